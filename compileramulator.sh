@@ -1,4 +1,4 @@
-sudo apt-get install libxerces-c-dev
+sudo apt-get install libxerces-c-dev zlib1g-dev liblzma-dev
 cd ./common/DRAMPower
 make -j
 cd ../../ramulator
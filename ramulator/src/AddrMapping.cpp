@@ -0,0 +1,156 @@
+#include "AddrMapping.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace ramulator;
+
+static int find_level(const vector<string>& names, const string& name, const string& key){
+    auto itr = find(names.begin(), names.end(), name);
+    if (itr == names.end()) {
+        cerr << "Unknown level in " << key << ": " << name << endl;
+        exit(1);
+    }
+    return itr - names.begin();
+}
+
+AddrMapping::AddrMapping(const vector<string>& names, const vector<int>& bits,
+    int tx_bits, const string& mapping, const string& hash, const string& xors)
+    : masks(names.size(), 0), runs(names.size()){
+    // the parts of the mapping, from the most significant, and their bits
+    // (-1 for the rest of the level)
+    vector<pair<int, int>> parts;
+    vector<int> counted(names.size(), 0);
+    vector<int> rest(names.size(), -1);
+    for (unsigned int i = 0; i < mapping.size();) {
+        if (i + 2 > mapping.size()) {
+            cerr << "Bad address_mapping: " << mapping << endl;
+            exit(1);
+        }
+        int level = find_level(names, mapping.substr(i, 2), "address_mapping");
+        i += 2;
+        int width = -1;
+        if (i < mapping.size() && isdigit(mapping[i])) {
+            width = 0;
+            while (i < mapping.size() && isdigit(mapping[i]))
+                width = width * 10 + (mapping[i++] - '0');
+            counted[level] += width;
+        } else if (rest[level] >= 0) {
+            cerr << "address_mapping has " << names[level] << " twice without bits" << endl;
+            exit(1);
+        } else {
+            rest[level] = parts.size();
+        }
+        parts.push_back({level, width});
+    }
+    for (unsigned int l = 0; l < names.size(); l++) {
+        int left = bits[l] - counted[l];
+        if (rest[l] >= 0)
+            parts[rest[l]].second = left;
+        else if (left)
+            left = -1;
+        if (left < 0) {
+            cerr << "address_mapping gives " << names[l] << " " << counted[l]
+                 << " bits instead of " << bits[l] << endl;
+            exit(1);
+        }
+    }
+
+    // address bit of each bit of each level
+    vector<vector<int>> pos(names.size());
+    for (unsigned int l = 0; l < names.size(); l++)
+        pos[l].resize(bits[l]);
+    int total = 0;
+    for (auto& part : parts)
+        total += part.second;
+    if (total > 62) {
+        cerr << "address_mapping has more than 62 bits" << endl;
+        exit(1);
+    }
+    int next = total;
+    vector<int> used(names.size(), 0);  // bits of each level given to parts
+    for (auto& part : parts) {
+        int l = part.first;
+        int dst = bits[l] - used[l] - part.second;
+        next -= part.second;
+        if (part.second)
+            runs[l].push_back({next, part.second, dst});
+        for (int b = 0; b < part.second; b++)
+            pos[l][dst + b] = next + b;
+        used[l] += part.second;
+        masks[l] |= ((1l << part.second) - 1) << next;
+        if (next + part.second == total && part.second)
+            top = l;
+    }
+
+    // the address bits whose parity gives each bit of each level, the bit
+    // itself by default
+    vector<vector<long>> parity(names.size());
+    for (unsigned int l = 0; l < names.size(); l++)
+        for (int b = 0; b < bits[l]; b++)
+            parity[l].push_back(1l << pos[l][b]);
+
+    int row = find(names.begin(), names.end(), "Ro") - names.begin();
+    int row_bit = 0;
+    stringstream hashed(hash);
+    string name;
+    while (getline(hashed, name, ',')) {
+        if (name == "")
+            continue;
+        int l = find_level(names, name, "address_hash");
+        for (int b = 0; b < bits[l]; b++) {
+            if (row == int(names.size()) || l == row || row_bit == bits[row]) {
+                cerr << "address_hash needs more row bits than there are" << endl;
+                exit(1);
+            }
+            parity[l][b] ^= 1l << pos[row][row_bit++];
+        }
+    }
+
+    stringstream entries(xors);
+    string entry;
+    while (getline(entries, entry, ',')) {
+        if (entry == "")
+            continue;
+        size_t colon = entry.find(':');
+        int l = find_level(names, entry.substr(0, 2), "address_xor");
+        int b = colon == string::npos ? -1 : atoi(entry.substr(2, colon - 2).c_str());
+        if (b < 0 || b >= bits[l]) {
+            cerr << "Bad address_xor entry: " << entry << endl;
+            exit(1);
+        }
+        long mask = strtol(entry.substr(colon + 1).c_str(), NULL, 0);
+        if (!mask || (mask & ((1l << tx_bits) - 1))) {
+            cerr << "address_xor mask of " << entry.substr(0, colon)
+                 << " must be non-zero, without the " << tx_bits << " offset bits" << endl;
+            exit(1);
+        }
+        parity[l][b] = mask >> tx_bits;
+    }
+
+    // one-to-one: the bits of the address are independent, i.e., the masks
+    // restricted to the mapped bits have full rank (the bits above, e.g.,
+    // of another HMC stack, only flip bits of the index)
+    vector<long> matrix;
+    for (unsigned int l = 0; l < names.size(); l++)
+        for (int b = 0; b < bits[l]; b++) {
+            matrix.push_back(parity[l][b] & ((1l << total) - 1));
+            if (parity[l][b] != 1l << pos[l][b])
+                xor_bits.push_back({int(l), b, parity[l][b] ^ (1l << pos[l][b])});
+        }
+    for (int col = 0; col < total; col++) {
+        auto pivot = find_if(matrix.begin() + col, matrix.end(),
+            [col] (long m) {return (m >> col) & 1;});
+        if (pivot == matrix.end()) {
+            cerr << "The address mapping is not one-to-one (see address_hash and address_xor)" << endl;
+            exit(1);
+        }
+        swap(matrix[col], *pivot);
+        for (unsigned int r = 0; r < matrix.size(); r++)
+            if (int(r) != col && ((matrix[r] >> col) & 1))
+                matrix[r] ^= matrix[col];
+    }
+}
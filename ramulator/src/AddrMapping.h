@@ -0,0 +1,99 @@
+#ifndef __ADDR_MAPPING_H
+#define __ADDR_MAPPING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+namespace ramulator
+{
+
+// Decodes an address (in transactions, i.e., without its offset bits) into
+// the index of each level of a memory: channel (or vault), rank, bank, row,
+// column... Set up in the configuration file:
+//   address_mapping = RoBaRaCoCh
+//     the levels that take the bits of the address, from the most
+//     significant down (a preset such as RoBaRaCoCh is one of them). A level
+//     may be split, with the bits of a part after its name (e.g.,
+//     RoCoBaVaCo2): each part takes the next bits of the index, from the
+//     most significant, and the part without a count the bits the others
+//     leave.
+//   address_hash = Ba,Bg
+//     permutation-based interleaving: bit i of each level listed, in order,
+//     is XORed with the next unused bit of the row, from the lowest
+//   address_xor = Ba0:0x42000,Va1:0x1100080
+//     bit i of a level becomes the parity of the byte address bits in the
+//     mask (a row of an XOR matrix), after the hash above
+//
+// The levels are named by the level_name of the standard (Ch, Ra, Bg, Ba,
+// Sa, Ro, Co, Va). The mapping must be one-to-one. It is compiled into one
+// mask per level, so decoding a level is a bit extraction (PEXT when the
+// build targets BMI2) and the parity of a few masks.
+class AddrMapping {
+public:
+    // names and bits of each level, bits of the offset of a transaction
+    AddrMapping(const std::vector<std::string>& names, const std::vector<int>& bits,
+        int tx_bits, const std::string& mapping, const std::string& hash,
+        const std::string& xors);
+
+    // addr is the address without its tx_bits offset bits
+    void decode(long addr, int* vec) const
+    {
+        for (unsigned int l = 0; l < masks.size(); l++)
+            vec[l] = extract(addr, l);
+        for (auto& x : xor_bits)
+            vec[x.level] ^= __builtin_parityl(addr & x.mask) << x.bit;
+    }
+
+    int decode(long addr, int level) const
+    {
+        int index = extract(addr, level);
+        for (auto& x : xor_bits)
+            if (x.level == level)
+                index ^= __builtin_parityl(addr & x.mask) << x.bit;
+        return index;
+    }
+
+    // the level of the most significant bit
+    int highest() const {return top;}
+
+private:
+    // bits [shift, shift + width) of the address are bits [dst, dst + width)
+    // of the index of a level
+    struct Run {
+        int shift;
+        int width;
+        int dst;
+    };
+    // bit of a level, XORed with the parity of the address bits in mask
+    struct XorBit {
+        int level;
+        int bit;
+        long mask;
+    };
+
+    std::vector<uint64_t> masks;  // address bits of each level
+    std::vector<std::vector<Run>> runs;
+    std::vector<XorBit> xor_bits;
+    int top = 0;
+
+    int extract(long addr, int level) const
+    {
+#ifdef __BMI2__
+        return _pext_u64(addr, masks[level]);
+#else
+        int index = 0;
+        for (auto& run : runs[level])
+            index |= ((addr >> run.shift) & ((1l << run.width) - 1)) << run.dst;
+        return index;
+#endif
+    }
+};
+
+} /*namespace ramulator*/
+
+#endif /*__ADDR_MAPPING_H*/
@@ -1,5 +1,7 @@
 #include "Cache.h"
 
+#include <climits>
+
 #ifndef DEBUG_CACHE
 #define debug_cache(...)
 #else
@@ -13,9 +15,13 @@
 namespace ramulator
 {
 
+std::string Cache::replacement_name[int(Replacement::MAX)] = {
+  "lru", "srrip", "drrip", "random"
+};
+
 Cache::Cache(int size, int assoc, int block_size,
     int mshr_entry_num, Level level,
-    std::shared_ptr<CacheSystem> cachesys, bool pim_mode):
+    std::shared_ptr<CacheSystem> cachesys, const Config& configs):
     level(level), cachesys(cachesys), higher_cache(0),
     lower_cache(nullptr), size(size), assoc(assoc),
     block_size(block_size), mshr_entry_num(mshr_entry_num) {
@@ -23,7 +29,7 @@ Cache::Cache(int size, int assoc, int block_size,
   debug_cache("level %d size %d assoc %d block_size %d\n",
       int(level), size, assoc, block_size);
 
-  if(pim_mode){  
+  if(configs.pim_mode_enabled()){  
     latency[0] = 4;
     latency[1] = 4+0;
     latency[2] = 4+0+31;
@@ -56,6 +62,25 @@ Cache::Cache(int size, int assoc, int block_size,
   index_offset = calc_log2(block_size);
   tag_offset = calc_log2(block_num) + index_offset;
 
+  // Only the levels in use need a whole set
+  if (level >= cachesys->first_level && level <= cachesys->last_level
+      && size_t(size) < size_t(block_size) * assoc) {
+    std::cerr << level_string << " cache of " << size
+        << " bytes is smaller than one set" << std::endl;
+    exit(1);
+  }
+  lines.resize(size_t(block_num) * assoc);
+  replacement = cachesys->replacement;
+  psel = psel_max / 2;
+  rand_state = 0x2545F4914F6CDD1Dul + int(level);
+
+  unsigned int mshr_slots = 2;
+  while (mshr_slots < 2 * unsigned(mshr_entry_num)) {
+    mshr_slots *= 2;
+  }
+  mshr_table.resize(mshr_slots);
+  mshr_mask = mshr_slots - 1;
+
   debug_cache("index_offset %d", index_offset);
   debug_cache("index_mask 0x%x", index_mask);
   debug_cache("tag_offset %d", tag_offset);
@@ -108,6 +133,16 @@ Cache::Cache(int size, int assoc, int block_size,
                          .desc("cache set not available")
                          .precision(0)
                          ;
+
+  std::string prefix = level_string;
+  prefix[0] = 'l';
+  prefetcher.reset(Prefetcher::create(configs, prefix, level_string,
+      block_size, mshr_entry_num));
+  if (prefetcher && (level < cachesys->first_level || level > cachesys->last_level)) {
+    std::cerr << prefix << "_prefetcher is set, but the " << level_string
+        << " cache is not simulated" << std::endl;
+    exit(1);
+  }
 }
 
 bool Cache::send(Request req) {
@@ -122,21 +157,24 @@ bool Cache::send(Request req) {
     assert(req.type == Request::Type::READ);
     cache_read_access++;
   }
-  // If there isn't a set, create it.
-  auto& lines = get_lines(req.addr);
-  std::list<Line>::iterator line;
+  Line* line = find_line(req.addr);
 
-  if (is_hit(lines, req.addr, &line)) {
-    lines.push_back(Line(req.addr, get_tag(req.addr), false,
-        line->dirty || (req.type == Request::Type::WRITE)));
-    lines.erase(line);
-    cachesys->hit_list.push_back(
-        make_pair(cachesys->clk + latency[int(level)], req));
+  if (line != nullptr && !line->lock) {
+    line->addr = req.addr;
+    line->dirty = line->dirty || (req.type == Request::Type::WRITE);
+    touch(*line);
+    cachesys->add_hit(cachesys->clk + latency[int(level)], req);
 
     debug_cache("hit, update timestamp %ld", cachesys->clk);
     debug_cache("hit finish time %ld",
         cachesys->clk + latency[int(level)]);
 
+    bool prefetch_hit = line->prefetched;
+    if (prefetch_hit) {
+      prefetcher->prefetch_useful++;
+      line->prefetched = false;
+    }
+    train(req, false, prefetch_hit);
     return true;
 
   } else {
@@ -159,17 +197,23 @@ bool Cache::send(Request req) {
 
     // Look it up in MSHR entries
     assert(req.type == Request::Type::READ);
-    auto mshr = hit_mshr(req.addr);
-    if (mshr != mshr_entries.end()) {
+    int mshr = hit_mshr(req.addr);
+    if (mshr != -1) {
       debug_cache("hit mshr");
       cache_mshr_hit++;
-      mshr->second->dirty = dirty || mshr->second->dirty;
+      Line& pending = lines[mshr_table[mshr].line];
+      pending.dirty = dirty || pending.dirty;
+      if (pending.prefetched) {
+        prefetcher->prefetch_late++;
+        pending.prefetched = false;
+      }
+      train(req, true, false);
       return true;
     }
 
     // All requests come to this stage will be READ, so they
     // should be recorded in MSHR entries.
-    if (mshr_entries.size() == mshr_entry_num) {
+    if (mshr_count == mshr_entry_num) {
       // When no MSHR entries available, the miss request
       // is stalling.
       cache_mshr_unavailable++;
@@ -178,66 +222,152 @@ bool Cache::send(Request req) {
     }
 
     // Check whether there is a line available
-    if (all_sets_locked(lines)) {
+    if (all_sets_locked(get_set(req.addr))) {
       cache_set_unavailable++;
       return false;
     }
 
-    auto newline = allocate_line(lines, req.addr);
-    if (newline == lines.end()) {
+    Line* newline = allocate_line(req.addr);
+    if (newline == nullptr) {
       return false;
     }
 
     newline->dirty = dirty;
 
     // Add to MSHR entries
-    mshr_entries.push_back(make_pair(req.addr, newline));
+    add_mshr(req.addr, newline - lines.data());
 
     // Send the request to next level;
-    if (!is_last_level) {
-      lower_cache->send(req);
-    } else {
-      cachesys->wait_list.push_back(
-          make_pair(cachesys->clk + latency[int(level)], req));
-    }
+    send_lower(req);
+    train(req, true, false);
     return true;
   }
 }
 
-void Cache::evictline(long addr, bool dirty) {
+void Cache::send_lower(const Request& req) {
+  if (!is_last_level) {
+    if (!lower_cache->send(req)) {
+      if (retry_list.empty()) {
+        cachesys->retrying.push_back(this);
+      }
+      retry_list.push_back(req);
+    }
+  } else {
+    cachesys->add_wait(cachesys->clk + latency[int(level)], req);
+  }
+}
+
+void Cache::train(const Request& req, bool miss, bool prefetch_hit) {
+  if (!prefetcher) {
+    return;
+  }
+  if (miss) {
+    prefetcher->prefetch_demand_misses++;
+  }
+  prefetch_lines.clear();
+  prefetcher->access(req.addr >> index_offset, miss, prefetch_hit,
+      prefetch_lines);
+  for (long line : prefetch_lines) {
+    prefetch(req, line << index_offset);
+  }
+}
+
+void Cache::prefetch(Request req, long addr) {
+  // Already here or on its way
+  if (find_line(addr) != nullptr) {
+    return;
+  }
+  // Keeps prefetch_mshr_reserve entries for demand misses
+  if (mshr_count + prefetcher->mshr_reserve >= mshr_entry_num
+      || all_sets_locked(get_set(addr))) {
+    prefetcher->prefetch_dropped++;
+    return;
+  }
+  Line* newline = allocate_line(addr);
+  if (newline == nullptr) {
+    prefetcher->prefetch_dropped++;
+    return;
+  }
+  newline->prefetched = true;
+  add_mshr(addr, newline - lines.data());
+
+  debug_cache("prefetch %lx @level %d", addr, int(level));
+  prefetcher->prefetch_issued++;
+  req.addr = addr;
+  req.type = Request::Type::READ;
+  send_lower(req);
+}
 
-  auto it = cache_lines.find(get_index(addr));
-  assert(it != cache_lines.end()); // check inclusive cache
-  auto& lines = it->second;
-  auto line = find_if(lines.begin(), lines.end(),
-      [addr, this](Line l){return (l.tag == get_tag(addr));});
+void Cache::retry() {
+  size_t kept = 0;
+  for (size_t i = 0; i < retry_list.size(); i++) {
+    if (!lower_cache->send(retry_list[i])) {
+      retry_list[kept++] = retry_list[i];
+    }
+  }
+  retry_list.erase(retry_list.begin() + kept, retry_list.end());
+}
+
+void Cache::warm(Request req) {
+  Line* line = find_line(req.addr);
+  bool dirty = (req.type == Request::Type::WRITE);
+
+  if (line != nullptr && !line->lock) {
+    line->addr = req.addr;
+    line->dirty = line->dirty || dirty;
+    touch(*line);
+    return;
+  }
+
+  // Nothing is in flight while warming, so no line is locked and the
+  // miss always finds a victim.
+  assert(mshr_count == 0);
+  cachesys->warming = true;
+  Line* newline = allocate_line(req.addr);
+  cachesys->warming = false;
+  assert(newline != nullptr);
+  newline->lock = false;
+  newline->dirty = dirty;
+
+  req.type = Request::Type::READ;
+  if (!is_last_level) {
+    lower_cache->warm(req);
+  } else {
+    cachesys->warm_memory(req);
+  }
+}
+
+void Cache::evictline(long addr, bool dirty) {
+  Line* line = find_line(addr);
+  assert(line != nullptr); // check inclusive cache
 
-  assert(line != lines.end());
   // Update LRU queue. The dirty bit will be set if the dirty
   // bit inherited from higher level(s) is set.
-  lines.push_back(Line(addr, get_tag(addr), false,
-      dirty || line->dirty));
-  lines.erase(line);
+  line->addr = addr;
+  line->lock = false;
+  line->dirty = dirty || line->dirty;
+  if (replacement == Replacement::LRU) {
+    touch(*line);
+  }
 }
 
 std::pair<long, bool> Cache::invalidate(long addr) {
   long delay = latency_each[int(level)];
   bool dirty = false;
 
-  auto& lines = get_lines(addr);
-  if (lines.size() == 0) {
+  Line* set = get_set(addr);
+  if (std::none_of(set, set + assoc, [](const Line& l){return l.valid;})) {
     // The line of this address doesn't exist.
     return make_pair(0, false);
   }
-  auto line = find_if(lines.begin(), lines.end(),
-      [addr, this](Line l){return (l.tag == get_tag(addr));});
+  Line* line = find_line(addr);
 
   // If the line is in this level cache, then erase it from
   // the buffer.
-  if (line != lines.end()) {
+  if (line != nullptr) {
     assert(!line->lock);
     debug_cache("invalidate %lx @ level %d", addr, int(level));
-    lines.erase(line);
+    line->valid = false;
   } else {
     // If it's not in current level, then no need to go up.
     return make_pair(delay, false);
@@ -262,10 +392,11 @@ std::pair<long, bool> Cache::invalidate(long addr) {
 }
 
 
-void Cache::evict(std::list<Line>* lines,
-    std::list<Line>::iterator victim) {
+void Cache::evict(Line* victim) {
   debug_cache("level %d miss evict victim %lx", int(level), victim->addr);
-  cache_eviction++;
+  if (!cachesys->warming) {
+    cache_eviction++;
+  }
 
   long addr = victim->addr;
   long invalidate_time = 0;
@@ -290,11 +421,13 @@ void Cache::evict(std::list<Line>* lines,
     lower_cache->evictline(addr, dirty);
   } else {
     // LLC eviction
-    if (dirty) {
+    if (dirty && cachesys->warming) {
+      cachesys->warm_memory(Request(addr, Request::Type::WRITE, 0));
+    } else if (dirty) {
       Request write_req(addr, Request::Type::WRITE, 0); // write memory requests are caused by eviction at LLC, which is highly reordered and most of them suffer from conflicts. Here we don't differentiate statistics related with write requests from different cores.
-      cachesys->wait_list.push_back(make_pair(
+      cachesys->add_wait(
           cachesys->clk + invalidate_time + latency[int(level)],
-          write_req));
+          write_req);
 
       debug_cache("inject one write request to memory system "
           "addr %lx, invalidate time %ld, issue time %ld",
@@ -303,51 +436,132 @@ void Cache::evict(std::list<Line>* lines,
     }
   }
 
-  lines->erase(victim);
+  victim->valid = false;
 }
 
-std::list<Cache::Line>::iterator Cache::allocate_line(
-    std::list<Line>& lines, long addr) {
-  // See if an eviction is needed
-  if (need_eviction(lines, addr)) {
-    // Get victim.
-    // The first one might still be locked due to reorder in MC
-    auto victim = find_if(lines.begin(), lines.end(),
-        [this](Line line) {
-          bool check = !line.lock;
-          if (!is_first_level) {
-            for (auto hc : higher_cache) {
-              if(!check) {
-                return check;
-              }
-              check = check && hc->check_unlock(line.addr);
-            }
-          }
-          return check;
-        });
-    if (victim == lines.end()) {
-      return victim;  // doesn't exist a line that's already unlocked in each level
+Cache::Line* Cache::find_victim(Line* set) {
+  // A line might still be locked due to reorder in MC
+  Line* victim = nullptr;
+  switch (replacement) {
+    case Replacement::LRU:
+      for (unsigned int i = 0; i < assoc; i++) {
+        if (set[i].lock || (victim && set[i].last_use > victim->last_use)) {
+          continue;
+        }
+        if (can_evict(set[i])) {
+          victim = &set[i];
+        }
+      }
+      return victim;
+
+    case Replacement::SRRIP:
+    case Replacement::DRRIP: {
+      // The first line with the highest re-reference prediction value. The
+      // lines of the set age until it reaches max_rrpv.
+      for (unsigned int i = 0; i < assoc; i++) {
+        if (set[i].lock || (victim && set[i].rrpv <= victim->rrpv)) {
+          continue;
+        }
+        if (can_evict(set[i])) {
+          victim = &set[i];
+        }
+      }
+      if (victim == nullptr) {
+        return nullptr;
+      }
+      int age = max_rrpv - victim->rrpv;
+      if (age) {
+        for (unsigned int i = 0; i < assoc; i++) {
+          set[i].rrpv = min(set[i].rrpv + age, max_rrpv);
+        }
+      }
+      return victim;
+    }
+
+    case Replacement::Random: {
+      unsigned int candidates = 0;
+      for (unsigned int i = 0; i < assoc; i++) {
+        candidates += can_evict(set[i]);
+      }
+      if (!candidates) {
+        return nullptr;
+      }
+      unsigned int pick = next_rand() % candidates;
+      for (unsigned int i = 0; ; i++) {
+        if (can_evict(set[i]) && !pick--) {
+          return &set[i];
+        }
+      }
     }
-    assert(victim != lines.end());
-    evict(&lines, victim);
+
+    default:
+      assert(false);
+      return nullptr;
   }
+}
 
-  // Allocate newline, with lock bit on and dirty bit off
-  lines.push_back(Line(addr, get_tag(addr)));
-  auto last_element = lines.end();
-  --last_element;
-  return last_element;
+void Cache::insert(Line& line, int index) {
+  switch (replacement) {
+    case Replacement::LRU:
+      line.last_use = ++use_clk;
+      break;
+    case Replacement::SRRIP:
+      line.rrpv = max_rrpv - 1;
+      break;
+    case Replacement::DRRIP: {
+      // Set dueling: the leader sets always insert as SRRIP or as bimodal
+      // RRIP, which inserts at max_rrpv but for one line in 32. The other
+      // sets follow the one that has fewer misses.
+      bool bimodal;
+      if (index % dueling_sets == 0) {
+        psel = min(psel + 1, psel_max);
+        bimodal = false;
+      } else if (index % dueling_sets == 1) {
+        psel = max(psel - 1, 0);
+        bimodal = true;
+      } else {
+        bimodal = psel > psel_max / 2;
+      }
+      line.rrpv = (bimodal && next_rand() % 32) ? max_rrpv : max_rrpv - 1;
+      break;
+    }
+    default:
+      break;
+  }
 }
 
-bool Cache::is_hit(std::list<Line>& lines, long addr,
-    std::list<Line>::iterator* pos_ptr) {
-  auto pos = find_if(lines.begin(), lines.end(),
-      [addr, this](Line l){return (l.tag == get_tag(addr));});
-  *pos_ptr = pos;
-  if (pos == lines.end()) {
-    return false;
+Cache::Line* Cache::allocate_line(long addr) {
+  Line* set = get_set(addr);
+  Line* newline = nullptr;
+  for (unsigned int i = 0; i < assoc; i++) {
+    if (!set[i].valid) {
+      if (newline == nullptr) {
+        newline = &set[i];
+      }
+    } else {
+      // Due to MSHR, the program can't reach here. Just for checking
+      assert(set[i].tag != get_tag(addr));
+    }
   }
-  return !pos->lock;
+
+  // See if an eviction is needed
+  if (newline == nullptr) {
+    newline = find_victim(set);
+    if (newline == nullptr) {
+      return nullptr;  // doesn't exist a line that's already unlocked in each level
+    }
+    evict(newline);
+  }
+
+  // Allocate newline, with lock bit on and dirty bit off
+  newline->addr = addr;
+  newline->tag = get_tag(addr);
+  newline->valid = true;
+  newline->lock = true;
+  newline->dirty = false;
+  newline->prefetched = false;
+  insert(*newline, get_index(addr));
+  return newline;
 }
 
 void Cache::concatlower(Cache* lower) {
@@ -356,33 +570,40 @@ void Cache::concatlower(Cache* lower) {
   lower->higher_cache.push_back(this);
 };
 
-bool Cache::need_eviction(const std::list<Line>& lines, long addr) {
-  if (find_if(lines.begin(), lines.end(),
-      [addr, this](Line l){
-        return (get_tag(addr) == l.tag);})
-      != lines.end()) {
-    // Due to MSHR, the program can't reach here. Just for checking
-    assert(false);
-  } else {
-    if (lines.size() < assoc) {
-      return false;
-    } else {
-      return true;
+void Cache::add_mshr(long addr, int line) {
+  addr = align(addr);
+  unsigned int i = mshr_slot(addr);
+  while (mshr_table[i].addr != -1) {
+    i = (i + 1) & mshr_mask;
+  }
+  mshr_table[i].addr = addr;
+  mshr_table[i].line = line;
+  mshr_count++;
+}
+
+void Cache::remove_mshr(unsigned int slot) {
+  // Backward shift: the entries after the hole that may take its place
+  // move up, so that no lookup stops at the hole too early
+  unsigned int hole = slot;
+  for (unsigned int i = (slot + 1) & mshr_mask; mshr_table[i].addr != -1;
+      i = (i + 1) & mshr_mask) {
+    unsigned int home = mshr_slot(mshr_table[i].addr);
+    if (((i - home) & mshr_mask) >= ((i - hole) & mshr_mask)) {
+      mshr_table[hole] = mshr_table[i];
+      hole = i;
     }
   }
+  mshr_table[hole].addr = -1;
+  mshr_count--;
 }
 
 void Cache::callback(Request& req) {
   debug_cache("level %d", int(level));
 
-  auto it = find_if(mshr_entries.begin(), mshr_entries.end(),
-      [&req, this](std::pair<long, std::list<Line>::iterator> mshr_entry) {
-        return (align(mshr_entry.first) == align(req.addr));
-      });
-
-  if (it != mshr_entries.end()) {
-    it->second->lock = false;
-    mshr_entries.erase(it);
+  int mshr = hit_mshr(req.addr);
+  if (mshr != -1) {
+    lines[mshr_table[mshr].line].lock = false;
+    remove_mshr(mshr);
   }
 
   if (higher_cache.size()) {
@@ -392,37 +613,70 @@ void Cache::callback(Request& req) {
   }
 }
 
+void Cache::calc_stats() {
+  if (prefetcher) {
+    prefetcher->calc_stats();
+  }
+}
+
+void Cache::checkpoint(Checkpoint& ckpt) {
+  ckpt.section("cache " + level_string);
+  assert(mshr_count == 0 && retry_list.empty());
+  ckpt.io(use_clk);
+  ckpt.io(psel);
+  ckpt.io(rand_state);
+  ckpt.io(lines);
+}
+
 void CacheSystem::tick() {
   debug_cache("clk %ld", clk);
 
   ++clk;
 
-  // Sends ready waiting request to memory
-  auto it = wait_list.begin();
-  while (it != wait_list.end() && clk >= it->first) {
-    if (!send_memory(it->second)) {
-      ++it;
+  for (size_t i = 0; i < retrying.size(); ) {
+    retrying[i]->retry();
+    if (retrying[i]->has_retries()) {
+      i++;
     } else {
+      retrying.erase(retrying.begin() + i);
+    }
+  }
 
-      debug_cache("complete req: addr %lx", (it->second).addr);
+  // Sends ready waiting request to memory, after the ones memory did not
+  // take before
+  auto& ready = waiting.at(clk);
+  for (auto& wait : ready) {
+    blocked.push_back(wait.second);
+  }
+  waiting.count -= ready.size();
+  ready.clear();
 
-      it = wait_list.erase(it);
+  size_t kept = 0;
+  for (size_t i = 0; i < blocked.size(); i++) {
+    if (!send_memory(blocked[i])) {
+      blocked[kept++] = blocked[i];
+    } else {
+      debug_cache("complete req: addr %lx", blocked[i].addr);
     }
   }
+  blocked.erase(blocked.begin() + kept, blocked.end());
 
   // hit request callback
-  it = hit_list.begin();
-  while (it != hit_list.end()) {
-    if (clk >= it->first) {
-      it->second.callback(it->second);
+  due.swap(hits.at(clk));
+  hits.count -= due.size();
+  for (auto& hit : due) {
+    hit.second.callback(hit.second);
 
-      debug_cache("finish hit: addr %lx", (it->second).addr);
+    debug_cache("finish hit: addr %lx", hit.second.addr);
+  }
+  due.clear();
+}
 
-      it = hit_list.erase(it);
-    } else {
-      ++it;
-    }
+long CacheSystem::get_next_event() {
+  if (blocked.size() || retrying.size()) {
+    return clk + 1;
   }
+  return min(waiting.next(clk), hits.next(clk));
 }
 
 } // namespace ramulator
@@ -1,18 +1,21 @@
 #ifndef __CACHE_H
 #define __CACHE_H
 
+#include "Checkpoint.h"
 #include "Config.h"
+#include "Prefetcher.h"
 #include "Request.h"
 #include "Statistics.h"
 #include <algorithm>
+#include <climits>
 #include <cstdio>
+#include <cstdlib>
 #include <cassert>
 #include <functional>
-#include <list>
-#include <map>
+#include <iostream>
 #include <memory>
-#include <queue>
-#include <list>
+#include <string>
+#include <vector>
 
 namespace ramulator
 {
@@ -39,19 +42,30 @@ public:
   } level;
   std::string level_string;
 
+  // Replacement policies (cache_replacement in the configuration file)
+  enum class Replacement {
+    LRU,    // least recently used (default)
+    SRRIP,  // static re-reference interval prediction, 2-bit
+    DRRIP,  // dynamic RRIP, set dueling between SRRIP and bimodal RRIP
+    Random,
+    MAX
+  };
+  static std::string replacement_name[int(Replacement::MAX)];
+
+  // The lines of all sets are kept in one array, assoc ways per set.
   struct Line {
     long addr;
     long tag;
+    bool valid = false;
     bool lock; // When the lock is on, the value is not valid yet.
     bool dirty;
-    Line(long addr, long tag):
-        addr(addr), tag(tag), lock(true), dirty(false) {}
-    Line(long addr, long tag, bool lock, bool dirty):
-        addr(addr), tag(tag), lock(lock), dirty(dirty) {}
+    bool prefetched; // brought in by a prefetch, not used by a demand yet
+    int rrpv;      // re-reference prediction value (RRIP)
+    long last_use; // order of the last access (LRU)
   };
 
   Cache(int size, int assoc, int block_size, int mshr_entry_num,
-      Level level, std::shared_ptr<CacheSystem> cachesys, bool pim_mode);
+      Level level, std::shared_ptr<CacheSystem> cachesys, const Config& configs);
 
   // L1, L2, L3 accumulated latencies
   int latency[int(Level::MAX)] = {4, 4 + 12, 4 + 12 + 31};
@@ -68,6 +82,23 @@ public:
 
   void callback(Request& req);
 
+  // Sends the misses the lower level could not take yet, called every
+  // cycle while there are any
+  void retry();
+  bool has_retries() const {return !retry_list.empty();}
+
+  // Functional warming: updates the lines and the replacement state for req
+  // without timing or statistics, and passes a miss (and a dirty victim of
+  // the last level) on to the lower level or to CacheSystem::warm_memory.
+  void warm(Request req);
+
+  // computes the prefetcher statistics at the end of the run
+  void calc_stats();
+
+  // Saves or restores the lines of every set in LRU order, with their
+  // replacement state. No line may be waiting for memory.
+  void checkpoint(Checkpoint& ckpt);
+
 protected:
 
   bool is_first_level;
@@ -80,9 +111,43 @@ protected:
   unsigned int index_offset;
   unsigned int tag_offset;
   unsigned int mshr_entry_num;
-  std::vector<std::pair<long, std::list<Line>::iterator>> mshr_entries;
 
-  std::map<int, std::list<Line> > cache_lines;
+  std::vector<Line> lines;
+  Replacement replacement;
+  long use_clk = 0;
+  // DRRIP policy selector, counts up on misses of the SRRIP leader sets
+  // and down on misses of the bimodal ones
+  int psel;
+  unsigned long rand_state;
+  static const int max_rrpv = 3;
+  static const int psel_max = 1023;
+  static const int dueling_sets = 32;
+
+  // misses the lower level did not accept, in the order they came
+  std::vector<Request> retry_list;
+
+  std::unique_ptr<Prefetcher> prefetcher;
+  std::vector<long> prefetch_lines;
+
+  // Trains the prefetcher on an accepted demand access and issues the
+  // prefetches it proposes
+  void train(const Request& req, bool miss, bool prefetch_hit);
+  // Allocates the line of addr and requests it from the lower level, like
+  // a demand miss that nothing waits for; req carries the callback
+  void prefetch(Request req, long addr);
+  // Sends a miss to the lower level or to memory
+  void send_lower(const Request& req);
+
+  // The MSHR entries are found by line address in an open-addressing hash
+  // table (linear probing, at most half full). line is the index of the
+  // line in lines that waits for the data.
+  struct MSHR {
+    long addr = -1;
+    int line;
+  };
+  std::vector<MSHR> mshr_table;
+  unsigned int mshr_mask;
+  unsigned int mshr_count = 0;
 
   int calc_log2(int val) {
       int n = 0;
@@ -104,6 +169,43 @@ protected:
     return (addr & ~(block_size-1l));
   }
 
+  // The first way of the set that holds addr
+  Line* get_set(long addr) {
+    return &lines[size_t(get_index(addr)) * assoc];
+  }
+
+  // The line of addr in its set, or nullptr
+  Line* find_line(long addr) {
+    Line* set = get_set(addr);
+    long tag = get_tag(addr);
+    for (unsigned int i = 0; i < assoc; i++) {
+      if (set[i].valid && set[i].tag == tag) {
+        return &set[i];
+      }
+    }
+    return nullptr;
+  }
+
+  unsigned long next_rand() {
+    // xorshift64
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+  }
+
+  // Updates the replacement state of a line that is accessed again
+  void touch(Line& line) {
+    if (replacement == Replacement::LRU) {
+      line.last_use = ++use_clk;
+    } else if (replacement != Replacement::Random) {
+      line.rrpv = 0;
+    }
+  }
+
+  // Sets the replacement state of a line allocated in set index
+  void insert(Line& line, int index);
+
   // Evict the cache line from higher level to this level.
   // Pass the dirty bit and update LRU queue.
   void evictline(long addr, bool dirty);
@@ -117,81 +219,66 @@ protected:
   // Evict the victim from current set of lines.
   // First do invalidation, then call evictline(L1 or L2) or send
   // a write request to memory(L3) when dirty bit is on.
-  void evict(std::list<Line>* lines,
-      std::list<Line>::iterator victim);
+  void evict(Line* victim);
+
+  // Chooses the line of the full set to be replaced among the ones that
+  // are unlocked in each level, nullptr if there is none.
+  Line* find_victim(Line* set);
 
   // First test whether need eviction, if so, do eviction by
   // calling evict function. Then allocate a new line and return
-  // the iterator points to it.
-  std::list<Line>::iterator allocate_line(
-      std::list<Line>& lines, long addr);
-
-  // Check whether the set to hold addr has space or eviction is
-  // needed.
-  bool need_eviction(const std::list<Line>& lines, long addr);
+  // a pointer to it, or nullptr if no line can be evicted.
+  Line* allocate_line(long addr);
 
-  // Check whether this addr is hit and fill in the pos_ptr with
-  // the iterator to the hit line or lines.end()
-  bool is_hit(std::list<Line>& lines, long addr,
-              std::list<Line>::iterator* pos_ptr);
-
-  bool all_sets_locked(const std::list<Line>& lines) {
-    if (lines.size() < assoc) {
-      return false;
-    }
-    for (const auto& line : lines) {
-      if (!line.lock) {
+  bool all_sets_locked(const Line* set) {
+    for (unsigned int i = 0; i < assoc; i++) {
+      if (!set[i].valid || !set[i].lock) {
         return false;
       }
     }
     return true;
   }
 
-  bool check_unlock(long addr) {
-    auto it = cache_lines.find(get_index(addr));
-    if (it == cache_lines.end()) {
-      return true;
-    } else {
-      auto& lines = it->second;
-      auto line = find_if(lines.begin(), lines.end(),
-          [addr, this](Line l){return (l.tag == get_tag(addr));});
-      if (line == lines.end()) {
-        return true;
-      } else {
-        bool check = !line->lock;
-        if (!is_first_level) {
-          for (auto hc : higher_cache) {
-            if (!check) {
-              return check;
-            }
-            check = check && hc->check_unlock(line->addr);
-          }
+  // Whether the line may leave this level: unlocked here and in each
+  // higher level
+  bool can_evict(const Line& line) {
+    if (line.lock) {
+      return false;
+    }
+    if (!is_first_level) {
+      for (auto hc : higher_cache) {
+        if (!hc->check_unlock(line.addr)) {
+          return false;
         }
-        return check;
       }
     }
+    return true;
+  }
+
+  bool check_unlock(long addr) {
+    Line* line = find_line(addr);
+    return line == nullptr || can_evict(*line);
   }
 
-  std::vector<std::pair<long, std::list<Line>::iterator>>::iterator
-  hit_mshr(long addr) {
-    auto mshr_it =
-        find_if(mshr_entries.begin(), mshr_entries.end(),
-            [addr, this](std::pair<long, std::list<Line>::iterator>
-                   mshr_entry) {
-              return (align(mshr_entry.first) == align(addr));
-            });
-    return mshr_it;
+  unsigned int mshr_slot(long addr) {
+    unsigned long line = (unsigned long)(addr) >> index_offset;
+    return (unsigned int)((line * 0x9E3779B97F4A7C15ul) >> 32) & mshr_mask;
   }
 
-  std::list<Line>& get_lines(long addr) {
-    if (cache_lines.find(get_index(addr))
-        == cache_lines.end()) {
-      cache_lines.insert(make_pair(get_index(addr),
-          std::list<Line>()));
+  // The slot of the MSHR entry of addr, or -1
+  int hit_mshr(long addr) {
+    addr = align(addr);
+    for (unsigned int i = mshr_slot(addr); mshr_table[i].addr != -1;
+        i = (i + 1) & mshr_mask) {
+      if (mshr_table[i].addr == addr) {
+        return i;
+      }
     }
-    return cache_lines[get_index(addr)];
+    return -1;
   }
 
+  void add_mshr(long addr, int line);
+  void remove_mshr(unsigned int slot);
 };
 
 class CacheSystem {
@@ -203,7 +290,7 @@ public:
       } else if (configs.has_l3_cache()) {
         first_level = Cache::Level::L3;
       } else {
-        last_level = Cache::Level::MAX; // no cache
+        first_level = Cache::Level::MAX; // no cache
       }
 
       if (configs.has_l3_cache()) {
@@ -213,28 +300,117 @@ public:
       } else {
         last_level = Cache::Level::MAX; // no cache
       }
-      
-      first_level = Cache::Level::L1;
-      last_level = Cache::Level::L1;
+
+      // Unless cache_hierarchy = on, only L1 is simulated and takes the
+      // place of the last level
+      if (configs["cache_hierarchy"] != "on") {
+        first_level = Cache::Level::L1;
+        last_level = Cache::Level::L1;
+      }
+
+      replacement = Cache::Replacement::LRU;
+      if (configs.contains("cache_replacement")) {
+        std::string name = configs["cache_replacement"];
+        int i = 0;
+        while (i < int(Cache::Replacement::MAX) && name != Cache::replacement_name[i]) {
+          i++;
+        }
+        if (i == int(Cache::Replacement::MAX)) {
+          std::cerr << "Unknown cache_replacement: " << name << std::endl;
+          exit(1);
+        }
+        replacement = Cache::Replacement(i);
+      }
     }
 
-  // wait_list contains miss requests with their latencies in
-  // cache. When this latency is met, the send_memory function
-  // will be called to send the request to the memory system.
-  std::list<std::pair<long, Request> > wait_list;
+  // Adds a miss to be sent to memory at when
+  void add_wait(long when, const Request& req) {
+    waiting.add(clk, when, req);
+  }
 
-  // hit_list contains hit requests with their latencies in cache.
-  // callback function will be called when this latency is met and
-  // set the instruction status to ready in processor's window.
-  std::list<std::pair<long, Request> > hit_list;
+  // Adds a hit whose callback is called at when, which sets the
+  // instruction status to ready in processor's window
+  void add_hit(long when, const Request& req) {
+    hits.add(clk, when, req);
+  }
 
   std::function<bool(Request)> send_memory;
+  // takes the requests that reach memory while warming (see Cache::warm)
+  std::function<void(Request)> warm_memory;
+  bool warming = false;
 
   long clk = 0;
   void tick();
+  // clk of the next tick that sends a miss to memory or finishes a hit
+  long get_next_event();
+  // whether no request is waiting in the caches
+  bool is_empty() const {
+    return !waiting.count && !hits.count && blocked.empty() && retrying.empty();
+  }
 
   Cache::Level first_level;
   Cache::Level last_level;
+  Cache::Replacement replacement;
+
+  // caches with misses their lower level did not accept yet
+  std::vector<Cache*> retrying;
+
+private:
+  // Requests due at a clk, in buckets by clk modulo the number of buckets,
+  // which grows if a request is due further ahead than that.
+  struct TimingWheel {
+    std::vector<std::vector<std::pair<long, Request>>> buckets =
+        std::vector<std::vector<std::pair<long, Request>>>(64);
+    long count = 0;
+
+    std::vector<std::pair<long, Request>>& at(long when) {
+      return buckets[when & (buckets.size() - 1)];
+    }
+
+    void add(long clk, long when, const Request& req) {
+      assert(when > clk);
+      if (when - clk >= long(buckets.size())) {
+        grow(when - clk);
+      }
+      at(when).emplace_back(when, req);
+      count++;
+    }
+
+    void grow(long ahead) {
+      size_t size = buckets.size();
+      while (long(size) <= ahead) {
+        size *= 2;
+      }
+      std::vector<std::vector<std::pair<long, Request>>> old(size);
+      old.swap(buckets);
+      for (auto& bucket : old) {
+        for (auto& entry : bucket) {
+          at(entry.first).push_back(entry);
+        }
+      }
+    }
+
+    // the earliest clk after clk with a request, or LONG_MAX
+    long next(long clk) {
+      if (!count) {
+        return LONG_MAX;
+      }
+      for (long when = clk + 1; ; when++) {
+        if (at(when).size()) {
+          return when;
+        }
+      }
+    }
+  };
+
+  // misses waiting for their latency in cache, then sent to memory
+  TimingWheel waiting;
+  // hits waiting for their latency in cache
+  TimingWheel hits;
+  // misses due that memory did not accept yet, in the order they were due
+  std::vector<Request> blocked;
+  // the hits of the current tick
+  std::vector<std::pair<long, Request>> due;
 };
 
 } // namespace ramulator
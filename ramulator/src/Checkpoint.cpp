@@ -0,0 +1,52 @@
+#include "Checkpoint.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace ramulator;
+
+const char Checkpoint::magic[8] = {'R', 'A', 'M', 'C', 'K', 'P', 'T', '\0'};
+
+Checkpoint::Checkpoint(const string& fname, bool saving)
+    : fname(fname), saving(saving){
+    file.open(fname, (saving ? ios::out | ios::trunc : ios::in) | ios::binary);
+    if (!file.good()) {
+        cerr << "Bad checkpoint file: " << fname << endl;
+        exit(1);
+    }
+
+    char file_magic[8];
+    uint32_t file_version = version;
+    memcpy(file_magic, magic, sizeof(magic));
+    bytes(file_magic, sizeof(file_magic));
+    io(file_version);
+    if (memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version) {
+        fail("not a checkpoint of this version of Ramulator");
+    }
+}
+
+void Checkpoint::section(const string& name){
+    string file_name = name;
+    io(file_name);
+    if (file_name != name) {
+        fail("expected " + name + ", found " + file_name + ", was it taken with another configuration?");
+    }
+}
+
+void Checkpoint::fail(const string& what){
+    cerr << "Bad checkpoint " << fname << ": " << what << endl;
+    exit(1);
+}
+
+void Checkpoint::bytes(void* data, size_t size){
+    if (saving) {
+        file.write((const char*) data, size);
+    }
+    else {
+        file.read((char*) data, size);
+    }
+    if (!file.good()) {
+        fail(saving ? "write failed" : "file ends early");
+    }
+}
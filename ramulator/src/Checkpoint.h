@@ -0,0 +1,125 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ramulator
+{
+
+// A binary file with the warmed-up state of a simulation: the trace positions,
+// the contents of the caches, the page table and the state and timing of the
+// DRAM. It is taken when no request is left anywhere in the system (see
+// --checkpoint), so queues, windows and callbacks are empty and not part of it.
+//
+// Each component passes its state through io() in a checkpoint(Checkpoint&)
+// method, which writes the checkpoint and reads it back with the same code.
+// A restored checkpoint must come from the same configuration, section()
+// stops a run whose components do not line up with the file.
+class Checkpoint {
+public:
+    static const char magic[8];
+    static const uint32_t version = 6;
+
+    // opens fname to write a checkpoint (saving) or to read one
+    Checkpoint(const std::string& fname, bool saving);
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    bool is_saving() const {return saving;}
+    bool is_restoring() const {return !saving;}
+
+    // marks the start of the state of a component
+    void section(const std::string& name);
+    // stops with an error about the checkpoint file
+    void fail(const std::string& what);
+
+    template <typename V>
+    void io(V& value) {
+        static_assert(std::is_trivially_copyable<V>::value, "no io() for this type");
+        bytes(&value, sizeof(V));
+    }
+
+    void io(std::string& value) {
+        uint64_t n = value.size();
+        io(n);
+        value.resize(n);
+        if (n) bytes(&value[0], n);
+    }
+
+    template <typename A, typename B>
+    void io(std::pair<A, B>& value) {
+        io(value.first);
+        io(value.second);
+    }
+
+    // a vector sized by the configuration (non-empty when restoring) has to
+    // keep its size
+    template <typename V>
+    void io(std::vector<V>& values) {
+        uint64_t n = values.size();
+        io(n);
+        if (is_restoring() && values.size() && values.size() != n)
+            fail("sizes differ, was it taken with another configuration?");
+        values.resize(n);
+        io_elements(values, std::is_trivially_copyable<V>());
+    }
+
+    template <typename V>
+    void io(std::list<V>& values) {
+        uint64_t n = values.size();
+        io(n);
+        if (is_restoring())
+            values.resize(n);
+        for (auto& value : values)
+            io(value);
+    }
+
+    template <typename K, typename V>
+    void io(std::map<K, V>& values) {
+        uint64_t n = values.size();
+        io(n);
+        if (is_saving()) {
+            for (auto& kv : values) {
+                K key = kv.first;
+                io(key);
+                io(kv.second);
+            }
+            return;
+        }
+        values.clear();
+        for (uint64_t i = 0; i < n; i++) {
+            std::pair<K, V> kv;
+            io(kv);
+            values.insert(values.end(), std::move(kv));
+        }
+    }
+
+private:
+    std::string fname;
+    std::fstream file;
+    bool saving;
+
+    void bytes(void* data, size_t size);
+
+    template <typename V>
+    void io_elements(std::vector<V>& values, std::true_type) {
+        if (values.size()) bytes(values.data(), values.size() * sizeof(V));
+    }
+
+    template <typename V>
+    void io_elements(std::vector<V>& values, std::false_type) {
+        for (auto& value : values)
+            io(value);
+    }
+};
+
+} /*namespace ramulator*/
+
+#endif /*__CHECKPOINT_H*/
@@ -17,7 +17,9 @@ public:
     {
         PISA,
         ZSIM,
-        PIN
+        PIN,
+        DRAM,
+        BINARY
     } format;
 private:
     std::map<std::string, std::string> options;
@@ -51,6 +53,8 @@ public:
             format = Format::PISA;
         else if(trace.find("zsim") != std::string::npos)
             format = Format::ZSIM;
+        else if(trace.find("binary") != std::string::npos)
+            format = Format::BINARY;
         else
             format = Format::PIN;
     }
@@ -96,6 +100,11 @@ public:
     int get_subarrays() const {return get_int_value("subarrays");}
     int get_ranks() const {return get_int_value("ranks");}
     bool pim_mode_enabled () const {if(get_int_value("pim_mode") == 1) return true; return false;}
+    // PIM cores that run together with the host cores (--pim-trace), 0 if
+    // the cores are either host or PIM cores
+    int get_pim_core_num() const {
+      return contains("pim_trace") ? get_int_value("pim_cores") : 0;
+    }
     Format get_trace_format() const{return format;}
     std::string get_cpu_type() const{
        /*if (contains("core_type")) {
@@ -162,6 +171,16 @@ public:
       }
       return false;
     }
+    bool fast_forward() const {
+      // the default value is false
+      if (options.find("fast_forward") != options.end()) {
+        if ((options.find("fast_forward"))->second == "on") {
+          return true;
+        }
+        return false;
+      }
+      return false;
+    }
 };
 
 
@@ -8,7 +8,7 @@ using namespace ramulator;
 namespace ramulator
 {
 
-static vector<int> get_offending_subarray(DRAM<SALP>* channel, vector<int> & addr_vec){
+static AddrVec get_offending_subarray(DRAM<SALP>* channel, const AddrVec& addr_vec){
     int sa_id = 0;
     auto rank = channel->children[addr_vec[int(SALP::Level::Rank)]];
     auto bank = rank->children[addr_vec[int(SALP::Level::Bank)]];
@@ -18,7 +18,7 @@ static vector<int> get_offending_subarray(DRAM<SALP>* channel, vector<int> & add
             sa_id = sa_other->id;
             break;
         }
-    vector<int> offending = addr_vec;
+    AddrVec offending = addr_vec;
     offending[int(SALP::Level::SubArray)] = sa_id;
     offending[int(SALP::Level::Row)] = -1;
     return offending;
@@ -26,7 +26,7 @@ static vector<int> get_offending_subarray(DRAM<SALP>* channel, vector<int> & add
 
 
 template <>
-vector<int> Controller<SALP>::get_addr_vec(SALP::Command cmd, list<Request>::iterator req){
+AddrVec Controller<SALP>::get_addr_vec(SALP::Command cmd, list<Request>::iterator req){
     if (cmd == SALP::Command::PRE_OTHER)
         return get_offending_subarray(channel, req->addr_vec);
     else
@@ -39,7 +39,7 @@ bool Controller<SALP>::is_ready(list<Request>::iterator req){
     SALP::Command cmd = get_first_cmd(req);
     if (cmd == SALP::Command::PRE_OTHER){
 
-        vector<int> addr_vec = get_offending_subarray(channel, req->addr_vec);
+        AddrVec addr_vec = get_offending_subarray(channel, req->addr_vec);
         return channel->check(cmd, addr_vec.data(), clk);
     }
     else return channel->check(cmd, req->addr_vec.data(), clk);
@@ -67,7 +67,7 @@ void Controller<TLDRAM>::tick(){
                   channel->update_serving_requests(
                       req.addr_vec.data(), -1, clk);
           }
-            req.callback(req);
+            complete(req);
             pending.pop_front();
         }
     }
@@ -76,23 +76,14 @@ void Controller<TLDRAM>::tick(){
     refresh->tick_ref();
 
     /*** 3. Should we schedule writes? ***/
-    if (!write_mode) {
-        // yes -- write queue is almost full or read queue is empty
-        if (writeq.size() >= int(0.8 * writeq.max) || readq.size() == 0)
-            write_mode = true;
-    }
-    else {
-        // no -- write queue is almost empty and read queue is not empty
-        if (writeq.size() <= int(0.2 * writeq.max) && readq.size() != 0)
-            write_mode = false;
-    }
+    update_write_mode();
 
     /*** 4. Find the best command to schedule, if any ***/
     Queue* queue = !write_mode ? &readq : &writeq;
     if (otherq.size())
         queue = &otherq;  // "other" requests are rare, so we give them precedence over reads/writes
 
-    auto req = scheduler->get_head(queue->q);
+    auto req = get_request(queue);
     if (req == queue->q.end() || !is_ready(req)) {
         // we couldn't find a command to schedule -- let's try to be speculative
         auto cmd = TLDRAM::Command::PRE;
@@ -104,6 +95,7 @@ void Controller<TLDRAM>::tick(){
     }
 
     if (req->is_first_command) {
+        count_turnaround(req);
         int coreid = req->coreid;
         req->is_first_command = false;
         if (req->type == Request::Type::READ || req->type == Request::Type::WRITE) {
@@ -160,7 +152,7 @@ void Controller<TLDRAM>::tick(){
     }
 
     // remove request from queue
-    queue->q.erase(req);
+    queue->erase(req);
 }
 
 template<>
@@ -178,7 +170,7 @@ void Controller<WideIO2>::tick() {
               (*read_latency_sum) += req.depart - req.arrive;
               channel->update_serving_requests(req.addr_vec.data(), -1, clk);
             }
-            req.callback(req);
+            complete(req);
             pending.pop_front();
         }
     }
@@ -187,23 +179,14 @@ void Controller<WideIO2>::tick() {
     refresh->tick_ref();
 
     /*** 3. Should we schedule writes? ***/
-    if (!write_mode) {
-        // yes -- write queue is almost full or read queue is empty
-        if (writeq.size() >= int(0.8 * writeq.max) || readq.size() == 0)
-            write_mode = true;
-    }
-    else {
-        // no -- write queue is almost empty and read queue is not empty
-        if (writeq.size() <= int(0.2 * writeq.max) && readq.size() != 0)
-            write_mode = false;
-    }
+    update_write_mode();
 
     /*** 4. Find the best command to schedule, if any ***/
     Queue* queue = !write_mode ? &readq : &writeq;
     if (otherq.size())
         queue = &otherq;  // "other" requests are rare, so we give them precedence over reads/writes
 
-    auto req = scheduler->get_head(queue->q);
+    auto req = get_request(queue);
     if (req == queue->q.end() || !is_ready(req)) {
       if (!no_DRAM_latency) {
         // we couldn't find a command to schedule -- let's try to be speculative
@@ -219,6 +202,7 @@ void Controller<WideIO2>::tick() {
     }
 
     if (req->is_first_command) {
+        count_turnaround(req);
         req->is_first_command = false;
         int coreid = req->coreid;
         if (req->type == Request::Type::READ || req->type == Request::Type::WRITE) {
@@ -279,10 +263,33 @@ void Controller<WideIO2>::tick() {
 
     // remove request from queue
     if (req->burst_count == 0) {
-        queue->q.erase(req);
+        queue->erase(req);
     }
 }
 
+// PRE_OTHER is checked against another subarray than the one of the request
+// (see is_ready), so the scheduler keeps looking at every request.
+template<>
+void Controller<SALP>::index_queues() {
+}
+
+// These controllers schedule around the generic readiness checks, so they
+// are never fast-forwarded.
+template<>
+long Controller<SALP>::get_next_event() {
+    return clk + 1;
+}
+
+template<>
+long Controller<TLDRAM>::get_next_event() {
+    return clk + 1;
+}
+
+template<>
+long Controller<WideIO2>::get_next_event() {
+    return clk + 1;
+}
+
 template<>
 void Controller<DDR4>::fake_ideal_DRAM(const Config& configs) {
     if (configs["no_DRAM_latency"] == "true") {
@@ -6,6 +6,8 @@
 #include <deque>
 #include <fstream>
 #include <list>
+#include <memory>
+#include <numeric>
 #include <string>
 #include <vector>
 
@@ -13,8 +15,10 @@
 #include "DRAM.h"
 #include "Refresh.h"
 #include "Request.h"
+#include "RequestQueue.h"
 #include "Scheduler.h"
 #include "Statistics.h"
+#include "WritePolicy.h"
 
 #include "HMC.h"
 
@@ -27,8 +31,7 @@
 #include "GDDR5.h"
 #include "HBM.h"
 
-#include "libdrampower/LibDRAMPower.h"
-#include "xmlparser/MemSpecParser.h"
+#include "DRAMPowerFeed.h"
 
 using namespace std;
 
@@ -60,6 +63,10 @@ public:
     ScalarStat* read_req_queue_length_sum;
     ScalarStat* write_req_queue_length_sum;
 
+    ScalarStat* write_coalesced;
+    ScalarStat* read_write_turnarounds;
+    ScalarStat* write_mode_cycles;
+
 #ifndef INTEGRATED_WITH_GEM5
     VectorStat* record_read_hits;
     VectorStat* record_read_misses;
@@ -169,8 +176,9 @@ public:
     // Number of precharged auto-refresh cycles during self-refresh exit
     ScalarStat spup_ref_pre_cycles_s;
 
-    libDRAMPower* drampower;
-    long update_counter = 0;
+    // fed with the commands of the channel, estimates its energy on a
+    // background thread
+    unique_ptr<DRAMPowerFeed> power_feed;
 
 public:
     /* Member Variables */
@@ -182,18 +190,21 @@ public:
     RowTable<T>* rowtable;  // tracks metadata about rows (e.g., which are open and for how long)
     Refresh<T>* refresh;
 
-    struct Queue {
-        list<Request> q;
-        unsigned int max = 32;
-        unsigned int size() {return q.size();}
-    };
+    typedef RequestQueue<T> Queue;
 
     Queue readq;  // queue for read requests
     Queue writeq;  // queue for write requests
     Queue otherq;  // queue for all "other" requests (e.g., refresh)
 
-    deque<Request> pending;  // read requests that are about to receive data from DRAM
+    RequestRing pending;  // read requests that are about to receive data from DRAM
+    // Set while the controller is ticked by a worker thread: the callbacks of
+    // completed reads are then run by deliver_callbacks() on the simulation
+    // thread, in the order of the controllers.
+    bool defer_callbacks = false;
+    vector<Request> completed;
     bool write_mode = false;  // whether write requests should be prioritized over reads
+    WritePolicy write_policy;
+    bool served_write = false;  // whether the last request served was a write
     //long refreshed = 0;  // last time refresh requests were generated
 
     /* Command trace for DRAMPower 3.1 */
@@ -229,6 +240,7 @@ public:
         rowpolicy(new RowPolicy<T>(this)),
         rowtable(new RowTable<T>(this)),
         refresh(new Refresh<T>(this)),
+        write_policy(configs),
         cmd_trace_files(channel->children.size())
     {
         record_cmd_trace = configs.record_cmd_trace();
@@ -242,14 +254,16 @@ public:
             for (unsigned int i = 0; i < channel->children.size(); i++)
                 cmd_trace_files[i].open(prefix + to_string(i) + suffix);
         }
-        /*if (configs["drampower_memspecs"] != "") {
+        if (configs["drampower_memspecs"] != "") {
           with_drampower = true;
-          drampower = new libDRAMPower(
-              Data::MemSpecParser::getMemSpecFromXML(
-                  configs["drampower_memspecs"]),
-              true);
-        }*/
+          int banks = channel->spec->org_entry.count[int(T::Level::Bank)];
+          if (has_bankgroup())
+              banks *= channel->spec->org_entry.count[int(T::Level::Bank) - 1];
+          power_feed.reset(new DRAMPowerFeed(configs["drampower_memspecs"],
+              channel->spec->command_name, int(T::Command::MAX), banks));
+        }
         fake_ideal_DRAM(configs);
+        index_queues();
         if (with_drampower) {
           // init DRAMPower stats
           act_energy
@@ -580,8 +594,7 @@ public:
     void finish(long dram_cycles) {
       // finalize DRAMPower
       if (with_drampower) {
-        drampower->updateCounters(true); // last update
-        drampower->calcEnergy();
+        libDRAMPower* drampower = power_feed->finish();
         act_energy = drampower->getEnergy().act_energy;
         pre_energy = drampower->getEnergy().pre_energy;
         read_energy = drampower->getEnergy().read_energy;
@@ -624,10 +637,14 @@ public:
         total_energy = drampower->getEnergy().total_energy;
         average_power = drampower->getPower().average_power;
         //drampower counter
-        numberofacts_s = 1;
-        numberofpres_s = 1;
-        numberofreads_s = 1;
-        numberofwrites_s = 1;
+        numberofacts_s = accumulate(drampower->counters.numberofactsBanks.begin(),
+            drampower->counters.numberofactsBanks.end(), 0L);
+        numberofpres_s = accumulate(drampower->counters.numberofpresBanks.begin(),
+            drampower->counters.numberofpresBanks.end(), 0L);
+        numberofreads_s = accumulate(drampower->counters.numberofreadsBanks.begin(),
+            drampower->counters.numberofreadsBanks.end(), 0L);
+        numberofwrites_s = accumulate(drampower->counters.numberofwritesBanks.begin(),
+            drampower->counters.numberofwritesBanks.end(), 0L);
         numberofrefs_s = drampower->counters.numberofrefs;
         precycles_s = drampower->counters.precycles;
         actcycles_s = drampower->counters.actcycles;
@@ -668,26 +685,30 @@ public:
 
     bool enqueue(Request& req)
     {
+        // a write to an address with a queued write only updates its data
+        if (req.type == Request::Type::WRITE && write_policy.coalescing && writeq.has_addr(req.addr)) {
+            ++(*write_coalesced);
+            return true;
+        }
+
         Queue& queue = get_queue(req.type);
         if (queue.max == queue.size())
             return false;
 
         req.arrive = clk;
-        queue.q.push_back(req);
+        queue.push_back(req);
         // shortcut for read requests, if a write to same addr exists
         // necessary for coherence
-        if (req.type == Request::Type::READ && find_if(writeq.q.begin(), writeq.q.end(),
-                [req](Request& wreq){ return req.addr == wreq.addr;}) != writeq.q.end()){
+        if (req.type == Request::Type::READ && writeq.has_addr(req.addr)) {
             req.depart = clk + 1;
             pending.push_back(req);
-            readq.q.pop_back();
+            readq.pop_back();
         }
         return true;
     }
 
     void tick()
     {
-        cout << "begin tick \n";
         clk++;
         (*req_queue_length_sum) += readq.size() + writeq.size() + pending.size();
         (*read_req_queue_length_sum) += readq.size() + pending.size();
@@ -702,7 +723,7 @@ public:
                   channel->update_serving_requests(
                       req.addr_vec.data(), -1, clk);
                 }
-                req.callback(req);
+                complete(req);
                 pending.pop_front();
             }
         }
@@ -711,23 +732,14 @@ public:
         refresh->tick_ref();
 
         /*** 3. Should we schedule writes? ***/
-        if (!write_mode) {
-            // yes -- write queue is almost full or read queue is empty
-            if (writeq.size() >= int(0.8 * writeq.max) || readq.size() == 0)
-                write_mode = true;
-        }
-        else {
-            // no -- write queue is almost empty and read queue is not empty
-            if (writeq.size() <= int(0.2 * writeq.max) && readq.size() != 0)
-                write_mode = false;
-        }
+        update_write_mode();
 
         /*** 4. Find the best command to schedule, if any ***/
         Queue* queue = !write_mode ? &readq : &writeq;
         if (otherq.size())
             queue = &otherq;  // "other" requests are rare, so we give them precedence over reads/writes
 
-        auto req = scheduler->get_head(queue->q);
+        auto req = get_request(queue);
         if (req == queue->q.end() || !is_ready(req)) {
           if (!no_DRAM_latency) {
             // we couldn't find a command to schedule -- let's try to be speculative
@@ -743,6 +755,7 @@ public:
         }
 
         if (req->is_first_command) {
+            count_turnaround(req);
             req->is_first_command = false;
             int coreid = req->coreid;
             if (req->type == Request::Type::READ || req->type == Request::Type::WRITE) {
@@ -797,8 +810,7 @@ public:
         }
 
         // remove request from queue
-        queue->q.erase(req);
-        cout << "end tick \n";
+        queue->erase(req);
     }
 
     bool is_ready(list<Request>::iterator req)
@@ -807,7 +819,7 @@ public:
         return channel->check(cmd, req->addr_vec.data(), clk);
     }
 
-    bool is_ready(typename T::Command cmd, const vector<int>& addr_vec)
+    bool is_ready(typename T::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check(cmd, addr_vec.data(), clk);
     }
@@ -819,7 +831,7 @@ public:
         return channel->check_row_hit(cmd, req->addr_vec.data());
     }
 
-    bool is_row_hit(typename T::Command cmd, const vector<int>& addr_vec)
+    bool is_row_hit(typename T::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check_row_hit(cmd, addr_vec.data());
     }
@@ -831,7 +843,7 @@ public:
         return channel->check_row_open(cmd, req->addr_vec.data());
     }
 
-    bool is_row_open(typename T::Command cmd, const vector<int>& addr_vec)
+    bool is_row_open(typename T::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check_row_open(cmd, addr_vec.data());
     }
@@ -840,6 +852,20 @@ public:
     {
     }
 
+    // Runs the callback of a completed read, or keeps it for deliver_callbacks()
+    void complete(Request& req) {
+      if (defer_callbacks)
+        completed.push_back(req);
+      else
+        req.callback(req);
+    }
+
+    void deliver_callbacks() {
+      for (auto& req : completed)
+        req.callback(req);
+      completed.clear();
+    }
+
     // For telling whether this channel is busying in processing read or write
     bool is_active() {
       return (channel->cur_serving_requests > 0);
@@ -861,7 +887,175 @@ public:
 #endif
     }
 
+    // Whether tick() should serve writes this cycle (see WritePolicy)
+    bool next_write_mode()
+    {
+        if (!write_mode)
+            // yes -- write queue is almost full or read queue is empty
+            return writeq.size() >= write_policy.high(writeq.max) || readq.size() == 0;
+        if (writeq.size() > write_policy.low(writeq.max) || readq.size() == 0)
+            return true;
+        // no -- write queue is almost empty and read queue is not empty,
+        // unless a write is still a row hit
+        return write_policy.drain == WritePolicy::Drain::RowHit && has_row_hit_write();
+    }
+
+    void update_write_mode()
+    {
+        write_mode = next_write_mode();
+        if (write_mode && writeq.size())
+            ++(*write_mode_cycles);
+    }
+
+    // Counts a turnaround when req is a read served after a write, or the
+    // other way around
+    void count_turnaround(list<Request>::iterator req)
+    {
+        if (req->type != Request::Type::READ && req->type != Request::Type::WRITE)
+            return;
+        bool write = req->type == Request::Type::WRITE;
+        if (write != served_write)
+            ++(*read_write_turnarounds);
+        served_write = write;
+    }
+
+    // The request scheduled from queue, or with write_drain = eager and no
+    // read ready, a ready write (queue then points to writeq)
+    list<Request>::iterator get_request(Queue*& queue)
+    {
+        auto req = scheduler->get_head(*queue);
+        if (queue != &readq || write_policy.drain != WritePolicy::Drain::Eager
+            || !writeq.size() || (req != queue->q.end() && is_ready(req)))
+            return req;
+        auto write = scheduler->get_head(writeq);
+        if (write == writeq.q.end() || !is_ready(write))
+            return req;
+        queue = &writeq;
+        return write;
+    }
+
+    bool has_row_hit_write()
+    {
+        if (!writeq.indexed()) {
+            for (auto req = writeq.q.begin(); req != writeq.q.end(); ++req)
+                if (is_row_hit(req))
+                    return true;
+            return false;
+        }
+        bool hit = false;
+        writeq.for_each_group([this, &hit] (typename Queue::Bank& bank, typename Queue::Group& group) {
+            writeq.refresh(bank, group);
+            hit |= group.hit;
+        });
+        return hit;
+    }
+
+    // Earliest clk at which tick() may do more than advance the clock and the
+    // queue length sums: the first pending read completes, a refresh is due,
+    // the write mode flips, a queued request becomes ready or the row policy
+    // can close a row. Every tick before it can be replaced by skip().
+    long get_next_event()
+    {
+        long next_clk = refresh->get_next_refresh();
+        if (pending.size())
+            next_clk = min(next_clk, pending[0].depart);
+
+        if (next_write_mode() != write_mode)
+            return clk + 1;
+
+        Queue* queue = !write_mode ? &readq : &writeq;
+        if (otherq.size())
+            queue = &otherq;
+        // get_request() may serve a write in read mode
+        bool eager = queue == &readq && write_policy.drain == WritePolicy::Drain::Eager;
+        for (Queue* q : {queue, eager ? &writeq : nullptr}) {
+            if (!q)
+                continue;
+            if (q->indexed()) {
+                q->for_each_group([this, q, &next_clk] (typename Queue::Bank& bank, typename Queue::Group& group) {
+                    q->refresh(bank, group);
+                    next_clk = min(next_clk, channel->get_next(group.cmd, group.reqs.front().second->addr_vec.data()));
+                });
+            } else {
+                for (auto req = q->q.begin(); req != q->q.end(); ++req)
+                    next_clk = min(next_clk, channel->get_next(get_first_cmd(req), req->addr_vec.data()));
+            }
+        }
+
+        if (!no_DRAM_latency && rowpolicy->type != RowPolicy<T>::Type::Opened) {
+            auto victim_clk = [this] (const int* rowgroup, long timestamp) {
+                long ready = channel->get_next(T::Command::PRE, rowgroup);
+                if (rowpolicy->type == RowPolicy<T>::Type::Timeout)
+                    ready = max(ready, timestamp + rowpolicy->timeout);
+                return ready;
+            };
+            for (auto& kv : rowtable->table)
+                next_clk = min(next_clk, victim_clk(kv.first.data(), kv.second.timestamp));
+            // FRFCFS_Cap adds an empty row table entry for every request it
+            // looks at, which the row policy may close as well
+            if (scheduler->type == Scheduler<T>::Type::FRFCFS_Cap) {
+                for (auto& req : queue->q)
+                    next_clk = min(next_clk, victim_clk(req.addr_vec.data(), 0));
+                if (eager)
+                    for (auto& req : writeq.q)
+                        next_clk = min(next_clk, victim_clk(req.addr_vec.data(), 0));
+            }
+        }
+        return max(next_clk, clk + 1);
+    }
+
+    // Advances the controller over cycles ticks, none of which reaches
+    // get_next_event()
+    void skip(long cycles)
+    {
+        clk += cycles;
+        (*req_queue_length_sum) += cycles * (readq.size() + writeq.size() + pending.size());
+        (*read_req_queue_length_sum) += cycles * (readq.size() + pending.size());
+        (*write_req_queue_length_sum) += cycles * writeq.size();
+        if (write_mode && writeq.size())
+            (*write_mode_cycles) += cycles;
+        refresh->skip(cycles);
+    }
+
+    // Saves or restores the DRAM state, the open rows and the refresh schedule
+    // of the channel, whose queues are empty
+    void checkpoint(Checkpoint& ckpt)
+    {
+        assert(readq.size() == 0 && writeq.size() == 0 && otherq.size() == 0 && pending.size() == 0);
+        ckpt.section("channel " + to_string(channel->id));
+        ckpt.io(clk);
+        ckpt.io(write_mode);
+        channel->checkpoint(ckpt);
+        ckpt.io(rowtable->table);
+        refresh->checkpoint(ckpt);
+    }
+
+    // Functional access for sampling: applies the commands of req to the
+    // state of the DRAM and the row table, without timing or statistics
+    void warm(const Request& req)
+    {
+        const int* addr = req.addr_vec.data();
+        typename T::Command target = channel->spec->translate[int(req.type)];
+        typename T::Command cmd;
+        do {
+            cmd = channel->decode(target, addr);
+            channel->update_state(cmd, addr);
+            rowtable->update(cmd, req.addr_vec, clk);
+        } while (cmd != target);
+    }
+
 private:
+    // Lets the scheduler decide per bank and row instead of per request
+    // (see RequestQueue). otherq holds refreshes, which are rare and not
+    // addressed down to a row.
+    void index_queues()
+    {
+        auto first_cmd = [this] (list<Request>::iterator req) {return get_first_cmd(req);};
+        readq.index(channel, first_cmd);
+        writeq.index(channel, first_cmd);
+        writeq.index_addrs();
+    }
+
     typename T::Command get_first_cmd(list<Request>::iterator req)
     {
         typename T::Command cmd = channel->spec->translate[int(req->type)];
@@ -872,26 +1066,23 @@ private:
         }
     }
 
-    void issue_cmd(typename T::Command cmd, const vector<int>& addr_vec)
+    // DRAMPower numbers the banks of all the bank groups of a rank together
+    bool has_bankgroup()
+    {
+        const string& standard = channel->spec->standard_name;
+        return standard == "DDR4" || standard == "GDDR5" || standard == "HBM";
+    }
+
+    void issue_cmd(typename T::Command cmd, const AddrVec& addr_vec)
     {
         assert(is_ready(cmd, addr_vec));
 
         if (with_drampower) {
           // update power estimation
-
-          const string& cmd_name = channel->spec->command_name[int(cmd)];
           int bank_id = addr_vec[int(T::Level::Bank)];
-          if (channel->spec->standard_name == "DDR4" || channel->spec->standard_name == "GDDR5" || channel->spec->standard_name == "HBM") {
-              // if has bankgroup
+          if (has_bankgroup())
               bank_id += addr_vec[int(T::Level::Bank) - 1] * channel->spec->org_entry.count[int(T::Level::Bank)];
-          }
-          drampower->doCommand(Data::MemCommand::getTypeFromName(cmd_name), bank_id, clk);
-
-          update_counter++;
-          if (update_counter == 1000000) {
-              drampower->updateCounters(false); // not the last update
-              update_counter = 0;
-          }
+          power_feed->command(int(cmd), bank_id, clk);
         }
 
         if (!no_DRAM_latency) {
@@ -924,13 +1115,13 @@ private:
             printf("\n");
         }
     }
-    vector<int> get_addr_vec(typename T::Command cmd, list<Request>::iterator req){
+    AddrVec get_addr_vec(typename T::Command cmd, list<Request>::iterator req){
         return req->addr_vec;
     }
 };
 
 template <>
-vector<int> Controller<SALP>::get_addr_vec(
+AddrVec Controller<SALP>::get_addr_vec(
     SALP::Command cmd, list<Request>::iterator req);
 
 template <>
@@ -945,6 +1136,18 @@ void Controller<TLDRAM>::tick();
 template <>
 void Controller<WideIO2>::tick();
 
+template <>
+long Controller<SALP>::get_next_event();
+
+template <>
+void Controller<SALP>::index_queues();
+
+template <>
+long Controller<TLDRAM>::get_next_event();
+
+template <>
+long Controller<WideIO2>::get_next_event();
+
 template <>
 void Controller<DDR4>::fake_ideal_DRAM(const Config& configs);
 
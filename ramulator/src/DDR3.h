@@ -30,6 +30,10 @@ public:
         Channel, Rank, Bank, Row, Column, MAX
     };
 
+    string level_name[int(Level::MAX)] = {
+        "Ch", "Ra", "Ba", "Ro", "Co"
+    };
+
     /*** Command ***/
     enum class Command : int
     { 
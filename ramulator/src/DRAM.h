@@ -1,6 +1,7 @@
 #ifndef __DRAM_H
 #define __DRAM_H
 
+#include "Checkpoint.h"
 #include "Statistics.h"
 #include <iostream>
 #include <vector>
@@ -9,6 +10,7 @@
 #include <functional>
 #include <algorithm>
 #include <cassert>
+#include <memory>
 #include <type_traits>
 
 using namespace std;
@@ -16,6 +18,63 @@ using namespace std;
 namespace ramulator
 {
 
+// The timing state of all nodes of a channel, and the timing parameters of the
+// standard sorted by whom they apply to. The next[] and prev[] arrays of the
+// nodes of a level lie next to each other, so that the siblings a command
+// updates share cache lines, and prev[] is a fixed-size ring buffer per command.
+template <typename T>
+struct DRAMTiming
+{
+    // Indices into T::timing[level][cmd] of the entries for the target node
+    // of a command, and of those for the siblings of the target node
+    vector<int> own[int(T::Level::MAX)][int(T::Command::MAX)];
+    vector<int> sibling[int(T::Level::MAX)][int(T::Command::MAX)];
+    // Whether a level below has timing entries for a command
+    bool below[int(T::Level::MAX)][int(T::Command::MAX)] = {};
+
+    // Number of recent issues of a command kept by a node, and their offset
+    // in the node's prev[]
+    int history[int(T::Level::MAX)][int(T::Command::MAX)] = {};
+    int history_offset[int(T::Level::MAX)][int(T::Command::MAX)] = {};
+    int history_size[int(T::Level::MAX)] = {};
+
+    vector<long> next[int(T::Level::MAX)];
+    vector<long> prev[int(T::Level::MAX)];
+    int nodes[int(T::Level::MAX)] = {};  // nodes that took their arrays so far
+
+    DRAMTiming(T* spec, typename T::Level top)
+    {
+        int levels = int(top);
+        long count = 1;
+        for (int l = int(top); l < int(T::Level::Row); l++, levels++) {
+            if (l > int(top)) {
+                if (!spec->org_entry.count[l])
+                    break; // the tree stops here, see DRAM()
+                count *= spec->org_entry.count[l];
+            }
+            for (int cmd = 0; cmd < int(T::Command::MAX); cmd++) {
+                auto& entries = spec->timing[l][cmd];
+                history_offset[l][cmd] = history_size[l];
+                for (int i = 0; i < int(entries.size()); i++) {
+                    if (entries[i].sibling) {
+                        assert(entries[i].dist == 1);
+                        sibling[l][cmd].push_back(i);
+                    } else {
+                        own[l][cmd].push_back(i);
+                        history[l][cmd] = max(history[l][cmd], entries[i].dist);
+                    }
+                }
+                history_size[l] += history[l][cmd];
+            }
+            next[l].assign(count * int(T::Command::MAX), -1); // initialize future
+            prev[l].assign(count * history_size[l], -1); // initialize history
+        }
+        for (int l = levels - 2; l >= int(top); l--)
+            for (int cmd = 0; cmd < int(T::Command::MAX); cmd++)
+                below[l][cmd] = own[l + 1][cmd].size() || sibling[l + 1][cmd].size() || below[l + 1][cmd];
+    }
+};
+
 template <typename T>
 class DRAM
 {
@@ -50,6 +109,10 @@ public:
     // Instead, their bank (or an equivalent entity) tracks their state for them
     map<int, typename T::State> row_state;
 
+    // Incremented whenever a command updates the state of this node or of its
+    // children, so that results derived from the state can be cached
+    long state_version = 0;
+
     // Insert a node as one of my child nodes
     void insert(DRAM<T>* child);
 
@@ -94,14 +157,20 @@ public:
 
     void finish(long dram_cycles);
 
+    // save or restore the state and timing of this node and its children
+    void checkpoint(Checkpoint& ckpt);
+
 private:
     // Constructor
     DRAM(){}
+    DRAM(T* spec, typename T::Level level, shared_ptr<DRAMTiming<T>> layout);
 
     // Timing
     long cur_clk = 0;
-    long next[int(T::Command::MAX)]; // the earliest time in the future when a command could be ready
-    deque<long> prev[int(T::Command::MAX)]; // the most recent history of when commands were issued
+    shared_ptr<DRAMTiming<T>> layout;
+    long* next; // the earliest time in the future when a command could be ready
+    long* prev; // the most recent history of when commands were issued
+    int prev_head[int(T::Command::MAX)] = {}; // position of the most recent issue in prev
 
     // Lookup table for which commands must be preceded by which other commands (i.e., "prerequisite")
     // E.g., a read command to a closed bank must be preceded by an activate command
@@ -187,10 +256,36 @@ void DRAM<T>::finish(long dram_cycles) {
   }
 }
 
+template <typename T>
+void DRAM<T>::checkpoint(Checkpoint& ckpt)
+{
+    if (!parent || parent->layout != layout) {
+        // the timing arrays of all nodes that share the layout
+        for (int l = 0; l < int(T::Level::MAX); l++) {
+            ckpt.io(layout->next[l]);
+            ckpt.io(layout->prev[l]);
+        }
+    }
+    ckpt.io(state);
+    ckpt.io(row_state);
+    ckpt.io(cur_clk);
+    ckpt.io(prev_head);
+    state_version++;  // invalidates results derived from the old state
+
+    for (auto child : children)
+        child->checkpoint(ckpt);
+}
+
 // Constructor
 template <typename T>
 DRAM<T>::DRAM(T* spec, typename T::Level level) :
-    spec(spec), level(level), id(0), parent(NULL)
+    DRAM(spec, level, make_shared<DRAMTiming<T>>(spec, level))
+{
+}
+
+template <typename T>
+DRAM<T>::DRAM(T* spec, typename T::Level level, shared_ptr<DRAMTiming<T>> layout) :
+    spec(spec), level(level), id(0), parent(NULL), layout(layout)
 {
 
     state = spec->start[(int)level];
@@ -200,15 +295,9 @@ DRAM<T>::DRAM(T* spec, typename T::Level level) :
     lambda = spec->lambda[int(level)];
     timing = spec->timing[int(level)];
 
-    fill_n(next, int(T::Command::MAX), -1); // initialize future
-    for (int cmd = 0; cmd < int(T::Command::MAX); cmd++) {
-        int dist = 0;
-        for (auto& t : timing[cmd])
-            dist = max(dist, t.dist);
-
-        if (dist)
-            prev[cmd].resize(dist, -1); // initialize history
-    }
+    int slot = layout->nodes[int(level)]++;
+    next = layout->next[int(level)].data() + slot * int(T::Command::MAX);
+    prev = layout->prev[int(level)].data() + slot * layout->history_size[int(level)];
 
     // try to recursively construct my children
     int child_level = int(level) + 1;
@@ -221,7 +310,7 @@ DRAM<T>::DRAM(T* spec, typename T::Level level) :
 
     // recursively construct my children
     for (int i = 0; i < child_max; i++) {
-        DRAM<T>* child = new DRAM<T>(spec, typename T::Level(child_level));
+        DRAM<T>* child = new DRAM<T>(spec, typename T::Level(child_level), layout);
         child->parent = this;
         child->id = i;
         children.push_back(child);
@@ -249,18 +338,20 @@ void DRAM<T>::insert(DRAM<T>* child)
 template <typename T>
 typename T::Command DRAM<T>::decode(typename T::Command cmd, const int* addr)
 {
-    int child_id = addr[int(level)+1];
-    if (prereq[int(cmd)]) {
-        typename T::Command prereq_cmd = prereq[int(cmd)](this, cmd, child_id);
-        if (prereq_cmd != T::Command::MAX)
-            return prereq_cmd; // stop recursion: there is a prerequisite at this level
-    }
+    for (auto node = this; ; ) {
+        int child_id = addr[int(node->level)+1];
+        if (node->prereq[int(cmd)]) {
+            typename T::Command prereq_cmd = node->prereq[int(cmd)](node, cmd, child_id);
+            if (prereq_cmd != T::Command::MAX)
+                return prereq_cmd; // stop: there is a prerequisite at this level
+        }
 
-    if (child_id < 0 || !children.size())
-        return cmd; // stop recursion: there were no prequisites at any level
+        if (child_id < 0 || !node->children.size())
+            return cmd; // stop: there were no prequisites at any level
 
-    // recursively decode at my child
-    return children[child_id]->decode(cmd, addr);
+        // decode at my child
+        node = node->children[child_id];
+    }
 }
 
 
@@ -268,15 +359,17 @@ typename T::Command DRAM<T>::decode(typename T::Command cmd, const int* addr)
 template <typename T>
 bool DRAM<T>::check(typename T::Command cmd, const int* addr, long clk)
 {
-    if (next[int(cmd)] != -1 && clk < next[int(cmd)])
-        return false; // stop recursion: the check failed at this level
+    for (auto node = this; ; ) {
+        if (node->next[int(cmd)] != -1 && clk < node->next[int(cmd)])
+            return false; // stop: the check failed at this level
 
-    int child_id = addr[int(level)+1];
-    if (child_id < 0 || level == spec->scope[int(cmd)] || !children.size())
-        return true; // stop recursion: the check passed at all levels
+        int child_id = addr[int(node->level)+1];
+        if (child_id < 0 || node->level == spec->scope[int(cmd)] || !node->children.size())
+            return true; // stop: the check passed at all levels
 
-    // recursively check my child
-    return children[child_id]->check(cmd, addr, clk);
+        // check my child
+        node = node->children[child_id];
+    }
 }
 
 // SAUGATA: added function to check whether a command is a row hit
@@ -284,31 +377,35 @@ bool DRAM<T>::check(typename T::Command cmd, const int* addr, long clk)
 template <typename T>
 bool DRAM<T>::check_row_hit(typename T::Command cmd, const int* addr)
 {
-    int child_id = addr[int(level)+1];
-    if (rowhit[int(cmd)]) {
-        return rowhit[int(cmd)](this, cmd, child_id);  // stop recursion: there is a row hit at this level
-    }
+    for (auto node = this; ; ) {
+        int child_id = addr[int(node->level)+1];
+        if (node->rowhit[int(cmd)]) {
+            return node->rowhit[int(cmd)](node, cmd, child_id);  // stop: there is a row hit at this level
+        }
 
-    if (child_id < 0 || !children.size())
-        return false; // stop recursion: there were no row hits at any level
+        if (child_id < 0 || !node->children.size())
+            return false; // stop: there were no row hits at any level
 
-    // recursively check for row hits at my child
-    return children[child_id]->check_row_hit(cmd, addr);
+        // check for row hits at my child
+        node = node->children[child_id];
+    }
 }
 
 template <typename T>
 bool DRAM<T>::check_row_open(typename T::Command cmd, const int* addr)
 {
-    int child_id = addr[int(level)+1];
-    if (rowopen[int(cmd)]) {
-        return rowopen[int(cmd)](this, cmd, child_id);  // stop recursion: there is a row hit at this level
-    }
+    for (auto node = this; ; ) {
+        int child_id = addr[int(node->level)+1];
+        if (node->rowopen[int(cmd)]) {
+            return node->rowopen[int(cmd)](node, cmd, child_id);  // stop: there is a row hit at this level
+        }
 
-    if (child_id < 0 || !children.size())
-        return false; // stop recursion: there were no row hits at any level
+        if (child_id < 0 || !node->children.size())
+            return false; // stop: there were no row hits at any level
 
-    // recursively check for row hits at my child
-    return children[child_id]->check_row_open(cmd, addr);
+        // check for open rows at my child
+        node = node->children[child_id];
+    }
 }
 
 template <typename T>
@@ -338,8 +435,10 @@ template <typename T>
 void DRAM<T>::update_state(typename T::Command cmd, const int* addr)
 {
     int child_id = addr[int(level)+1];
-    if (lambda[int(cmd)])
+    if (lambda[int(cmd)]) {
         lambda[int(cmd)](this, child_id); // update this level
+        state_version++;
+    }
 
     if (level == spec->scope[int(cmd)] || !children.size())
         return; // stop recursion: updated all levels
@@ -353,14 +452,11 @@ void DRAM<T>::update_state(typename T::Command cmd, const int* addr)
 template <typename T>
 void DRAM<T>::update_timing(typename T::Command cmd, const int* addr, long clk)
 {
+    int l = int(level);
     // I am not a target node: I am merely one of its siblings
-    if (id != addr[int(level)]) {
-        for (auto& t : timing[int(cmd)]) {
-            if (!t.sibling)
-                continue; // not an applicable timing parameter
-
-            assert (t.dist == 1);
-
+    if (id != addr[l]) {
+        for (int i : layout->sibling[l][int(cmd)]) {
+            auto& t = timing[int(cmd)][i];
             long future = clk + t.val;
             next[int(t.cmd)] = max(next[int(t.cmd)], future); // update future
         }
@@ -369,16 +465,18 @@ void DRAM<T>::update_timing(typename T::Command cmd, const int* addr, long clk)
     }
 
     // I am a target node
-    if (prev[int(cmd)].size()) {
-        prev[int(cmd)].pop_back();  // FIXME TIANSHI why pop back?
-        prev[int(cmd)].push_front(clk); // update history
+    int n = layout->history[l][int(cmd)];
+    long* history = prev + layout->history_offset[l][int(cmd)];
+    int& head = prev_head[int(cmd)];
+    if (n) {
+        head = (head ? head : n) - 1;
+        history[head] = clk; // update history
     }
 
-    for (auto& t : timing[int(cmd)]) {
-        if (t.sibling)
-            continue; // not an applicable timing parameter
-
-        long past = prev[int(cmd)][t.dist-1];
+    for (int i : layout->own[l][int(cmd)]) {
+        auto& t = timing[int(cmd)][i];
+        int k = head + t.dist - 1;
+        long past = history[k < n ? k : k - n];
         if (past < 0)
             continue; // not enough history
 
@@ -398,12 +496,14 @@ void DRAM<T>::update_timing(typename T::Command cmd, const int* addr, long clk)
 
     // Some commands have timings that are higher that their scope levels, thus
     // we do not stop at the cmd's scope level
-    if (!children.size())
-        return; // stop recursion: updated all levels
+    if (!layout->below[l][int(cmd)])
+        return; // stop recursion: no level below has timings for cmd
 
-    // recursively update *all* of my children
+    // recursively update my children, the siblings only if they have timings
+    bool siblings = layout->sibling[l + 1][int(cmd)].size();
     for (auto child : children)
-        child->update_timing(cmd, addr, clk);
+        if (siblings || child->id == addr[l + 1])
+            child->update_timing(cmd, addr, clk);
 
 }
 
@@ -0,0 +1,107 @@
+#include "DRAMPowerFeed.h"
+#include "xmlparser/MemSpecParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+using namespace ramulator;
+
+// The feeds of all channels, drained by one background thread that runs
+// while there is at least one feed. Never destroyed, so that a run ending
+// with exit() does not tear it down under the thread.
+namespace {
+    struct Worker {
+        mutex lock;
+        vector<DRAMPowerFeed*> feeds;
+        thread runner;
+        bool stop = false;
+    };
+    Worker& worker = *new Worker;
+
+    void drain_feeds(){
+        while (true) {
+            bool fed = false;
+            {
+                lock_guard<mutex> lock(worker.lock);
+                if (worker.stop)
+                    return;
+                for (auto feed : worker.feeds)
+                    fed |= feed->drain();
+            }
+            if (!fed)
+                this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+}
+
+// DRAMPower updates its counters every this many commands, to bound the
+// commands it keeps
+static const long update_interval = 1000000;
+
+DRAMPowerFeed::DRAMPowerFeed(const string& memspec, const string* command_names,
+    int commands, int banks)
+    : ring(ring_size), head(0), tail(0){
+    Data::MemorySpecification spec = Data::MemSpecParser::getMemSpecFromXML(memspec);
+    if (spec.memArchSpec.nbrOfBanks < banks) {
+        cerr << "drampower_memspecs " << memspec << " has "
+             << spec.memArchSpec.nbrOfBanks << " banks, fewer than the " << banks << " of a channel" << endl;
+        exit(1);
+    }
+    drampower.reset(new libDRAMPower(spec, true));
+
+    string* dp_names = Data::MemCommand::getCommandTypeStrings();
+    string* dp_end = dp_names + Data::MemCommand::nCommands;
+    for (int i = 0; i < commands; i++) {
+        string* name = find(dp_names, dp_end, command_names[i]);
+        types.push_back(name == dp_end ? -1 : int(name - dp_names));
+    }
+
+    lock_guard<mutex> lock(worker.lock);
+    worker.feeds.push_back(this);
+    if (worker.feeds.size() == 1) {
+        worker.stop = false;
+        worker.runner = thread(drain_feeds);
+    }
+}
+
+DRAMPowerFeed::~DRAMPowerFeed(){
+    unique_lock<mutex> lock(worker.lock);
+    worker.feeds.erase(find(worker.feeds.begin(), worker.feeds.end(), this));
+    if (worker.feeds.empty()) {
+        worker.stop = true;
+        lock.unlock();
+        worker.runner.join();
+    }
+}
+
+bool DRAMPowerFeed::drain(){
+    size_t last = head.load(std::memory_order_acquire);
+    size_t next = tail.load(std::memory_order_relaxed);
+    if (next == last)
+        return false;
+    for (; next != last; next++) {
+        const Command& c = ring[next & mask];
+        drampower->doCommand(Data::MemCommand::cmds(c.type), c.bank, c.clk);
+        if (++fed == update_interval) {
+            drampower->updateCounters(false); // not the last update
+            fed = 0;
+        }
+        // frees the slot as soon as it is read, for a producer waiting on a
+        // full ring
+        tail.store(next + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+libDRAMPower* DRAMPowerFeed::finish(){
+    while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed))
+        this_thread::yield();
+    // waits for the background thread to leave drain()
+    lock_guard<mutex> lock(worker.lock);
+    drampower->updateCounters(true); // last update
+    drampower->calcEnergy();
+    return drampower.get();
+}
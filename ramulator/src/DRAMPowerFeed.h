@@ -0,0 +1,79 @@
+#ifndef __DRAMPOWER_FEED_H
+#define __DRAMPOWER_FEED_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libdrampower/LibDRAMPower.h"
+
+namespace ramulator
+{
+
+// Estimates the energy of a channel (or HMC vault) with DRAMPower off the
+// simulation path (drampower_memspecs = <memspec XML> in the configuration).
+// The controller records each command it issues in the ring of its channel,
+// a lock-free queue with one producer, the thread that ticks the controller,
+// and one consumer, a background thread shared by all channels that hands
+// the commands to their libDRAMPower in order. A full ring makes the
+// controller wait, so no command is lost.
+//
+// Commands are translated by name. Those DRAMPower does not know (e.g., the
+// power-down and self-refresh commands of Ramulator) are left out.
+class DRAMPowerFeed {
+public:
+    // command_names holds the names of the commands of the standard; banks
+    // is the number of banks of the channel, as numbered by the controller
+    DRAMPowerFeed(const std::string& memspec, const std::string* command_names,
+        int commands, int banks);
+    DRAMPowerFeed(const DRAMPowerFeed&) = delete;
+    DRAMPowerFeed& operator=(const DRAMPowerFeed&) = delete;
+    ~DRAMPowerFeed();
+
+    void command(int cmd, int bank, long clk) {
+        int type = types[cmd];
+        if (type < 0)
+            return;
+        size_t next = head.load(std::memory_order_relaxed);
+        while (next - tail.load(std::memory_order_acquire) == ring.size())
+            std::this_thread::yield();
+        ring[next & mask] = {clk, bank, type};
+        head.store(next + 1, std::memory_order_release);
+    }
+
+    // Waits until the background thread has fed every command, and computes
+    // the energy of the run
+    libDRAMPower* finish();
+
+    // feeds the commands in the ring, false if there were none (background
+    // thread)
+    bool drain();
+
+private:
+    struct Command {
+        int64_t clk;
+        int32_t bank;
+        int32_t type;  // Data::MemCommand::cmds
+    };
+    static const size_t ring_size = 1 << 14;
+
+    std::vector<Command> ring;
+    size_t mask = ring_size - 1;
+    // a cache line apart, so that the producer (head) and the consumer (tail,
+    // fed) do not write to the same line. Padded rather than aligned: the
+    // feed is allocated with new, which does not honour alignas before C++17.
+    std::atomic<size_t> head;
+    char pad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    long fed = 0;  // commands since the last update of the counters
+
+    std::vector<int> types;  // DRAMPower command of each command, -1 for none
+    std::unique_ptr<libDRAMPower> drampower;
+};
+
+} /*namespace ramulator*/
+
+#endif /*__DRAMPOWER_FEED_H*/
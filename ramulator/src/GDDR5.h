@@ -29,6 +29,10 @@ public:
         Channel, Rank, BankGroup, Bank, Row, Column, MAX
     };
 
+    string level_name[int(Level::MAX)] = {
+        "Ch", "Ra", "Bg", "Ba", "Ro", "Co"
+    };
+
     /*** Command ***/
     enum class Command : int
     { 
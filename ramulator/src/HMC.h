@@ -47,6 +47,10 @@ public:
         Vault, BankGroup, Bank, Row, Column, MAX
     };
 
+    string level_name[int(Level::MAX)] = {
+        "Va", "Bg", "Ba", "Ro", "Co"
+    };
+
     /*** Command ***/
     enum class Command : int
     { 
@@ -6,17 +6,20 @@
 #include <deque>
 #include <fstream>
 #include <list>
+#include <memory>
+#include <numeric>
 #include <string>
 #include <vector>
 
 #include "Controller.h"
+#include "RequestQueue.h"
 #include "Scheduler.h"
+#include "WritePolicy.h"
 
 #include "HMC.h"
 #include "Packet.h"
 
-#include "libdrampower/LibDRAMPower.h"
-#include "xmlparser/MemSpecParser.h"
+#include "DRAMPowerFeed.h"
 
 using namespace std;
 
@@ -47,6 +50,10 @@ public:
     ScalarStat* read_req_queue_length_sum;
     ScalarStat* write_req_queue_length_sum;
 
+    ScalarStat* write_coalesced;
+    ScalarStat* read_write_turnarounds;
+    ScalarStat* write_mode_cycles;
+
     VectorStat* record_read_hits;
     VectorStat* record_read_misses;
     VectorStat* record_read_conflicts;
@@ -153,8 +160,9 @@ public:
     // Number of precharged auto-refresh cycles during self-refresh exit
     ScalarStat spup_ref_pre_cycles_s;
 
-    libDRAMPower* drampower;
-    long update_counter = 0;
+    // fed with the commands of the channel, estimates its energy on a
+    // background thread
+    unique_ptr<DRAMPowerFeed> power_feed;
 
 public:
     /* Member Variables */
@@ -166,18 +174,21 @@ public:
     RowTable<HMC>* rowtable;  // tracks metadata about rows (e.g., which are open and for how long)
     Refresh<HMC>* refresh;
 
-    struct Queue {
-        list<Request> q;
-        unsigned int max = 32; // TODO queue qize
-        unsigned int size() {return q.size();}
-    };
+    typedef RequestQueue<HMC> Queue;
 
     Queue readq;  // queue for read requests
     Queue writeq;  // queue for write requests
     Queue otherq;  // queue for all "other" requests (e.g., refresh)
 
-    deque<Request> pending;  // read requests that are about to receive data from DRAM
+    RequestRing pending;  // read requests that are about to receive data from DRAM
+    // Set while the controller is ticked by a worker thread: the callbacks of
+    // completed reads are then run by deliver_callbacks() on the simulation
+    // thread, in the order of the controllers.
+    bool defer_callbacks = false;
+    vector<Request> completed;
     bool write_mode = false;  // whether write requests should be prioritized over reads
+    WritePolicy write_policy;
+    bool served_write = false;  // whether the last request served was a write
     //long refreshed = 0;  // last time refresh requests were generated
 
     /* Command trace for DRAMPower 3.1 */
@@ -193,17 +204,27 @@ public:
     bool unlimit_bandwidth = false;
 
     // HMC
-    deque<Packet> response_packets_buffer;
-    map<long, Packet> incoming_packets_buffer;
-
-    bool pim_mode_enabled = false;
+    // the packets in flight, set by the memory
+    PacketPool* packets = nullptr;
+    // slots of the responses waiting for the switch
+    Ring<int> response_packets_buffer;
+
+    // per-core statistics of the PIM cores follow those of the host cores
+    int pim_core_base = 0;
+    // Requests of the PIM cores of this stack wait here while readq or
+    // writeq is full, one of them moving on per cycle. A free entry is a
+    // credit of the PIM cores for this vault: they stall when none is left
+    // (see receive_pim()).
+    Ring<int> pim_buffer;
+    unsigned int pim_buffer_size = 8;
     /* Constructor */
     Controller(const Config& configs, DRAM<HMC>* channel) :
         channel(channel),
         scheduler(new Scheduler<HMC>(this)),
         rowpolicy(new RowPolicy<HMC>(this)),
         rowtable(new RowTable<HMC>(this)),
-        refresh(new Refresh<HMC>(this))
+        refresh(new Refresh<HMC>(this)),
+        write_policy(configs)
     {
         record_cmd_trace = configs.record_cmd_trace();
         print_cmd_trace = configs.print_cmd_trace();
@@ -215,13 +236,13 @@ public:
                 cmd_trace_prefix + "chan-" + to_string(channel->id)
                 + ".cmdtrace");
         }
-        /*if (configs["drampower_memspecs"] != "") {
+        if (configs["drampower_memspecs"] != "") {
           with_drampower = true;
-          drampower = new libDRAMPower(
-              Data::MemSpecParser::getMemSpecFromXML(
-                  configs["drampower_memspecs"]),
-              true);
-        }*/
+          int banks = channel->spec->org_entry.count[int(HMC::Level::BankGroup)]
+              * channel->spec->org_entry.count[int(HMC::Level::Bank)];
+          power_feed.reset(new DRAMPowerFeed(configs["drampower_memspecs"],
+              channel->spec->command_name, int(HMC::Command::MAX), banks));
+        }
         if (configs["no_DRAM_latency"] == "true") {
           no_DRAM_latency = true;
           scheduler->type = Scheduler<HMC>::Type::FRFCFS;
@@ -235,7 +256,11 @@ public:
           assert(channel->spec->speed_entry.nCCDL == 1);
         }
 
-        pim_mode_enabled = configs.pim_mode_enabled();
+        if (configs.contains("pim_vault_buffer")) {
+          pim_buffer_size = configs.get_int_value("pim_vault_buffer");
+        }
+
+        index_queues();
         if (with_drampower) {
           // init DRAMPower stats
           act_energy
@@ -561,25 +586,38 @@ public:
         cmd_trace_file.close();
     }
 
-    bool receive (Packet& packet) {
+    // The request packet in slot, which stays there for the response
+    bool receive (int slot) {
+      Packet& packet = (*packets)[slot];
       assert(packet.type == Packet::Type::REQUEST);
 
       Request& req = packet.req;
+      assert(req.packet == slot);
       req.burst_count = channel->spec->burst_count;
       req.transaction_bytes = channel->spec->payload_flits * 16;
       debug_hmc("req.burst_count %d", req.burst_count);
       debug_hmc("req.reqid %d, req.coreid %d", req.reqid, req.coreid);
-      // buffer packet, for future response packet
-      incoming_packets_buffer[req.reqid] = packet;
 
       return enqueue(req);
     }
 
+    // A request of a PIM core of this stack: false when the vault has no
+    // credit left for it
+    bool receive_pim(int slot) {
+      if (pim_buffer.empty() && receive(slot)) {
+        return true;
+      }
+      if (pim_buffer.size() >= pim_buffer_size) {
+        return false;
+      }
+      pim_buffer.push_back(slot);
+      return true;
+    }
+
     void finish(long dram_cycles) {
       // finalize DRAMPower
       if (with_drampower) {
-        drampower->updateCounters(true); // last update
-        drampower->calcEnergy();
+        libDRAMPower* drampower = power_feed->finish();
         act_energy = drampower->getEnergy().act_energy;
         pre_energy = drampower->getEnergy().pre_energy;
         read_energy = drampower->getEnergy().read_energy;
@@ -622,10 +660,14 @@ public:
         total_energy = drampower->getEnergy().total_energy;
         average_power = drampower->getPower().average_power;
         //drampower counter
-        numberofacts_s = 1;
-        numberofpres_s = 1;
-        numberofreads_s = 1;
-        numberofwrites_s = 1;
+        numberofacts_s = accumulate(drampower->counters.numberofactsBanks.begin(),
+            drampower->counters.numberofactsBanks.end(), 0L);
+        numberofpres_s = accumulate(drampower->counters.numberofpresBanks.begin(),
+            drampower->counters.numberofpresBanks.end(), 0L);
+        numberofreads_s = accumulate(drampower->counters.numberofreadsBanks.begin(),
+            drampower->counters.numberofreadsBanks.end(), 0L);
+        numberofwrites_s = accumulate(drampower->counters.numberofwritesBanks.begin(),
+            drampower->counters.numberofwritesBanks.end(), 0L);
         numberofrefs_s = drampower->counters.numberofrefs;
         precycles_s = drampower->counters.precycles;
         actcycles_s = drampower->counters.actcycles;
@@ -666,51 +708,56 @@ public:
 
     bool enqueue(Request& req)
     {
+        // a write to an address with a queued write only updates its data
+        if (req.type == Request::Type::WRITE && write_policy.coalescing && writeq.has_addr(req.addr)) {
+            ++(*write_coalesced);
+            // the response of the write leaves at once, as if issued (req
+            // lives in the packet the response replaces)
+            Request write = req;
+            response_packets_buffer.push_back(form_response_packet(write));
+            return true;
+        }
 
         Queue& queue = get_queue(req.type);
-        if(!pim_mode_enabled){
-            if (queue.max == queue.size())
-                return false;
-        }
+        if (queue.max == queue.size())
+            return false;
 
         req.arrive = clk;
-        queue.q.push_back(req);
+        queue.push_back(req);
         // shortcut for read requests, if a write to same addr exists
         // necessary for coherence
-        if (req.type == Request::Type::READ && find_if(writeq.q.begin(), writeq.q.end(),
-                [req](Request& wreq){ return req.addr == wreq.addr;}) != writeq.q.end()){
+        if (req.type == Request::Type::READ && writeq.has_addr(req.addr)) {
             req.depart = clk + 1;
             pending.push_back(req);
-            readq.q.pop_back();
+            readq.pop_back();
         }
         return true;
     }
 
-    Packet form_response_packet(Request& req) {
-      // All packets sent from host controller are Request packets
-      assert(incoming_packets_buffer.find(req.reqid) !=
-          incoming_packets_buffer.end());
-      Packet req_packet = incoming_packets_buffer[req.reqid];
-      int cub = req_packet.header.CUB.value;
-      int tag = req_packet.header.TAG.value;
-      int slid = req_packet.tail.SLID.value;
+    // Replaces the request packet of req by its response, in the same slot
+    int form_response_packet(Request& req) {
+      Packet& packet = (*packets)[req.packet];
+      assert(packet.type == Packet::Type::REQUEST);
+      int cub = packet.header.CUB.value;
+      int tag = packet.header.TAG.value;
+      int slid = packet.tail.SLID.value;
       int lng = req.type == Request::Type::WRITE ?
                 1 : 1 + channel->spec->payload_flits;
-      Packet::Command cmd = req_packet.header.CMD.value;
-      Packet packet(Packet::Type::RESPONSE, cub, tag, lng, slid, cmd);
+      Packet::Command cmd = packet.header.CMD.value;
+      int src_cub = packet.src_cub;
+      packet = Packet(Packet::Type::RESPONSE, cub, tag, lng, slid, cmd);
       packet.req = req;
+      packet.src_cub = src_cub;
       debug_hmc("cub: %d", cub);
       debug_hmc("slid: %d", slid);
       debug_hmc("lng: %d", lng);
       debug_hmc("cmd: %d", int(cmd));
       // DEBUG:
       assert(packet.header.CUB.valid());
-      assert(packet.header.TAG.valid()); // -1 also considered valid here...
+      assert(packet.header.TAG.valid());
       assert(packet.header.SLID.valid());
       assert(packet.header.CMD.valid());
-      // Don't forget to release the space for incoming packet
-      incoming_packets_buffer.erase(req.reqid);
-      return packet;
+      return req.packet;
     }
 
     void tick()
@@ -721,6 +768,11 @@ public:
         (*read_req_queue_length_sum) += readq.size() + pending.size();
         (*write_req_queue_length_sum) += writeq.size();
 
+        /*** 0. Move a buffered request of a PIM core into its queue ***/
+        if (pim_buffer.size() && receive(pim_buffer.front())) {
+          pim_buffer.pop_front();
+        }
+
         /*** 1. Serve completed reads ***/
         if (pending.size()) {
           Request& req = pending[0];
@@ -728,18 +780,17 @@ public:
             if (req.depart - req.arrive > 1) {
               channel->update_serving_requests(req.addr_vec.data(), -1, clk);
             }
-            if(pim_mode_enabled){
+            Packet& packet = (*packets)[req.packet];
+            // the reads of a PIM core in another stack return over the links
+            if(req.pim && packet.src_cub == packet.header.CUB.value){
                 req.depart_hmc = clk;
                 if (req.type == Request::Type::READ || req.type == Request::Type::WRITE) {
-                  assert(incoming_packets_buffer.find(req.reqid) != incoming_packets_buffer.end());
-                  incoming_packets_buffer.erase(req.reqid);
-                  req.callback(req);
+                  complete(req);
                   pending.pop_front();
                }
             }
             else{
-                Packet packet = form_response_packet(req);
-                response_packets_buffer.push_back(packet);
+                response_packets_buffer.push_back(form_response_packet(req));
                 pending.pop_front();
                 }
           }
@@ -749,23 +800,14 @@ public:
         refresh->tick_ref();
 
         /*** 3. Should we schedule writes? ***/
-        if (!write_mode) {
-            // yes -- write queue is almost full or read queue is empty
-            if (writeq.size() >= int(0.8 * writeq.max) || readq.size() == 0)
-                write_mode = true;
-        }
-        else {
-            // no -- write queue is almost empty and read queue is not empty
-            if (writeq.size() <= int(0.2 * writeq.max) && readq.size() != 0)
-                write_mode = false;
-        }
+        update_write_mode();
 
         /*** 4. Find the best command to schedule, if any ***/
         Queue* queue = !write_mode ? &readq : &writeq;
         if (otherq.size())
             queue = &otherq;  // "other" requests are rare, so we give them precedence over reads/writes
 
-        auto req = scheduler->get_head(queue->q);
+        auto req = get_request(queue);
         if (req == queue->q.end() || !is_ready(req)) {
           if (!no_DRAM_latency) {
             // we couldn't find a command to schedule -- let's try to be speculative
@@ -781,8 +823,9 @@ public:
         }
 
         if (req->is_first_command) {
+          count_turnaround(req);
           req->is_first_command = false;
-          int coreid = req->coreid;
+          int coreid = req->coreid + (req->pim ? pim_core_base : 0);
           if (req->type == Request::Type::READ || req->type == Request::Type::WRITE) {
             channel->update_serving_requests(req->addr_vec.data(), 1, clk);
           }
@@ -838,15 +881,14 @@ public:
         } else if (req->type == Request::Type::WRITE) {
             --req->burst_count;
             if (req->burst_count == 0) {
-              Packet packet = form_response_packet(*req);
-              response_packets_buffer.push_back(packet);
+              response_packets_buffer.push_back(form_response_packet(*req));
               channel->update_serving_requests(req->addr_vec.data(), -1, clk);
             }
         }
 
         // remove request from queue
         if (req->burst_count == 0) {
-          queue->q.erase(req);
+          queue->erase(req);
         }
     }
 
@@ -856,7 +898,7 @@ public:
         return channel->check(cmd, req->addr_vec.data(), clk);
     }
 
-    bool is_ready(typename HMC::Command cmd, const vector<int>& addr_vec)
+    bool is_ready(typename HMC::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check(cmd, addr_vec.data(), clk);
     }
@@ -868,7 +910,7 @@ public:
         return channel->check_row_hit(cmd, req->addr_vec.data());
     }
 
-    bool is_row_hit(typename HMC::Command cmd, const vector<int>& addr_vec)
+    bool is_row_hit(typename HMC::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check_row_hit(cmd, addr_vec.data());
     }
@@ -880,7 +922,7 @@ public:
         return channel->check_row_open(cmd, req->addr_vec.data());
     }
 
-    bool is_row_open(typename HMC::Command cmd, const vector<int>& addr_vec)
+    bool is_row_open(typename HMC::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check_row_open(cmd, addr_vec.data());
     }
@@ -889,6 +931,26 @@ public:
     {
     }
 
+    // Runs the callback of a completed read, or keeps it for deliver_callbacks()
+    // A request of a PIM core done in its vault frees its packet with the
+    // callback, on the simulation thread, which is the only one to take slots
+    void complete(Request& req) {
+      if (defer_callbacks) {
+        completed.push_back(req);
+      } else {
+        packets->release(req.packet);
+        req.callback(req);
+      }
+    }
+
+    void deliver_callbacks() {
+      for (auto& req : completed) {
+        packets->release(req.packet);
+        req.callback(req);
+      }
+      completed.clear();
+    }
+
     // For telling whether this channel is busying in processing read or write
     bool is_active() {
       return (channel->cur_serving_requests > 0);
@@ -908,7 +970,172 @@ public:
       (*record_write_conflicts)[coreid] = (*write_row_conflicts)[coreid];
     }
 
+    // Whether tick() should serve writes this cycle (see WritePolicy)
+    bool next_write_mode()
+    {
+        if (!write_mode)
+            // yes -- write queue is almost full or read queue is empty
+            return writeq.size() >= write_policy.high(writeq.max) || readq.size() == 0;
+        if (writeq.size() > write_policy.low(writeq.max) || readq.size() == 0)
+            return true;
+        // no -- write queue is almost empty and read queue is not empty,
+        // unless a write is still a row hit
+        return write_policy.drain == WritePolicy::Drain::RowHit && has_row_hit_write();
+    }
+
+    void update_write_mode()
+    {
+        write_mode = next_write_mode();
+        if (write_mode && writeq.size())
+            ++(*write_mode_cycles);
+    }
+
+    // Counts a turnaround when req is a read served after a write, or the
+    // other way around
+    void count_turnaround(list<Request>::iterator req)
+    {
+        if (req->type != Request::Type::READ && req->type != Request::Type::WRITE)
+            return;
+        bool write = req->type == Request::Type::WRITE;
+        if (write != served_write)
+            ++(*read_write_turnarounds);
+        served_write = write;
+    }
+
+    // The request scheduled from queue, or with write_drain = eager and no
+    // read ready, a ready write (queue then points to writeq)
+    list<Request>::iterator get_request(Queue*& queue)
+    {
+        auto req = scheduler->get_head(*queue);
+        if (queue != &readq || write_policy.drain != WritePolicy::Drain::Eager
+            || !writeq.size() || (req != queue->q.end() && is_ready(req)))
+            return req;
+        auto write = scheduler->get_head(writeq);
+        if (write == writeq.q.end() || !is_ready(write))
+            return req;
+        queue = &writeq;
+        return write;
+    }
+
+    bool has_row_hit_write()
+    {
+        if (!writeq.indexed()) {
+            for (auto req = writeq.q.begin(); req != writeq.q.end(); ++req)
+                if (is_row_hit(req))
+                    return true;
+            return false;
+        }
+        bool hit = false;
+        writeq.for_each_group([this, &hit] (typename Queue::Bank& bank, typename Queue::Group& group) {
+            writeq.refresh(bank, group);
+            hit |= group.hit;
+        });
+        return hit;
+    }
+
+    // Earliest clk at which tick() may do more than advance the clock and the
+    // queue length sums (see Controller<T>::get_next_event)
+    long get_next_event()
+    {
+        long next_clk = refresh->get_next_refresh();
+        if (pending.size())
+            next_clk = min(next_clk, pending[0].depart);
+        if (pim_buffer.size())
+            return clk + 1;
+
+        if (next_write_mode() != write_mode)
+            return clk + 1;
+
+        Queue* queue = !write_mode ? &readq : &writeq;
+        if (otherq.size())
+            queue = &otherq;
+        // get_request() may serve a write in read mode
+        bool eager = queue == &readq && write_policy.drain == WritePolicy::Drain::Eager;
+        for (Queue* q : {queue, eager ? &writeq : nullptr}) {
+            if (!q)
+                continue;
+            if (q->indexed()) {
+                q->for_each_group([this, q, &next_clk] (typename Queue::Bank& bank, typename Queue::Group& group) {
+                    q->refresh(bank, group);
+                    next_clk = min(next_clk, channel->get_next(group.cmd, group.reqs.front().second->addr_vec.data()));
+                });
+            } else {
+                for (auto req = q->q.begin(); req != q->q.end(); ++req)
+                    next_clk = min(next_clk, channel->get_next(get_first_cmd(req), req->addr_vec.data()));
+            }
+        }
+
+        if (!no_DRAM_latency && rowpolicy->type != RowPolicy<HMC>::Type::Opened) {
+            auto victim_clk = [this] (const int* rowgroup, long timestamp) {
+                long ready = channel->get_next(HMC::Command::PRE, rowgroup);
+                if (rowpolicy->type == RowPolicy<HMC>::Type::Timeout)
+                    ready = max(ready, timestamp + rowpolicy->timeout);
+                return ready;
+            };
+            for (auto& kv : rowtable->table)
+                next_clk = min(next_clk, victim_clk(kv.first.data(), kv.second.timestamp));
+            if (scheduler->type == Scheduler<HMC>::Type::FRFCFS_Cap) {
+                for (auto& req : queue->q)
+                    next_clk = min(next_clk, victim_clk(req.addr_vec.data(), 0));
+                if (eager)
+                    for (auto& req : writeq.q)
+                        next_clk = min(next_clk, victim_clk(req.addr_vec.data(), 0));
+            }
+        }
+        return max(next_clk, clk + 1);
+    }
+
+    void skip(long cycles)
+    {
+        clk += cycles;
+        (*req_queue_length_sum) += cycles * (readq.size() + writeq.size() + pending.size());
+        (*read_req_queue_length_sum) += cycles * (readq.size() + pending.size());
+        (*write_req_queue_length_sum) += cycles * writeq.size();
+        if (write_mode && writeq.size())
+            (*write_mode_cycles) += cycles;
+        refresh->skip(cycles);
+    }
+
+    // Saves or restores the DRAM state, the open rows and the refresh schedule
+    // of the vault, whose queues are empty
+    void checkpoint(Checkpoint& ckpt)
+    {
+        assert(readq.size() == 0 && writeq.size() == 0 && otherq.size() == 0 && pending.size() == 0
+            && pim_buffer.empty());
+        ckpt.section("vault " + to_string(channel->id));
+        ckpt.io(clk);
+        ckpt.io(write_mode);
+        channel->checkpoint(ckpt);
+        ckpt.io(rowtable->table);
+        refresh->checkpoint(ckpt);
+    }
+
+    // Functional access for sampling: applies the commands of req to the
+    // state of the DRAM and the row table, without timing or statistics
+    void warm(const Request& req)
+    {
+        const int* addr = req.addr_vec.data();
+        HMC::Command target = channel->spec->translate[int(req.type)];
+        HMC::Command cmd;
+        do {
+            cmd = channel->decode(target, addr);
+            channel->update_state(cmd, addr);
+            rowtable->update(cmd, req.addr_vec, clk);
+        } while (cmd != target);
+    }
+
 private:
+    // Lets the scheduler decide per bank and row instead of per request
+    // (see RequestQueue). otherq holds refreshes, which are rare and not
+    // addressed down to a row.
+    void index_queues()
+    {
+        auto first_cmd = [this] (list<Request>::iterator req) {return get_first_cmd(req);};
+        readq.index(channel, first_cmd);
+        writeq.index(channel, first_cmd);
+        writeq.index_addrs();
+    }
+
     typename HMC::Command get_first_cmd(list<Request>::iterator req)
     {
         typename HMC::Command cmd = channel->spec->translate[int(req->type)];
@@ -919,22 +1146,13 @@ private:
         }
     }
 
-    void issue_cmd(typename HMC::Command cmd, const vector<int>& addr_vec)
+    void issue_cmd(typename HMC::Command cmd, const AddrVec& addr_vec)
     {
         // update power estimation
         if (with_drampower) {
-
-          const string& cmd_name = channel->spec->command_name[int(cmd)];
           int bank_id = addr_vec[int(HMC::Level::Bank)];
           bank_id += addr_vec[int(HMC::Level::Bank) - 1] * channel->spec->org_entry.count[int(HMC::Level::Bank)];
-          printf("%ld %d\n", clk, bank_id);
-          drampower->doCommand(Data::MemCommand::getTypeFromName(cmd_name), bank_id, clk);
-
-          update_counter++;
-          if (update_counter == 1000000) {
-              drampower->updateCounters(false); // not the last update
-              update_counter = 0;
-          }
+          power_feed->command(int(cmd), bank_id, clk);
         }
 
         if (print_cmd_trace){
@@ -965,7 +1183,7 @@ private:
             }
         }
     }
-    vector<int> get_addr_vec(typename HMC::Command cmd, list<Request>::iterator req){
+    AddrVec get_addr_vec(typename HMC::Command cmd, list<Request>::iterator req){
         return req->addr_vec;
     }
 };
@@ -8,6 +8,8 @@
 #include "Packet.h"
 #include "Statistics.h"
 
+#include <numeric>
+
 using namespace std;
 
 namespace ramulator
@@ -20,6 +22,11 @@ public:
   long max_address;
 
   long capacity_per_stack;
+  int stacks;
+  int vaults_per_stack;
+  // the PIM cores, and the first of them in the per-core statistics
+  int pim_cores;
+  int pim_core_base;
   ScalarStat dram_capacity;
   ScalarStat num_dram_cycles;
   VectorStat num_read_requests;
@@ -28,6 +35,14 @@ public:
   ScalarStat memory_footprint;
   VectorStat incoming_requests_per_channel;
   VectorStat incoming_read_reqs_per_channel;
+  // the requests of the PIM cores, counted apart from those of the host when
+  // both run (see Config::get_pim_core_num())
+  VectorStat* pim_incoming_requests_per_channel = &incoming_requests_per_channel;
+  VectorStat* pim_incoming_read_reqs_per_channel = &incoming_read_reqs_per_channel;
+  unique_ptr<VectorStat> pim_incoming_stats[2];
+  // requests of the PIM cores refused for lack of credits of their vault, or
+  // of room on the links toward another stack (only with PIM cores)
+  unique_ptr<VectorStat> pim_vault_stalls;
   ScalarStat physical_page_replacement;
   ScalarStat maximum_internal_bandwidth;
   ScalarStat maximum_link_bandwidth;
@@ -67,6 +82,10 @@ public:
   ScalarStat write_req_queue_length_avg;
   ScalarStat write_req_queue_length_sum;
 
+  ScalarStat write_coalesced;
+  ScalarStat read_write_turnarounds;
+  ScalarStat write_mode_cycles;
+
   VectorStat record_read_hits;
   VectorStat record_read_misses;
   VectorStat record_read_conflicts;
@@ -106,13 +125,22 @@ public:
     long free_physical_pages_remaining;
     map<pair<int, long>, long> page_translation;
 
-    vector<list<int>> tags_pools;
+    // the free tags of each host link
+    vector<vector<int>> tags_pools;
+    PacketPool packets;
 
     vector<Controller<HMC>*> ctrls;
     vector<LogicLayer<HMC>*> logic_layers;
     HMC * spec;
 
+    // ticks the vaults on controller_threads threads, see tick()
+    unique_ptr<TickPool> tick_pool;
+    // --stats-series, see tick()
+    unique_ptr<TimeSeries> series;
+    vector<unique_ptr<ControllerStatBatch<Controller<HMC>>>> stat_batches;
+
     vector<int> addr_bits;
+    unique_ptr<AddrMapping> mapping;
     vector<int> requests_per_vault;
     int tx_bits;
 
@@ -132,15 +160,24 @@ public:
         assert((1<<tx_bits) == tx);
 
         pim_mode_enabled = configs.pim_mode_enabled();
+        // the CUB field of the packets holds the stack
+        stacks = configs.get_stacks();
+        if (stacks < 1 || stacks > (1 << cub_bits) || (stacks & (stacks - 1))) {
+          cerr << "stacks must be a power of 2, at most " << (1 << cub_bits) << endl;
+          exit(1);
+        }
+        vaults_per_stack = sz[int(HMC::Level::Vault)];
+        pim_cores = pim_mode_enabled ? configs.get_core_num() : configs.get_pim_core_num();
+        pim_core_base = pim_mode_enabled ? 0 : configs.get_core_num();
+        int core_stat_num = configs.get_core_num() + configs.get_pim_core_num();
         capacity_per_stack = spec->channel_width / 8;
 
         for (unsigned int lev = 0; lev < addr_bits.size(); lev++) {
           addr_bits[lev] = calc_log2(sz[lev]);
           capacity_per_stack *= sz[lev];
         }
-        max_address = capacity_per_stack * configs.get_stacks();
-        requests_per_vault.resize(32);
-        for(int i = 0; i < 32; i++) requests_per_vault[i] = 0;
+        max_address = capacity_per_stack * stacks;
+        requests_per_vault.resize(ctrls.size(), 0);
         addr_bits[int(HMC::Level::MAX) - 1] -= calc_log2(spec->prefetch_size);
 
         // Initiating translation
@@ -161,21 +198,39 @@ public:
           printf("configs[\"addressing_type\"] %s\n", configs["addressing_type"].c_str());
           type = name_to_type[configs["addressing_type"]];
         }
+        string layout = configs["address_mapping"];
+        if (layout == "" || name_to_type.count(layout)) {
+          if (layout != "")
+            type = name_to_type[layout];
+          layout = preset_mapping();
+        }
+        mapping.reset(new AddrMapping(vector<string>(spec->level_name, spec->level_name + addr_bits.size()),
+            addr_bits, tx_bits, layout, configs["address_hash"], configs["address_xor"]));
 
         // HMC
         assert(spec->source_links > 0);
         tags_pools.resize(spec->source_links);
         for (auto & tags_pool : tags_pools) {
-          for (int i = 0 ; i < spec->max_tags ; ++i) {
+          for (int i = spec->max_tags - 1 ; i >= 0 ; --i) {
             tags_pool.push_back(i);
           }
         }
+        packets.init(spec->source_links, spec->max_tags);
 
-        int stacks = configs.get_int_value("stacks");
+        // each stack switches the packets of its own vaults
         for (int i = 0 ; i < stacks ; ++i) {
-          logic_layers.emplace_back(new LogicLayer<HMC>(configs, i, spec, ctrls,
-              this, std::bind(&Memory<HMC>::receive_packets, this,
-                              std::placeholders::_1)));
+          vector<Controller<HMC>*> vault_ctrls(ctrls.begin() + i * vaults_per_stack,
+              ctrls.begin() + (i + 1) * vaults_per_stack);
+          logic_layers.emplace_back(new LogicLayer<HMC>(configs, i, spec, vault_ctrls,
+              this, &packets, std::bind(&Memory<HMC>::receive_packets, this,
+                              std::placeholders::_1, std::placeholders::_2)));
+        }
+        for (auto logic_layer : logic_layers) {
+          for (int peer : logic_layer->neighbours) {
+            if (peer > logic_layer->cub) {
+              logic_layer->connect(logic_layers[peer]);
+            }
+          }
         }
 
         // regStats
@@ -193,32 +248,56 @@ public:
             ;
 
         num_read_requests
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("read_requests")
             .desc("Number of incoming read requests to DRAM")
             .precision(0)
             ;
 
         num_write_requests
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("write_requests")
             .desc("Number of incoming write requests to DRAM")
             .precision(0)
             ;
 
         incoming_requests_per_channel
-            .init(sz[int(HMC::Level::Vault)])
+            .init(ctrls.size())
             .name("incoming_requests_per_channel")
             .desc("Number of incoming requests to each DRAM channel")
             .precision(0)
             ;
 
         incoming_read_reqs_per_channel
-            .init(sz[int(HMC::Level::Vault)])
+            .init(ctrls.size())
             .name("incoming_read_reqs_per_channel")
             .desc("Number of incoming read requests to each DRAM channel")
             .precision(0)
             ;
+        if (pim_cores > 0) {
+          pim_vault_stalls.reset(new VectorStat);
+          pim_vault_stalls->init(ctrls.size())
+              .name("pim_vault_stalls")
+              .desc("Number of sends of the PIM cores refused by each vault for lack of credits, retries included")
+              .precision(0)
+              ;
+        }
+        if (configs.get_pim_core_num() > 0) {
+          pim_incoming_stats[0].reset(new VectorStat);
+          pim_incoming_stats[0]->init(ctrls.size())
+              .name("pim_incoming_requests_per_channel")
+              .desc("Number of incoming requests of the PIM cores to each DRAM channel")
+              .precision(0)
+              ;
+          pim_incoming_stats[1].reset(new VectorStat);
+          pim_incoming_stats[1]->init(ctrls.size())
+              .name("pim_incoming_read_reqs_per_channel")
+              .desc("Number of incoming read requests of the PIM cores to each DRAM channel")
+              .precision(0)
+              ;
+          pim_incoming_requests_per_channel = pim_incoming_stats[0].get();
+          pim_incoming_read_reqs_per_channel = pim_incoming_stats[1].get();
+        }
         ramulator_active_cycles
             .name("ramulator_active_cycles")
             .desc("The total number of cycles that the DRAM part is active (serving R/W)")
@@ -349,38 +428,38 @@ public:
             ;
 
         read_row_hits
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("read_row_hits")
             .desc("Number of row hits for read requests")
             .precision(0)
             ;
         read_row_misses
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("read_row_misses")
             .desc("Number of row misses for read requests")
             .precision(0)
             ;
         read_row_conflicts
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("read_row_conflicts")
             .desc("Number of row conflicts for read requests")
             .precision(0)
             ;
 
         write_row_hits
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("write_row_hits")
             .desc("Number of row hits for write requests")
             .precision(0)
             ;
         write_row_misses
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("write_row_misses")
             .desc("Number of row misses for write requests")
             .precision(0)
             ;
         write_row_conflicts
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("write_row_conflicts")
             .desc("Number of row conflicts for write requests")
             .precision(0)
@@ -419,43 +498,61 @@ public:
             .precision(6)
             ;
 
+        write_coalesced
+            .name("write_coalesced")
+            .desc("Writes merged into a queued write to the same address.")
+            .precision(0)
+            ;
+        read_write_turnarounds
+            .name("read_write_turnarounds")
+            .desc("Reads served after a write and writes served after a read.")
+            .precision(0)
+            ;
+        write_mode_cycles
+            .name("write_mode_cycles")
+            .desc("Memory cycles in write mode with writes queued, over all vaults.")
+            .precision(0)
+            ;
+
         record_read_hits
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("record_read_hits")
             .desc("record read hit count for this core when it reaches request limit or to the end")
             ;
 
         record_read_misses
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("record_read_misses")
             .desc("record_read_miss count for this core when it reaches request limit or to the end")
             ;
 
         record_read_conflicts
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("record_read_conflicts")
             .desc("record read conflict count for this core when it reaches request limit or to the end")
             ;
 
         record_write_hits
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("record_write_hits")
             .desc("record write hit count for this core when it reaches request limit or to the end")
             ;
 
         record_write_misses
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("record_write_misses")
             .desc("record write miss count for this core when it reaches request limit or to the end")
             ;
 
         record_write_conflicts
-            .init(configs.get_core_num())
+            .init(core_stat_num)
             .name("record_write_conflicts")
             .desc("record write conflict for this core when it reaches request limit or to the end")
             ;
 
         for (auto ctrl : ctrls) {
+          ctrl->pim_core_base = pim_core_base;
+          ctrl->packets = &packets;
           ctrl->read_transaction_bytes = &read_transaction_bytes;
           ctrl->write_transaction_bytes = &write_transaction_bytes;
 
@@ -474,6 +571,9 @@ public:
           ctrl->req_queue_length_sum = &req_queue_length_sum;
           ctrl->read_req_queue_length_sum = &read_req_queue_length_sum;
           ctrl->write_req_queue_length_sum = &write_req_queue_length_sum;
+          ctrl->write_coalesced = &write_coalesced;
+          ctrl->read_write_turnarounds = &read_write_turnarounds;
+          ctrl->write_mode_cycles = &write_mode_cycles;
 
           ctrl->record_read_hits = &record_read_hits;
           ctrl->record_read_misses = &record_read_misses;
@@ -482,10 +582,62 @@ public:
           ctrl->record_write_misses = &record_write_misses;
           ctrl->record_write_conflicts = &record_write_conflicts;
         }
+
+        if (configs.contains("controller_threads"))
+            start_controller_threads(configs.get_int_value("controller_threads"));
+
+        if (configs["stats_series"] != "") {
+            series.reset(new TimeSeries(configs));
+            series->before_dump = [this]() { flush_stat_batches(); };
+        }
+    }
+
+    // Vaults share only the statistics above and, in PIM mode, the callbacks
+    // of completed requests; response packets stay in the vault until the
+    // logic layers tick. See Memory<T>::start_controller_threads().
+    void start_controller_threads(int threads)
+    {
+        threads = min(threads, int(ctrls.size()));
+        if (threads <= 1)
+            return;
+        for (auto ctrl : ctrls)
+            if (ctrl->print_cmd_trace)
+                return;
+
+        for (auto ctrl : ctrls) {
+            ctrl->defer_callbacks = true;
+            stat_batches.emplace_back(new ControllerStatBatch<Controller<HMC>>(ctrl, {
+                &Controller<HMC>::read_transaction_bytes, &Controller<HMC>::write_transaction_bytes,
+                &Controller<HMC>::row_hits, &Controller<HMC>::row_misses, &Controller<HMC>::row_conflicts,
+                &Controller<HMC>::queueing_latency_sum, &Controller<HMC>::req_queue_length_sum,
+                &Controller<HMC>::read_req_queue_length_sum, &Controller<HMC>::write_req_queue_length_sum,
+                &Controller<HMC>::write_coalesced, &Controller<HMC>::read_write_turnarounds,
+                &Controller<HMC>::write_mode_cycles,
+            }, {
+                &Controller<HMC>::read_row_hits, &Controller<HMC>::read_row_misses,
+                &Controller<HMC>::read_row_conflicts, &Controller<HMC>::write_row_hits,
+                &Controller<HMC>::write_row_misses, &Controller<HMC>::write_row_conflicts,
+            }));
+        }
+        tick_pool.reset(new TickPool(threads, [this, threads](int shard) {
+            int begin = shard * ctrls.size() / threads;
+            int end = (shard + 1) * ctrls.size() / threads;
+            for (int i = begin; i < end; i++)
+                ctrls[i]->tick();
+        }));
+    }
+
+    void flush_stat_batches()
+    {
+        for (auto& batch : stat_batches) {
+            batch->detach();
+            batch->attach();
+        }
     }
 
     ~Memory()
     {
+        tick_pool.reset();
         for (auto ctrl: ctrls)
             delete ctrl;
         delete spec;
@@ -506,9 +658,17 @@ public:
         num_dram_cycles++;
 
         bool is_active = false;
-        for (auto ctrl : ctrls) {
-          is_active = is_active || ctrl->is_active();
-          ctrl->tick();
+        if (tick_pool) {
+          for (auto ctrl : ctrls)
+            is_active = is_active || ctrl->is_active();
+          tick_pool->run();
+          for (auto ctrl : ctrls)
+            ctrl->deliver_callbacks();
+        } else {
+          for (auto ctrl : ctrls) {
+            is_active = is_active || ctrl->is_active();
+            ctrl->tick();
+          }
         }
         if (is_active) {
           ramulator_active_cycles++;
@@ -516,27 +676,78 @@ public:
         for (auto logic_layer : logic_layers) {
           logic_layer->tick();
         }
+        if (series) {
+          series->tick();
+        }
+    }
+
+    // Number of upcoming ticks up to and including the first one in which a
+    // vault or a logic layer may make progress
+    long ticks_to_next_event()
+    {
+        long next_clk = LONG_MAX;
+        for (auto ctrl : ctrls) {
+          next_clk = min(next_clk, ctrl->get_next_event());
+        }
+        for (auto logic_layer : logic_layers) {
+          next_clk = min(next_clk, logic_layer->get_next_event());
+        }
+        // a row of the time series holds the counts of the cores up to its
+        // tick, which the cores may change in skipped ticks
+        if (series) {
+          next_clk = min(next_clk, clk + series->ticks_to_dump());
+        }
+        return next_clk == LONG_MAX ? LONG_MAX : next_clk - clk;
+    }
+
+    void skip(long cycles)
+    {
+        clk += cycles;
+        num_dram_cycles += cycles;
+
+        bool is_active = false;
+        for (auto ctrl : ctrls) {
+          is_active = is_active || ctrl->is_active();
+          ctrl->skip(cycles);
+        }
+        if (is_active) {
+          ramulator_active_cycles += cycles;
+        }
+        for (auto logic_layer : logic_layers) {
+          logic_layer->skip(cycles);
+        }
+        if (series) {
+          series->skip(cycles);
+        }
     }
 
     int assign_tag(int slid) {
       if (tags_pools[slid].empty()) {
         return -1;
       } else {
-        int tag = tags_pools[slid].front();
-        tags_pools[slid].pop_front();
+        int tag = tags_pools[slid].back();
+        tags_pools[slid].pop_back();
         return tag;
       }
     }
 
-    Packet form_request_packet(const Request& req) {
+    // Puts the request packet of req in its slot of the pool: that of its tag
+    // for the host, -1 when the link has no tag left
+    int form_request_packet(Request& req) {
       // All packets sent from host controller are Request packets
       long addr = req.addr;
       int cub = addr / capacity_per_stack;
-      long adrs = addr;
+      // the address within the stack
+      long adrs = addr % capacity_per_stack;
       int max_block_bits = spec->maxblock_entry.flit_num_bits;
       clear_lower_bits(addr, max_block_bits);
       int slid = addr % spec->source_links;
-      int tag = assign_tag(slid); // may return -1 when no available tag // TODO recycle tags when request callback
+      // the requests of PIM cores do not use the tags of the host links
+      int tag = req.pim ? 0 : assign_tag(slid);
+      if (tag == -1) {
+        debug_hmc("tag for link %d not available", slid);
+        return -1;
+      }
       int lng = req.type == Request::Type::READ ?
                                                 1 : 1 +  spec->payload_flits;
       Packet::Command cmd;
@@ -549,7 +760,9 @@ public:
         break;
         default: assert(false);
       }
-      Packet packet(Packet::Type::REQUEST, cub, adrs, tag, lng, slid, cmd);
+      req.packet = req.pim ? packets.alloc() : packets.tagged_slot(slid, tag);
+      Packet& packet = packets[req.packet];
+      packet = Packet(Packet::Type::REQUEST, cub, adrs, tag, lng, slid, cmd);
       packet.req = req;
       debug_hmc("cub: %d", cub);
       debug_hmc("adrs: %lx", adrs);
@@ -559,20 +772,31 @@ public:
       // DEBUG:
       assert(packet.header.CUB.valid());
       assert(packet.header.ADRS.valid());
-      assert(packet.header.TAG.valid()); // -1 also considered valid here...
+      assert(packet.header.TAG.valid());
       assert(packet.tail.SLID.valid());
       assert(packet.header.CMD.valid());
-      return packet;
+      return req.packet;
     }
 
-    void receive_packets(Packet packet) {
+    // a packet from a host link, a response unless slot is -1 (flow control)
+    void receive_packets(int slot, int rtc) {
       debug_hmc("receive response packets@host controller");
-      if (packet.flow_control) {
+      if (slot < 0) {
         return;
       }
+      Packet& packet = packets[slot];
       assert(packet.type == Packet::Type::RESPONSE);
+      // the callback may send requests, which may take slots
+      Request req = packet.req;
+      if (req.pim) {
+        // a response of a PIM core from another stack
+        packets.release(slot);
+        if (req.type == Request::Type::READ) {
+          req.callback(req);
+        }
+        return;
+      }
       tags_pools[packet.header.SLID.value].push_back(packet.header.TAG.value);
-      Request& req = packet.req;
       req.depart_hmc = clk;
       if (req.type == Request::Type::READ) {
         read_latency_sum += req.depart_hmc - req.arrive_hmc;
@@ -585,143 +809,228 @@ public:
       }
     }
 
-    bool send(Request req)
+    // Decodes the address of req into its address vector
+    void map_address(Request& req)
     {
-        debug_hmc("receive request packets@host controller");
         req.initial_addr = req.addr;
         req.addr_vec.resize(addr_bits.size());
-        req.reqid = mem_req_count;
 
         clear_higher_bits(req.addr, max_address-1ll);
         long addr = req.addr;
-        long coreid = req.coreid;
 
         // Each transaction size is 2^tx_bits, so first clear the lowest tx_bits bits
         clear_lower_bits(addr, tx_bits);
+        mapping->decode(addr, req.addr_vec.data());
+        // vaults are numbered across the stacks
+        req.addr_vec[int(HMC::Level::Vault)] += req.addr / capacity_per_stack * vaults_per_stack;
+    }
+
+    // The address_mapping of type: the levels from the most significant
+    // bits. The lowest bits of the column are those of a maximum block, so
+    // that a block stays in a vault.
+    string preset_mapping()
+    {
+        string low_column = "Co" + to_string(spec->maxblock_entry.flit_num_bits - tx_bits);
         switch(int(type)) {
-          case int(Type::RoCoBaVa): {
-            int max_block_col_bits =  spec->maxblock_entry.flit_num_bits - tx_bits;
-            req.addr_vec[int(HMC::Level::Column)] = slice_lower_bits(addr, max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Vault)]  = slice_lower_bits(addr, addr_bits[int(HMC::Level::Vault)]);
-            req.addr_vec[int(HMC::Level::Bank)]   = slice_lower_bits(addr, addr_bits[int(HMC::Level::Bank)]);
-            req.addr_vec[int(HMC::Level::BankGroup)] = slice_lower_bits(addr, addr_bits[int(HMC::Level::BankGroup)]);
-            int column_MSB_bits = slice_lower_bits(addr, addr_bits[int(HMC::Level::Column)] - max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Column)] = req.addr_vec[int(HMC::Level::Column)] | (column_MSB_bits << max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Row)] = slice_lower_bits(addr, addr_bits[int(HMC::Level::Row)]);
-          }
-          break;
-          case int(Type::RoBaCoVa): {
-            int max_block_col_bits =
-                spec->maxblock_entry.flit_num_bits - tx_bits;
-            req.addr_vec[int(HMC::Level::Column)] =
-                slice_lower_bits(addr, max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Vault)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::Vault)]);
-            int column_MSB_bits =
-              slice_lower_bits(
-                  addr, addr_bits[int(HMC::Level::Column)] - max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Column)] =
-              req.addr_vec[int(HMC::Level::Column)] | (column_MSB_bits << max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Bank)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::Bank)]);
-            req.addr_vec[int(HMC::Level::BankGroup)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::BankGroup)]);
-            req.addr_vec[int(HMC::Level::Row)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::Row)]);
-          }
-          break;
-          case int(Type::RoCoBaBgVa): {
-            int max_block_col_bits =
-                spec->maxblock_entry.flit_num_bits - tx_bits;
-            req.addr_vec[int(HMC::Level::Column)] =
-                slice_lower_bits(addr, max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Vault)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::Vault)]);
-            req.addr_vec[int(HMC::Level::BankGroup)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::BankGroup)]);
-            req.addr_vec[int(HMC::Level::Bank)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::Bank)]);
-            int column_MSB_bits =
-              slice_lower_bits(
-                  addr, addr_bits[int(HMC::Level::Column)] - max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Column)] =
-              req.addr_vec[int(HMC::Level::Column)] | (column_MSB_bits << max_block_col_bits);
-            req.addr_vec[int(HMC::Level::Row)] =
-                slice_lower_bits(addr, addr_bits[int(HMC::Level::Row)]);
-          }
-          break;
+          case int(Type::RoCoBaVa): return "RoCoBgBaVa" + low_column;
+          case int(Type::RoBaCoVa): return "RoBgBaCoVa" + low_column;
+          case int(Type::RoCoBaBgVa): return "RoCoBaBgVa" + low_column;
           default:
               assert(false);
         }
+        return "";
+    }
 
-        requests_per_vault[req.addr_vec[int(HMC::Level::Vault)]]++;
-        req.arrive_hmc = clk;
+    // index in ctrls of the vault of the address of a request, before it is
+    // mapped (see TraceDispatcher)
+    int get_vault(long addr)
+    {
+        clear_higher_bits(addr, max_address-1ll);
+        int stack = addr / capacity_per_stack;
+        clear_lower_bits(addr, tx_bits);
+        return stack * vaults_per_stack + mapping->decode(addr, int(HMC::Level::Vault));
+    }
+
+    // index in ctrls of the vault of a mapped request
+    int get_vault(const Request& req)
+    {
+        return req.addr_vec[int(HMC::Level::Vault)];
+    }
 
-        if(pim_mode_enabled){
-            Packet packet = form_request_packet(req);
-            ctrls[req.addr_vec[int(HMC::Level::Vault)]] -> receive(packet);
+    // The PIM cores are spread evenly over the stacks, in order: the stack of
+    // a core and the first core of a stack, out of cores
+    int home_stack(int coreid, int cores)
+    {
+        return long(coreid) * stacks / cores;
+    }
+
+    int first_core(int cub, int cores)
+    {
+        return (long(cub) * cores + stacks - 1) / stacks;
+    }
+
+    bool send(Request req)
+    {
+        if (pim_mode_enabled)
+            return send_pim(req);
+        return send_host(req);
+    }
+
+    // a request of a PIM core, straight to its vault
+    bool send_pim(Request req)
+    {
+        req.pim = true;
+        map_address(req);
+        req.reqid = mem_req_count;
+        long coreid = req.coreid;
+
+        int vault = get_vault(req);
+        req.arrive_hmc = clk;
 
-            if (req.type == Request::Type::READ) {
-                ++num_read_requests[coreid];
-                ++incoming_read_reqs_per_channel[req.addr_vec[int(HMC::Level::Vault)]];
+        int slot = form_request_packet(req);
+        Packet& packet = packets[slot];
+        packet.src_cub = home_stack(coreid, pim_cores);
+        if (packet.src_cub == packet.header.CUB.value) {
+            if (!ctrls[vault]->receive_pim(slot)) {
+                packets.release(slot);
+                ++(*pim_vault_stalls)[vault];
+                return false;
             }
-            if (req.type == Request::Type::WRITE) {
-                ++num_write_requests[coreid];
+        } else {
+            // a vault of another stack, over the pass-thru links
+            Link<HMC>* link = logic_layers[packet.src_cub]->route(
+                packet.header.CUB.value, packet.tail.SLID.value);
+            if (packet.total_flits > link->master.available_space()) {
+                packets.release(slot);
+                ++(*pim_vault_stalls)[vault];
+                return false;
             }
-            ++incoming_requests_per_channel[req.addr_vec[int(HMC::Level::Vault)]];
-            ++mem_req_count;
-            return true;
+            link->master.output_buffer.push_back(slot);
         }
-        else{
-            Packet packet = form_request_packet(req);
 
-            if (packet.header.TAG.value == -1) {
-              debug_hmc("tag for link %d not available", packet.tail.SLID.value);
-              return false;
-            }
+        requests_per_vault[vault]++;
+        if (req.type == Request::Type::READ) {
+            ++num_read_requests[pim_core_base + coreid];
+            ++(*pim_incoming_read_reqs_per_channel)[vault];
+        }
+        if (req.type == Request::Type::WRITE) {
+            ++num_write_requests[pim_core_base + coreid];
+        }
+        ++(*pim_incoming_requests_per_channel)[vault];
+        ++mem_req_count;
+        return true;
+    }
 
-            // TODO support multiple stacks
-
-
-            Link<HMC>* link =
-                logic_layers[0]->host_links[packet.tail.SLID.value].get();
-
-            if (packet.total_flits <= link->slave.available_space()) {
-              link->slave.receive(packet);
-              if (req.type == Request::Type::READ) {
-                ++num_read_requests[coreid];
-                ++incoming_read_reqs_per_channel[req.addr_vec[int(HMC::Level::Vault)]];
-              }
-              if (req.type == Request::Type::WRITE) {
-                ++num_write_requests[coreid];
-              }
-              ++incoming_requests_per_channel[req.addr_vec[int(HMC::Level::Vault)]];
-              ++mem_req_count;
-              return true;
-            } else {
-              return false;
-            }
+    // a request of the host, over the host links of the first stack
+    bool send_host(Request req)
+    {
+        debug_hmc("receive request packets@host controller");
+        map_address(req);
+        req.reqid = mem_req_count;
+        long coreid = req.coreid;
+
+        int vault = get_vault(req);
+        req.arrive_hmc = clk;
+
+        int slot = form_request_packet(req);
+        if (slot == -1) {
+          return false;
+        }
+        Packet& packet = packets[slot];
+
+        // the host is attached to the first stack
+        int slid = packet.tail.SLID.value;
+        Link<HMC>* link = logic_layers[0]->host_links[slid].get();
+
+        if (packet.total_flits <= link->slave.available_space()) {
+          link->slave.receive(slot, packet.tail.RTC.value);
+          requests_per_vault[vault]++;
+          if (req.type == Request::Type::READ) {
+            ++num_read_requests[coreid];
+            ++incoming_read_reqs_per_channel[vault];
+          }
+          if (req.type == Request::Type::WRITE) {
+            ++num_write_requests[coreid];
+          }
+          ++incoming_requests_per_channel[vault];
+          ++mem_req_count;
+          return true;
+        } else {
+          // the tag is free again
+          tags_pools[slid].push_back(packet.header.TAG.value);
+          return false;
         }
      }
 
+    void warm(Request req)
+    {
+        map_address(req);
+        ctrls[get_vault(req)]->warm(req);
+    }
+
+    void get_totals(long& cycles, double& bytes)
+    {
+        flush_stat_batches();
+        cycles = long(num_dram_cycles.value());
+        bytes = read_transaction_bytes.value() + write_transaction_bytes.value();
+    }
+
     int pending_requests()
     {
         int reqs = 0;
         for (auto ctrl: ctrls)
-            reqs += ctrl->readq.size() + ctrl->writeq.size() + ctrl->otherq.size() + ctrl->pending.size();
+            reqs += ctrl->readq.size() + ctrl->writeq.size() + ctrl->otherq.size() + ctrl->pending.size()
+                + ctrl->pim_buffer.size();
         return reqs;
     }
 
+    // pending_requests() leaves out the packets on the links: a request of
+    // the host is only done once its response has returned the tag (PIM
+    // reads complete in the vault and keep theirs)
+    bool is_drained()
+    {
+        if (pending_requests())
+            return false;
+        if (!pim_mode_enabled)
+            for (auto& tags_pool : tags_pools)
+                if (int(tags_pool.size()) != spec->max_tags)
+                    return false;
+        for (auto logic_layer : logic_layers)
+            if (logic_layer->get_next_event() != LONG_MAX)
+                return false;
+        return true;
+    }
+
+    void checkpoint(Checkpoint& ckpt)
+    {
+        ckpt.section("memory");
+        ckpt.io(free_physical_pages);
+        ckpt.io(free_physical_pages_remaining);
+        ckpt.io(page_translation);
+        ckpt.io(tags_pools);
+        for (auto ctrl : ctrls)
+            ctrl->checkpoint(ckpt);
+    }
+
     void finish(void) {
       dram_capacity = max_address;
       int *sz = spec->org_entry.count;
       maximum_internal_bandwidth =
-        spec->speed_entry.rate * 1e6 * spec->channel_width * sz[int(HMC::Level::Vault)] / 8;
+        spec->speed_entry.rate * 1e6 * spec->channel_width * sz[int(HMC::Level::Vault)] * stacks / 8;
       maximum_link_bandwidth =
         spec->link_width * 2 * spec->source_links * spec->lane_speed * 1e9 / 8;
 
+      flush_stat_batches();
+      if (series) {
+        series->finish();
+      }
       long dram_cycles = num_dram_cycles.value();
-      long total_read_req = num_read_requests.total();
+      // the latencies are those of the reads of the host cores, which come
+      // first in the per-core statistics
+      Stats::VCounter reads;
+      num_read_requests.value(reads);
+      long total_read_req = pim_mode_enabled ? long(num_read_requests.total())
+          : long(accumulate(reads.begin(), reads.begin() + pim_core_base, 0.0));
       for (auto ctrl : ctrls) {
         ctrl->finish(dram_cycles);
       }
@@ -812,14 +1121,7 @@ private:
     }
 
     bool tmp_bool = false;
-public:
-    int slice_lower_bits(long& addr, int bits)
-    {
 
-        int lbits = addr & ((1<<bits) - 1);
-        addr >>= bits;
-        return lbits;
-    }
     void clear_lower_bits(long& addr, int bits)
     {
         addr >>= bits;
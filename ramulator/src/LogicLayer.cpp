@@ -5,17 +5,19 @@
 
 #include <cmath>
 #include <vector>
-#include <set>
+#include <string>
 
 namespace ramulator {
 
 template<typename T>
 void LinkMaster<T>::send() {
+  PacketPool& packets = *logic_layer->packets;
   if (output_buffer.size() > 0 &&
-      available_token_count >= output_buffer.front().total_flits) {
+      available_token_count >= packets[output_buffer.front()].total_flits) {
     debug_hmc("send data packet @ link %d master", link->id);
 
-    Packet packet = output_buffer.front();
+    int slot = output_buffer.front();
+    Packet& packet = packets[slot];
     output_buffer.pop_front();
     int rtc = leftmostbit(link->slave.extracted_token_count);
     debug_hmc("link->slave.extracted_token_count: %d, RTC: %d",
@@ -25,13 +27,14 @@ void LinkMaster<T>::send() {
 
     debug_hmc("packet.total_flits: %d", packet.total_flits);
 
+    int total_flits = packet.total_flits;
     if (link->type != Link<T>::Type::HOST_SOURCE_MODE) {
-      available_token_count -= packet.total_flits;
+      available_token_count -= total_flits;
     }
-    send_via_link(packet);
+    send_via_link(slot, rtc);
 
     next_packet_clk = clk +
-        ceil(packet.total_flits * logic_layer->one_flit_cycles);
+        ceil(total_flits * one_flit_cycles);
     debug_hmc("clk %ld", clk);
     debug_hmc("next_packet_clk %ld", next_packet_clk);
   } else {
@@ -42,17 +45,16 @@ void LinkMaster<T>::send() {
       debug_hmc("link->slave.extracted_token_count: %d, RTC: %d",
           link->slave.extracted_token_count, rtc);
       link->slave.extracted_token_count -= rtc;
-      Packet tret_packet(Packet::Type::TRET, rtc);
-      send_via_link(tret_packet);
-      next_packet_clk = clk +
-          ceil(tret_packet.total_flits * logic_layer->one_flit_cycles);
+      // a TRET packet, of one flit
+      send_via_link(-1, rtc);
+      next_packet_clk = clk + ceil(one_flit_cycles);
       debug_hmc("clk: %ld", clk);
       debug_hmc("next_packet_clk %ld", next_packet_clk);
     } else {
       // send NULL packet here: no need to do anything
       // NULL packet has one flit
       debug_hmc("send NULL packet @ link %d master", link->id);
-      next_packet_clk = clk + ceil(logic_layer->one_flit_cycles);
+      next_packet_clk = clk + ceil(one_flit_cycles);
       debug_hmc("clk: %ld", clk);
       debug_hmc("next_packet_clk %ld", next_packet_clk);
     }
@@ -60,17 +62,27 @@ void LinkMaster<T>::send() {
 }
 
 template<typename T>
-void LinkSlave<T>::receive(Packet& packet) {
-  if (packet.flow_control) {
+void LinkMaster<T>::skip(long cycles) {
+  // an idle link sends a NULL packet every ceil(one_flit_cycles) cycles
+  long last = clk + cycles;
+  if (next_packet_clk <= last) {
+    long period = ceil(one_flit_cycles);
+    long first = std::max(clk + 1, next_packet_clk);
+    next_packet_clk = first + ((last - first) / period + 1) * period;
+  }
+  clk = last;
+}
+
+template<typename T>
+void LinkSlave<T>::receive(int slot, int rtc, long ready) {
+  link->master.available_token_count += rtc;
+  if (slot < 0) {
     debug_hmc("receive flow control packet @ link %d slave", link->id);
-    int rtc = packet.tail.RTC.value;
-    link->master.available_token_count += rtc;
     // drop this packet
   } else {
     debug_hmc("receive data packet @ link %d slave", link->id);
-    int rtc = packet.tail.RTC.value;
-    link->master.available_token_count += rtc;
-    input_buffer.push_back(packet);
+    input_buffer.push_back(slot);
+    ready_clk.push_back(ready);
     debug_hmc("input_buffer.size() %ld @ link %d slave",
         input_buffer.size(), link->id);
   }
@@ -80,69 +92,216 @@ template<typename T>
 void Switch<T>::tick() {
   clk++;
   debug_hmc("@ clk: %ld stack %d", clk, logic_layer->cub);
-  // one controller can only receive one packet per cycle
-  std::set<int> used_vaults;
-  for (auto link : logic_layer->host_links) {
-    if (link->slave.input_buffer.empty()) {
-      continue;
-    }
-    // TODO reorder the requests in one link when one vault is more busy
-    Packet& packet = link->slave.input_buffer.front();
-    Request& req = packet.req;
-    // from links to vaults
-    if (packet.header.CUB.value == logic_layer->cub) {
-      int vault_id = req.addr_vec[int(HMC::Level::Vault)];
-      if (used_vaults.find(vault_id) != used_vaults.end()) {
-        continue; // This port has been occupied in this cycle
+  PacketPool& packets = *logic_layer->packets;
+  // one controller and one link can only receive one packet per cycle
+  used_vaults.clear();
+  used_links.clear();
+  for (auto links : {&logic_layer->host_links, &logic_layer->pass_thru_links}) {
+    for (auto& link : *links) {
+      if (!link->slave.has_ready(clk)) {
+        continue;
       }
-      auto ctrl = vault_ctrls[vault_id];
-      if(ctrl->receive(packet)) {
-        link->slave.extracted_token_count += packet.total_flits;
-        link->slave.input_buffer.pop_front();
-        debug_hmc("extracted_token_count %d", link->slave.extracted_token_count);
+      // TODO reorder the requests in one link when one vault is more busy
+      int slot = link->slave.input_buffer.front();
+      Packet& packet = packets[slot];
+      if (packet.type == Packet::Type::REQUEST &&
+          packet.header.CUB.value == logic_layer->cub) {
+        // from links to vaults
+        int vault_id = packet.req.addr_vec[int(HMC::Level::Vault)];
+        int port = vault_id % vault_ctrls.size();
+        if (used_vaults.test(port)) {
+          continue; // This port has been occupied in this cycle
+        }
+        if (!vault_ctrls[port]->receive(slot)) {
+          continue;
+        }
         debug_hmc("forward packet to vault %d", vault_id);
-        used_vaults.insert(vault_id);
+        used_vaults.set(port);
+      } else {
+        // requests to other stacks and responses on their way back
+        int dest = packet.type == Packet::Type::REQUEST ?
+            packet.header.CUB.value : packet.src_cub;
+        if (!forward(slot, dest)) {
+          continue;
+        }
       }
-    } else { // from links to other stacks
-      // TODO: support multiple stacks
-      assert((packet.header.CUB.value != logic_layer->cub) &&
-          "Only support one stack");
+      link->slave.extracted_token_count += packet.total_flits;
+      link->slave.pop_front();
+      debug_hmc("extracted_token_count %d", link->slave.extracted_token_count);
     }
   }
-  // from vaults to links
-  // currently only according to SLID field
-  // TODO: support multiple stacks
-  // one link can only receive one packet per cycle
-  std::set<int> used_links;
+  // from vaults to links, toward the stack the request came from and then
+  // according to SLID field
   for (auto vault_ctrl : vault_ctrls) {
     if (vault_ctrl->response_packets_buffer.empty()) {
       continue;
     }
-    Packet& packet = vault_ctrl->response_packets_buffer.front();
-    int slid = packet.header.SLID.value; // identify the target of transmission
-    Link<T>* link = logic_layer->host_links[slid].get();
-    assert(link->type == Link<T>::Type::HOST_SOURCE_MODE);
-    if (used_links.find(slid) != used_links.end()) {
-      continue; // This port has been occupied in this cycle
-    }
-    if (packet.total_flits <= link->master.available_space()) {
-      link->master.output_buffer.push_back(packet);
+    int slot = vault_ctrl->response_packets_buffer.front();
+    if (forward(slot, packets[slot].src_cub)) {
       vault_ctrl->response_packets_buffer.pop_front();
-      used_links.insert(slid);
     }
   }
 }
 
+template<typename T>
+bool Switch<T>::forward(int slot, int dest) {
+  Packet& packet = (*logic_layer->packets)[slot];
+  // identify the target of transmission
+  int slid = packet.type == Packet::Type::REQUEST ?
+      packet.tail.SLID.value : packet.header.SLID.value;
+  Link<T>* link = logic_layer->route(dest, slid);
+  if (link == nullptr) {
+    link = logic_layer->host_links[slid].get();
+  }
+  if (used_links.test(link->id)) {
+    return false; // This port has been occupied in this cycle
+  }
+  if (packet.total_flits > link->master.available_space()) {
+    return false;
+  }
+  link->master.output_buffer.push_back(slot);
+  used_links.set(link->id);
+  return true;
+}
+
+template<typename T>
+long Switch<T>::get_next_event() {
+  long next_clk = LONG_MAX;
+  for (auto links : {&logic_layer->host_links, &logic_layer->pass_thru_links}) {
+    for (auto& link : *links) {
+      if (!link->slave.input_buffer.empty()) {
+        next_clk = std::min(next_clk,
+            std::max(clk + 1, link->slave.ready_clk.front() + 1));
+      }
+    }
+  }
+  for (auto vault_ctrl : vault_ctrls) {
+    if (!vault_ctrl->response_packets_buffer.empty()) {
+      return clk + 1;
+    }
+  }
+  return next_clk;
+}
+
+template<typename T>
+void LogicLayer<T>::set_topology(const Config& configs, int stacks) {
+  std::string topology = configs["stack_topology"];
+  next_hop.assign(stacks, -1);
+  if (topology == "" || topology == "chain") {
+    if (cub > 0) {
+      neighbours.push_back(cub - 1);
+    }
+    if (cub < stacks - 1) {
+      neighbours.push_back(cub + 1);
+    }
+    for (int dest = 0 ; dest < stacks ; ++dest) {
+      if (dest != cub) {
+        int next = dest < cub ? cub - 1 : cub + 1;
+        next_hop[dest] = std::find(neighbours.begin(), neighbours.end(), next) -
+            neighbours.begin();
+      }
+    }
+  } else if (topology == "star") {
+    for (int dest = 0 ; dest < stacks ; ++dest) {
+      if (dest == cub) {
+        continue;
+      }
+      if (cub == 0) {
+        next_hop[dest] = neighbours.size();
+        neighbours.push_back(dest);
+      } else {
+        // everything goes through the cube of the host
+        next_hop[dest] = 0;
+      }
+    }
+    if (cub != 0) {
+      neighbours.push_back(0);
+    }
+  } else {
+    std::cerr << "Unknown stack_topology: " << topology << std::endl;
+    exit(1);
+  }
+}
+
+template<typename T>
+double LogicLayer<T>::pass_thru_link_flit_cycles(const Config& configs) {
+  int link_width = spec->link_width;
+  double lane_speed = spec->lane_speed;
+  if (configs.contains("pass_thru_link_width")) {
+    auto it = T::linkwidth_map.find(configs["pass_thru_link_width"]);
+    if (it == T::linkwidth_map.end()) {
+      std::cerr << "Unknown pass_thru_link_width: "
+                << configs["pass_thru_link_width"] << std::endl;
+      exit(1);
+    }
+    link_width = spec->link_width_table[int(it->second)];
+  }
+  if (configs.contains("pass_thru_lane_speed")) {
+    auto it = T::lanespeed_map.find(configs["pass_thru_lane_speed"]);
+    if (it == T::lanespeed_map.end()) {
+      std::cerr << "Unknown pass_thru_lane_speed: "
+                << configs["pass_thru_lane_speed"] << std::endl;
+      exit(1);
+    }
+    lane_speed = spec->lane_speed_table[int(it->second)];
+  }
+  return (128.0/(lane_speed * link_width))/mem->clk_ns();
+}
+
+template<typename T>
+void LogicLayer<T>::connect(LogicLayer<T>* peer) {
+  int n = std::find(neighbours.begin(), neighbours.end(), peer->cub) -
+      neighbours.begin();
+  int m = std::find(peer->neighbours.begin(), peer->neighbours.end(), cub) -
+      peer->neighbours.begin();
+  assert(n < int(neighbours.size()) && m < int(peer->neighbours.size()));
+  for (int i = 0 ; i < pass_thru_links_num ; ++i) {
+    Link<T>* link = pass_thru_links[n * pass_thru_links_num + i].get();
+    Link<T>* peer_link = peer->pass_thru_links[m * pass_thru_links_num + i].get();
+    // a packet sent at clk reaches the other side pass_thru_latency cycles
+    // after its first flit
+    link->master.send_via_link = [this, link, peer_link](int slot, int rtc) {
+      peer_link->slave.receive(slot, rtc, link->master.clk + pass_thru_latency);
+    };
+    peer_link->master.send_via_link = [peer, link, peer_link](int slot, int rtc) {
+      link->slave.receive(slot, rtc, peer_link->master.clk + peer->pass_thru_latency);
+    };
+  }
+}
+
 template<typename T>
 void LogicLayer<T>::tick() {
-  for (auto link : host_links) {
+  for (auto& link : host_links) {
     link->master.tick();
   }
-  for (auto link : pass_thru_links) {
+  for (auto& link : pass_thru_links) {
     link->master.tick();
   }
   xbar.tick();
 }
 
+template<typename T>
+long LogicLayer<T>::get_next_event() {
+  long next_clk = xbar.get_next_event();
+  for (auto& link : host_links) {
+    next_clk = std::min(next_clk, link->master.get_next_event());
+  }
+  for (auto& link : pass_thru_links) {
+    next_clk = std::min(next_clk, link->master.get_next_event());
+  }
+  return next_clk;
+}
+
+template<typename T>
+void LogicLayer<T>::skip(long cycles) {
+  for (auto& link : host_links) {
+    link->master.skip(cycles);
+  }
+  for (auto& link : pass_thru_links) {
+    link->master.skip(cycles);
+  }
+  xbar.skip(cycles);
+}
+
 } /* namespace ramulator */
 #endif /*__LOGICLAYER_CPP*/
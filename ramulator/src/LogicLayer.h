@@ -6,6 +6,11 @@
 #include "HMC_Controller.h"
 #include "Memory.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
 #include <memory>
 #include <vector>
 
@@ -17,22 +22,28 @@ class Link;
 template<typename T>
 class LogicLayer;
 
+// A packet crossing a link: the slot of a data packet in the PacketPool, or
+// -1 for a flow control packet, and the tokens it returns to the other side
+typedef function<void(int, int)> LinkReceiver;
+
 template<typename T>
 class LinkMaster {
  public:
-  function<void(Packet&)> send_via_link;
+  LinkReceiver send_via_link;
   Link<T>* link;
   LogicLayer<T>* logic_layer;
-  std::deque<Packet> output_buffer;
+  Ring<int> output_buffer;  // slots of the packets to send
   int buffer_max = 32;
   int available_token_count; // available token count on the other side
+  double one_flit_cycles;
   long clk = 0;
   long next_packet_clk = 0;
 
-  LinkMaster(const Config& configs, function<void(Packet&)> receive_from_link,
+  LinkMaster(const Config& configs, LinkReceiver receive_from_link,
       Link<T>* link, LogicLayer<T>* logic_layer):
       send_via_link(receive_from_link), link(link), logic_layer(logic_layer),
-      available_token_count(link->slave.buffer_max) {
+      available_token_count(link->slave.buffer_max),
+      one_flit_cycles(logic_layer->one_flit_cycles) {
   }
 
   void send();
@@ -47,6 +58,17 @@ class LinkMaster {
       send();
     }
   }
+
+  // clk of the next data or flow control packet; an idle link only sends
+  // NULL packets, which skip() accounts for
+  long get_next_event() {
+    if (output_buffer.empty() && link->slave.extracted_token_count == 0) {
+      return LONG_MAX;
+    }
+    return std::max(clk + 1, next_packet_clk);
+  }
+
+  void skip(long cycles);
  private:
   // returns 0 if val == 0
   // returns 1<<leftmostbit if val > 0
@@ -67,12 +89,23 @@ class LinkSlave {
  public:
   Link<T>* link;
   int extracted_token_count = 0;
-  std::deque<Packet> input_buffer;
+  Ring<int> input_buffer;  // slots of the packets received
+  // clk after which each packet of input_buffer has crossed the link
+  Ring<long> ready_clk;
   int buffer_max = 32;
 
   LinkSlave(const Config& configs, Link<T>* link): link(link) {}
 
-  void receive(Packet& packet);
+  void receive(int slot, int rtc, long ready = 0);
+
+  bool has_ready(long clk) {
+    return !input_buffer.empty() && ready_clk.front() < clk;
+  }
+
+  void pop_front() {
+    input_buffer.pop_front();
+    ready_clk.pop_front();
+  }
 
   int available_space() {
     return buffer_max - input_buffer.size();
@@ -95,11 +128,23 @@ class Link {
   LinkMaster<T> master;
 
   Link(const Config& configs, Type type, int id, LogicLayer<T>* logic_layer,
-       function<void(Packet&)> receive_from_link):type(type), id(id),
+       LinkReceiver receive_from_link):type(type), id(id),
       slave(configs, this),
       master(configs, receive_from_link, this, logic_layer) {}
 };
 
+// One bit per port (vault or link) of a switch, set once the port has taken
+// a packet in the current cycle
+class PortMask {
+ public:
+  void resize(int ports) { words.assign((ports + 63) / 64, 0); }
+  void clear() { std::fill(words.begin(), words.end(), 0); }
+  bool test(int port) const { return words[port >> 6] >> (port & 63) & 1; }
+  void set(int port) { words[port >> 6] |= uint64_t(1) << (port & 63); }
+ private:
+  std::vector<uint64_t> words;
+};
+
 template<typename T>
 class Switch {
  public:
@@ -109,40 +154,94 @@ class Switch {
 
   Switch(const Config& configs, LogicLayer<T>* logic_layer,
          std::vector<Controller<T>*> vault_ctrls):
-      logic_layer(logic_layer), vault_ctrls(vault_ctrls) {}
+      logic_layer(logic_layer), vault_ctrls(vault_ctrls) {
+    used_vaults.resize(vault_ctrls.size());
+  }
+
+  // called once the logic layer has made its links
+  void set_links(int links) {
+    used_links.resize(links);
+  }
 
   void tick();
 
+  // clk of the next tick that may move a packet between links and vaults
+  long get_next_event();
+
+  void skip(long cycles) {
+    clk += cycles;
+  }
+
  private:
   // TODO longer delay for different quadrants
   const int delay = 1;
+
+  // moves a packet into the output buffer of the link toward cube dest, or
+  // of host link slid in dest; one packet per link and cycle
+  bool forward(int slot, int dest);
+  // one packet per vault and per link and cycle
+  PortMask used_vaults;
+  PortMask used_links;
 };
 
+// The stacks are connected by pass-thru links, pass_thru_links of them
+// between each pair of neighbouring cubes, in one of two topologies:
+//   chain: cube i is connected to cubes i - 1 and i + 1
+//   star:  cube 0 is connected to all other cubes
+// The host is attached to cube 0. A packet for another cube is forwarded
+// hop by hop on the link of the shortest path (selected by its SLID), and
+// responses return to the cube the request came from. Each hop adds
+// pass_thru_latency memory cycles to the serialization of the packet, which
+// runs at pass_thru_link_width and pass_thru_lane_speed (those of the host
+// links by default).
 template<typename T>
 class LogicLayer {
  public:
   T* spec;
   MemoryBase* mem;
+  // the packets in flight in all cubes
+  PacketPool* packets;
   int cub;
   double one_flit_cycles; // = ceil(128/(30/# of lane) / 0.8)
   Switch<T> xbar;
   std::vector<std::shared_ptr<Link<T>>> host_links;
+  // pass_thru_links_num links to each cube of neighbours in turn
   std::vector<std::shared_ptr<Link<T>>> pass_thru_links;
+  std::vector<int> neighbours;
+  // index in neighbours of the next cube toward each cube, -1 for this one
+  std::vector<int> next_hop;
+  int pass_thru_links_num;
+  int pass_thru_latency = 4;
 
   LogicLayer(const Config& configs, int cub, T* spec,
       std::vector<Controller<T>*> vault_ctrls, MemoryBase* mem,
-      function<void(Packet&)> host_ctrl_recv):
-      spec(spec), mem(mem), xbar(configs, this, vault_ctrls) {
+      PacketPool* packets, LinkReceiver host_ctrl_recv):
+      spec(spec), mem(mem), packets(packets), cub(cub),
+      xbar(configs, this, vault_ctrls) {
     // initialize some system parameters
     one_flit_cycles =
         (128.0/(spec->lane_speed * spec->link_width))/mem->clk_ns();
 
     int host_links_num = configs.get_int_value("source_mode_host_links");
     // FIXME: we shouldn't assume all host links are in source mode
-    int pass_thru_links_num = configs.get_int_value("pass_thru_links");
-    // FIXME: we shouldn't assume we only have one stack so we shouldn't assume
-    // the number of pass thru link is zero.
-    assert(pass_thru_links_num == 0);
+    pass_thru_links_num = configs.get_int_value("pass_thru_links");
+    int stacks = configs.get_stacks();
+    if (stacks > 1 && pass_thru_links_num <= 0) {
+      std::cerr << "stacks > 1 needs pass_thru_links > 0" << std::endl;
+      exit(1);
+    }
+    if (stacks == 1) {
+      pass_thru_links_num = 0;
+    }
+    if (configs.contains("pass_thru_latency")) {
+      pass_thru_latency = configs.get_int_value("pass_thru_latency");
+    }
+    if (pass_thru_latency < 0) {
+      std::cerr << "pass_thru_latency must not be negative" << std::endl;
+      exit(1);
+    }
+    set_topology(configs, stacks);
+
     int link_id = 0;
     for (int i = 0 ; i < host_links_num ; ++i) {
       // FIXME: we shouldn't assume all host links are in source mode
@@ -151,13 +250,41 @@ class LogicLayer {
                       host_ctrl_recv));
       link_id++;
     }
-    for (int i = 0 ; i < pass_thru_links_num ; ++i) {
-      // TODO instantiate pass_thru_links here
-      link_id++;
+
+    double pass_thru_flit_cycles = pass_thru_link_flit_cycles(configs);
+    for (unsigned n = 0 ; n < neighbours.size() ; ++n) {
+      for (int i = 0 ; i < pass_thru_links_num ; ++i) {
+        // connected to the peer cube in connect()
+        pass_thru_links.emplace_back(
+            new Link<T>(configs, Link<T>::Type::PASSTHRU, link_id, this,
+                        nullptr));
+        pass_thru_links.back()->master.one_flit_cycles = pass_thru_flit_cycles;
+        link_id++;
+      }
+    }
+    xbar.set_links(link_id);
+  }
+
+  // links the pass-thru links of this cube and of a neighbouring one
+  void connect(LogicLayer<T>* peer);
+
+  // the link a packet for cube dest leaves by, nullptr for this cube
+  Link<T>* route(int dest, int slid) {
+    int n = next_hop[dest];
+    if (n < 0) {
+      return nullptr;
     }
+    return pass_thru_links[n * pass_thru_links_num + slid % pass_thru_links_num].get();
   }
 
   void tick();
+
+  long get_next_event();
+  void skip(long cycles);
+
+ private:
+  void set_topology(const Config& configs, int stacks);
+  double pass_thru_link_flit_cycles(const Config& configs);
 };
 
 } /* namespace ramulator */
@@ -6,14 +6,21 @@
 #include "Memory.h"
 #include "HMC_Memory.h"
 #include "DRAM.h"
+#include "Sampler.h"
 #include "Statistics.h"
 #include <algorithm>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <stdlib.h>
 #include <functional>
 #include <map>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <boost/program_options.hpp>
 
 /* Standards */
@@ -96,7 +103,12 @@ void run_dramtrace(const Config& configs, Memory<T, Controller>& memory, const s
         };
 
     // TODO allow request streams coming from different cores
-    Request req(addr, type, read_complete, 0);
+    Request req(addr, type, Request::Callback::of(&read_complete), 0);
+
+    // A failed send leaves a generic memory untouched, so retrying it in
+    // skipped cycles changes nothing. The HMC host controller uses up a tag.
+    bool fast_forward = configs.fast_forward();
+    bool retry_is_noop = !std::is_same<T, HMC>::value;
 
     while (!end || memory.pending_requests()){
         if (!end && !stall){
@@ -119,6 +131,15 @@ void run_dramtrace(const Config& configs, Memory<T, Controller>& memory, const s
                 else if (type == Request::Type::WRITE) writes++;
             }
         }
+        if (fast_forward && (end || (stall && (window.is_full() || retry_is_noop)))) {
+            // nothing is sent until the memory makes progress
+            long ticks = memory.ticks_to_next_event();
+            if (ticks > 1 && ticks != LONG_MAX) {
+                memory.skip(ticks - 1);
+                clks += ticks - 1;
+                Stats::curTick += ticks - 1;
+            }
+        }
         memory.tick();
         clks ++;
         Stats::curTick++; // memory clock, global, for Statistics
@@ -129,6 +150,21 @@ void run_dramtrace(const Config& configs, Memory<T, Controller>& memory, const s
 
 }
 
+// The send of the PIM cores that run together with the host cores, straight
+// to the vaults; only HMC has them (see main())
+template <typename T>
+function<bool(Request)> pim_send(Memory<T, Controller>& memory)
+{
+    assert(false && "PIM cores need an HMC");
+    return nullptr;
+}
+
+template <>
+function<bool(Request)> pim_send<HMC>(Memory<HMC, Controller>& memory)
+{
+    return bind(&Memory<HMC, Controller>::send_pim, &memory, placeholders::_1);
+}
+
 template <typename T>
 void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const std::vector<string>& files)
 {
@@ -147,24 +183,139 @@ void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const st
 
     auto send = bind(&Memory<T, Controller>::send, &memory, placeholders::_1);
     Processor proc(configs, files, send, memory);
+
+    // --pim-trace: a second group of cores, PIM cores with the configuration
+    // of --pim-config, runs at the memory clock on the same vaults. Their
+    // statistics start with "pim_".
+    Config pim_configs;
+    unique_ptr<Processor> pim_proc;
+    if (configs["pim_trace"] != "") {
+        pim_configs = configs;
+        if (configs["pim_config"] != "") {
+            pim_configs.parse(configs["pim_config"]);
+        }
+        pim_configs.set("pim_mode", "1");
+        pim_configs.set_core_num(configs.get_pim_core_num());
+        // the PIM cores are organized as the host cores unless told otherwise
+        // (the in-order core issues no reads from zsim traces)
+        pim_configs.set_org(configs["pim_core_org"] != "" ? configs["pim_core_org"] : configs.get_cpu_type());
+        StatNamePrefix scope("pim_");
+        pim_proc.reset(new Processor(pim_configs, {configs["pim_trace"]}, pim_send(memory), memory));
+    }
+
+    // --restore: the run continues from a saved state, with the statistics
+    // and the processor clocks starting at zero
+    if (configs["restore"] != "") {
+        Checkpoint ckpt(configs["restore"], false);
+        proc.checkpoint(ckpt);
+        memory.checkpoint(ckpt);
+        cout << "Restored checkpoint " << configs["restore"] << endl;
+    }
+
+    // --checkpoint: after checkpoint_insts instructions or checkpoint_cycles
+    // processor cycles, the cores stop issuing and the state is saved once the
+    // requests in flight have drained, which ends the run
+    string checkpoint_file = configs["checkpoint"];
+    long checkpoint_insts = atol(configs["checkpoint_insts"].c_str());
+    long checkpoint_cycles = atol(configs["checkpoint_cycles"].c_str());
+    auto checkpoint_due = [&]() {
+        if (checkpoint_cycles > 0 && long(proc.cpu_cycles.value()) >= checkpoint_cycles)
+            return true;
+        if (checkpoint_insts <= 0)
+            return false;
+        long insts = 0;
+        for (auto& core : proc.cores)
+            insts += long(core->cpu_inst.value());
+        return insts >= checkpoint_insts;
+    };
+    bool draining = false;
+
+    // --sample-insts: detailed samples between functionally warmed stretches
+    unique_ptr<Sampler> sampler;
+    if (configs["sample_insts"] != "") {
+        sampler.reset(new Sampler(configs, proc, memory));
+        sampler->start();
+    }
+    // the sampler and --checkpoint-insts look at the instruction counts in
+    // every tick, so the cores skip ticks only while they wait for memory
+    if (sampler || checkpoint_insts > 0) {
+        proc.skip_bubbles = false;
+    }
+
+    bool fast_forward = configs.fast_forward();
+    // looked up once, not in every cycle
+    bool weighted_speedup = configs.calc_weighted_speedup();
+    bool early_exit = configs.is_early_exit();
+    // Exit conditions checked after every processor tick, without the side
+    // effects of Processor::finished() and Processor::has_reached_limit()
+    auto may_exit = [&]() {
+        bool all = true, any = false;
+        for (auto group : {&proc, pim_proc.get()}) {
+            if (!group)
+                continue;
+            for (auto& core : group->cores) {
+                bool done = weighted_speedup ? core->has_reached_limit() : core->finished();
+                all = all && done;
+                any = any || done;
+            }
+        }
+        if (weighted_speedup)
+            return all;
+        if (early_exit)
+            return any;
+        return all && memory.pending_requests() == 0;
+    };
+
+    // With PIM cores, a group of cores stops ticking once it is done, so that
+    // its cycles are its own
+    bool host_done = false, pim_done = !pim_proc;
+    auto host_ticking = [&]() { return !(pim_proc && host_done); };
     for (long i = 0; ; i++) {
+        bool ticked = (i == next_cpu_tick || i == next_mem_tick);
         if (i == next_cpu_tick) {
             next_cpu_tick += cpu_tick;
-            proc.tick();
+            if (host_ticking()) {
+                proc.tick();
+            }
             Stats::curTick++; // processor clock, global, for Statistics
 
-            if (configs.calc_weighted_speedup()) {
-                if (proc.has_reached_limit()) {
+            if (sampler) {
+                sampler->tick();
+            }
+
+            if (checkpoint_file != "") {
+                if (!draining && checkpoint_due()) {
+                    proc.drain();
+                    draining = true;
+                }
+                if (draining && proc.is_drained() && memory.is_drained()) {
+                    Checkpoint ckpt(checkpoint_file, true);
+                    proc.checkpoint(ckpt);
+                    memory.checkpoint(ckpt);
+                    cout << "Checkpoint written to " << checkpoint_file << " after "
+                         << long(proc.cpu_cycles.value()) << " cycles" << endl;
+                    checkpoint_file = "";
+                    break;
+                }
+            }
+
+            // each group of cores computes its statistics once it is done
+            if (!host_done)
+                host_done = weighted_speedup ? proc.has_reached_limit() : proc.finished();
+            if (!pim_done)
+                pim_done = weighted_speedup ? pim_proc->has_reached_limit() : pim_proc->finished();
+            if (weighted_speedup) {
+                if (host_done && pim_done) {
                    break;
                 }
             }
             else{
-                if (configs.is_early_exit()) {
-                    if (proc.finished())
+                if (early_exit) {
+                    if (host_done || (pim_proc && pim_done))
                         break;
                 }
                 else {
-                    if (proc.finished() && (memory.pending_requests() == 0)){
+                    if (host_done && pim_done && (memory.pending_requests() == 0)){
                          break;
                     }
                 }
@@ -173,8 +324,59 @@ void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const st
 
         if (i == next_mem_tick) {
             next_mem_tick += mem_tick;
+            if (!pim_done) {
+                pim_proc->tick();
+            }
             memory.tick();
         }
+
+        if (fast_forward && ticked) {
+            // Jump to the first tick of either clock that may do more than
+            // advance the clocks. Processor ticks that fall on the same
+            // cycle as that memory tick are not skipped: they come first.
+            long cpu_ticks = host_ticking() ? proc.ticks_to_next_event() : LONG_MAX;
+            if (cpu_ticks == 1 || may_exit() || (sampler && sampler->is_draining())) continue;
+            long mem_ticks = memory.ticks_to_next_event();
+            if (!pim_done) {
+                // the PIM cores tick with the memory
+                long pim_ticks = pim_proc->ticks_to_next_event();
+                if (pim_ticks == 1) continue;
+                mem_ticks = min(mem_ticks, pim_ticks);
+            }
+            if (cpu_ticks == LONG_MAX && mem_ticks == LONG_MAX) continue;
+
+            long until = LONG_MAX;
+            if (cpu_ticks != LONG_MAX)
+                until = next_cpu_tick + (cpu_ticks - 1) * cpu_tick;
+            if (mem_ticks != LONG_MAX)
+                until = min(until, next_mem_tick + (mem_ticks - 1) * mem_tick);
+
+            long cpu_skipped = max(0l, (until - next_cpu_tick + cpu_tick - 1) / cpu_tick);
+            long mem_skipped = max(0l, (until - next_mem_tick + mem_tick - 1) / mem_tick);
+            if (cpu_skipped > 0) {
+                if (host_ticking()) {
+                    proc.skip(cpu_skipped);
+                }
+                Stats::curTick += cpu_skipped;
+                next_cpu_tick += cpu_skipped * cpu_tick;
+            }
+            if (mem_skipped > 0) {
+                if (!pim_done) {
+                    pim_proc->skip(mem_skipped);
+                }
+                memory.skip(mem_skipped);
+                next_mem_tick += mem_skipped * mem_tick;
+            }
+            i = min(next_cpu_tick, next_mem_tick) - 1;
+        }
+    }
+
+    if (checkpoint_file != "") {
+        cout << "No checkpoint written: the simulation ended before " << checkpoint_file << " was due" << endl;
+    }
+
+    if (sampler) {
+        sampler->finish();
     }
 
     // This a workaround for statistics set only initially lost in the end
@@ -231,6 +433,156 @@ void start_run<HMC>(const Config& configs, HMC* spec, const vector<string>& file
   }
 }
 
+// Builds the memory of the DRAM standard in configs and runs the traces on it
+static void run_standard(Config& configs, const vector<string>& files) {
+  const std::string& standard = configs["standard"];
+  assert(standard != "" || "DRAM standard should be specified.");
+
+  if (configs["unlimit_bandwidth"] == "true") {
+    configs.set("speed", configs["speed"] + "_unlimit_bandwidth");
+  }
+
+  if (standard == "DDR3") {
+    DDR3* ddr3 = new DDR3(configs["org"], configs["speed"]);
+    start_run(configs, ddr3, files);
+  } else if (standard == "DDR4") {
+    DDR4* ddr4 = new DDR4(configs["org"], configs["speed"]);
+    start_run(configs, ddr4, files);
+  } else if (standard == "SALP-MASA") {
+    SALP* salp8 = new SALP(configs["org"], configs["speed"], "SALP-MASA", configs.get_subarrays());
+    start_run(configs, salp8, files);
+  } else if (standard == "LPDDR3") {
+    LPDDR3* lpddr3 = new LPDDR3(configs["org"], configs["speed"]);
+    start_run(configs, lpddr3, files);
+  } else if (standard == "LPDDR4") {
+    // total cap: 2GB, 1/2 of others
+    LPDDR4* lpddr4 = new LPDDR4(configs["org"], configs["speed"]);
+    start_run(configs, lpddr4, files);
+  } else if (standard == "GDDR5") {
+    GDDR5* gddr5 = new GDDR5(configs["org"], configs["speed"]);
+    start_run(configs, gddr5, files);
+  } else if (standard == "HBM") {
+    HBM* hbm = new HBM(configs["org"], configs["speed"]);
+    start_run(configs, hbm, files);
+  } else if (standard == "WideIO") {
+    // total cap: 1GB, 1/4 of others
+    WideIO* wio = new WideIO(configs["org"], configs["speed"]);
+    start_run(configs, wio, files);
+  } else if (standard == "WideIO2") {
+    // total cap: 2GB, 1/2 of others
+    WideIO2* wio2 = new WideIO2(configs["org"], configs["speed"], configs.get_channels());
+    if (configs.contains("extend_channel_width") &&
+        configs["extend_channel_width"] == "true") {
+      wio2->channel_width *= 2;
+    }
+    start_run(configs, wio2, files);
+  }
+  // Various refresh mechanisms
+    else if (standard == "DSARP") {
+    DSARP* dsddr3_dsarp = new DSARP(configs["org"], configs["speed"], DSARP::Type::DSARP, configs.get_subarrays());
+    start_run(configs, dsddr3_dsarp, files);
+  } else if (standard == "ALDRAM") {
+    ALDRAM* aldram = new ALDRAM(configs["org"], configs["speed"]);
+    start_run(configs, aldram, files);
+  } else if (standard == "TLDRAM") {
+    TLDRAM* tldram = new TLDRAM(configs["org"], configs["speed"], configs.get_subarrays());
+    start_run(configs, tldram, files);
+  } else if (standard == "HMC") {
+    HMC* hmc = new HMC(configs["org"], configs["speed"], configs["maxblock"],
+        configs["link_width"], configs["lane_speed"],
+        configs.get_int_value("source_mode_host_links"),
+        configs.get_int_value("payload_flits"));
+    start_run(configs, hmc, files);
+  }
+}
+
+// Runs the traces on every configuration of a sweep file. Each line of the
+// file is a stats file followed by name=value overrides of the configuration
+// file (e.g. "ddr4_2ch.stats channels=2 org=DDR4_8Gb_x8"); '#' starts a
+// comment. The text traces are parsed once, before the configurations are
+// simulated in jobs forked processes at a time: the statistics of Ramulator
+// are global to a process, and the forked processes share the parsed traces
+// (see Trace::preload). The output of a run goes to its stats file + ".log".
+static int run_sweep(const Config& base, const string& sweep_fname, const vector<string>& files, int jobs) {
+  ifstream sweep_file(sweep_fname);
+  if (!sweep_file.good()) {
+    cout << "Bad sweep file: " << sweep_fname << endl;
+    return 1;
+  }
+  vector<pair<string, vector<pair<string, string>>>> runs;
+  string line;
+  while (getline(sweep_file, line)) {
+    line = line.substr(0, line.find('#'));
+    istringstream tokens(line);
+    string stats_out, option;
+    if (!(tokens >> stats_out))
+      continue;
+    vector<pair<string, string>> overrides;
+    while (tokens >> option) {
+      size_t eq = option.find('=');
+      if (eq == string::npos) {
+        cout << "Bad option in sweep file (expected name=value): " << option << endl;
+        return 1;
+      }
+      overrides.emplace_back(option.substr(0, eq), option.substr(eq + 1));
+    }
+    runs.emplace_back(stats_out, overrides);
+  }
+
+  // parse the traces once, as they are opened by the runs
+  bool loaded = true;
+  if (base["trace_type"] == "DRAM") {
+    loaded = Trace::preload(files[0], Config::Format::DRAM);
+  } else if (base.get_split_trace()) {
+    for (int i = 0; i < base.get_core_num(); i++)
+      loaded = loaded && Trace::preload(files[0] + "." + to_string(i), Config::Format::ZSIM);
+  } else {
+    loaded = Trace::preload(files[0], base.get_trace_format());
+  }
+  if (!loaded) {
+    return 1;
+  }
+
+  int running = 0, failed = 0;
+  auto wait_run = [&]() {
+    int status;
+    if (wait(&status) > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+      failed++;
+    running--;
+  };
+  for (auto& run : runs) {
+    if (running == jobs)
+      wait_run();
+    cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      failed++;
+      continue;
+    }
+    if (pid == 0) {
+      Config configs = base;
+      for (auto& option : run.second)
+        configs.set(option.first, option.second);
+      if (!freopen((run.first + ".log").c_str(), "w", stdout)) {
+        perror(run.first.c_str());
+        _exit(1);
+      }
+      Stats::statlist.output(run.first);
+      run_standard(configs, files);
+      cout.flush();
+      _exit(0);
+    }
+    cout << "Running " << run.first << endl;
+    running++;
+  }
+  while (running)
+    wait_run();
+
+  cout << "Sweep done: " << runs.size() - failed << " of " << runs.size() << " configurations simulated." << endl;
+  return failed ? 1 : 0;
+}
+
 int main(int argc, const char *argv[])
 {
     po::options_description desc;
@@ -253,9 +605,27 @@ int main(int argc, const char *argv[])
       ("unlimit-bandwidth", po::value<string>(), "ideal DRAM with unlimited bandwidth")
       ("core-org", po::value<string>(), "core organization")
       ("number-cores", po::value<string>(), "number of pim cores")
-      ("trace-format", po::value<string>(), "trace format is either pin, pisa, or zsim")
+      ("trace-format", po::value<string>(), "trace format is either pin, pisa, zsim, or binary")
       ("split-trace", po::value<string>(), "split trace or merge trace")
       ("disable-perf-scheduling", po::value<string>(), "disable perfect scheduling")
+      ("fast-forward", po::value<string>(), "skip cycles in which neither the cores nor the memory can make progress (on/off, default off)")
+      ("controller-threads", po::value<string>(), "number of threads that tick the DRAM channels or HMC vaults (default 1)")
+      ("sweep", po::value<string>(), "file of configurations to run on the trace(s), one per line: <stats file> [name=value ...]")
+      ("sweep-jobs", po::value<string>(), "number of configurations of --sweep simulated at once (default: number of CPUs)")
+      ("checkpoint", po::value<string>(), "file the warmed-up state is written to, at --checkpoint-insts or --checkpoint-cycles (cpu mode)")
+      ("checkpoint-insts", po::value<string>(), "take the checkpoint after this many instructions of all cores")
+      ("checkpoint-cycles", po::value<string>(), "take the checkpoint after this many processor cycles")
+      ("restore", po::value<string>(), "checkpoint to start the simulation from (cpu mode)")
+      ("stats-series", po::value<string>(), "binary file the selected statistics are written to every --stats-epoch memory cycles")
+      ("stats-epoch", po::value<string>(), "memory cycles per row of --stats-series (default 100000)")
+      ("stats-series-select", po::value<string>(), "comma-separated statistics for --stats-series, name* selects a prefix (default: traffic, row hits, queues and instructions)")
+      ("sample-insts", po::value<string>(), "sample the trace: measure this many instructions of all cores in detail every --sample-period (cpu mode)")
+      ("sample-warmup", po::value<string>(), "instructions simulated in detail, but not measured, before each sample (default 0)")
+      ("sample-period", po::value<string>(), "instructions from the start of one sample to the next, the rest is only functionally warmed")
+      ("pim-trace", po::value<string>(), "trace of PIM cores that run together with the host cores of --trace (HMC, cpu mode)")
+      ("pim-cores", po::value<string>(), "number of PIM cores of --pim-trace")
+      ("pim-config", po::value<string>(), "config file whose parameters replace those of --config for the PIM cores (e.g. caches)")
+      ("pim-core-org", po::value<string>(), "core organization of the PIM cores (default that of --core-org)")
        ;
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -307,9 +677,55 @@ int main(int argc, const char *argv[])
     if (vm.count("disable-perf-scheduling")) {
         configs.set_disable_per_scheduling(true);
     }
+    if (vm.count("fast-forward")) {
+      configs.set("fast_forward", vm["fast-forward"].as<string>());
+    }
+    if (vm.count("controller-threads")) {
+      configs.set("controller_threads", vm["controller-threads"].as<string>());
+    }
     if (vm.count("split-trace")){
         configs.set_split_trace(true);
     }
+    if (vm.count("checkpoint")) {
+      configs.set("checkpoint", vm["checkpoint"].as<string>());
+    }
+    if (vm.count("checkpoint-insts")) {
+      configs.set("checkpoint_insts", vm["checkpoint-insts"].as<string>());
+    }
+    if (vm.count("checkpoint-cycles")) {
+      configs.set("checkpoint_cycles", vm["checkpoint-cycles"].as<string>());
+    }
+    if (vm.count("restore")) {
+      configs.set("restore", vm["restore"].as<string>());
+    }
+    if (vm.count("stats-series")) {
+      configs.set("stats_series", vm["stats-series"].as<string>());
+    }
+    if (vm.count("stats-epoch")) {
+      configs.set("stats_epoch", vm["stats-epoch"].as<string>());
+    }
+    if (vm.count("stats-series-select")) {
+      configs.set("stats_series_select", vm["stats-series-select"].as<string>());
+    }
+    if (vm.count("sample-insts")) {
+      configs.set("sample_insts", vm["sample-insts"].as<string>());
+    }
+    if (vm.count("sample-warmup")) {
+      configs.set("sample_warmup_insts", vm["sample-warmup"].as<string>());
+    }
+    if (vm.count("sample-period")) {
+      configs.set("sample_period_insts", vm["sample-period"].as<string>());
+    }
+    if (vm.count("pim-trace")) {
+      configs.set("pim_trace", vm["pim-trace"].as<string>());
+      configs.set("pim_cores", vm.count("pim-cores") ? vm["pim-cores"].as<string>() : "1");
+    }
+    if (vm.count("pim-config")) {
+      configs.set("pim_config", vm["pim-config"].as<string>());
+    }
+    if (vm.count("pim-core-org")) {
+      configs.set("pim_core_org", vm["pim-core-org"].as<string>());
+    }
 
 
     const std::string& standard = configs["standard"];
@@ -329,6 +745,47 @@ int main(int argc, const char *argv[])
       cout << "mode is required. (missing --mode [cpu|dram])" << endl;
     }
 
+    if ((configs["checkpoint"] != "" || configs["restore"] != "") && configs["trace_type"] != "CPU") {
+      cout << "checkpoints are only supported in cpu mode" << endl;
+      return 1;
+    }
+    if (configs["checkpoint"] != "" && configs["checkpoint_insts"] == "" && configs["checkpoint_cycles"] == "") {
+      cout << "--checkpoint needs --checkpoint-insts or --checkpoint-cycles" << endl;
+      return 1;
+    }
+    if (configs["sample_insts"] != "") {
+      long sample = atol(configs["sample_insts"].c_str());
+      long warmup = atol(configs["sample_warmup_insts"].c_str());
+      long period = atol(configs["sample_period_insts"].c_str());
+      if (configs["trace_type"] != "CPU") {
+        cout << "sampling is only supported in cpu mode" << endl;
+        return 1;
+      }
+      if (sample <= 0 || warmup < 0 || period < sample + warmup) {
+        cout << "--sample-insts needs --sample-period of at least --sample-insts plus --sample-warmup" << endl;
+        return 1;
+      }
+      if (configs["checkpoint"] != "" || configs.get_expected_limit_insts() > 0) {
+        cout << "sampling cannot be combined with --checkpoint or --expected-limit-insts" << endl;
+        return 1;
+      }
+    }
+
+    if (configs["pim_trace"] != "") {
+      if (standard != "HMC" || configs["trace_type"] != "CPU" || configs.pim_mode_enabled()) {
+        cout << "--pim-trace needs an HMC in cpu mode with pim_mode = 0 (host cores)" << endl;
+        return 1;
+      }
+      if (configs.get_pim_core_num() <= 0) {
+        cout << "--pim-cores must be positive" << endl;
+        return 1;
+      }
+      if (configs["checkpoint"] != "" || configs["restore"] != "" || configs["sample_insts"] != "") {
+        cout << "--pim-trace cannot be combined with checkpoints or sampling" << endl;
+        return 1;
+      }
+    }
+
     const string& trace_format = vm["trace-format"].as<string>();
     configs.set_trace_format(trace_format);
 
@@ -338,7 +795,6 @@ int main(int argc, const char *argv[])
     } else {
       stats_out = standard + string(".stats");
     }
-    Stats::statlist.output(stats_out);
 
 
     std::vector<string> files;
@@ -356,63 +812,17 @@ int main(int argc, const char *argv[])
   configs.set_org(core_org);
     
 
-    if (configs["unlimit_bandwidth"] == "true") {
-      configs.set("speed", configs["speed"] + "_unlimit_bandwidth");
-    }
-
-    if (standard == "DDR3") {
-      DDR3* ddr3 = new DDR3(configs["org"], configs["speed"]);
-      start_run(configs, ddr3, files);
-    } else if (standard == "DDR4") {
-      DDR4* ddr4 = new DDR4(configs["org"], configs["speed"]);
-      start_run(configs, ddr4, files);
-    } else if (standard == "SALP-MASA") {
-      SALP* salp8 = new SALP(configs["org"], configs["speed"], "SALP-MASA", configs.get_subarrays());
-      start_run(configs, salp8, files);
-    } else if (standard == "LPDDR3") {
-      LPDDR3* lpddr3 = new LPDDR3(configs["org"], configs["speed"]);
-      start_run(configs, lpddr3, files);
-    } else if (standard == "LPDDR4") {
-      // total cap: 2GB, 1/2 of others
-      LPDDR4* lpddr4 = new LPDDR4(configs["org"], configs["speed"]);
-      start_run(configs, lpddr4, files);
-    } else if (standard == "GDDR5") {
-      GDDR5* gddr5 = new GDDR5(configs["org"], configs["speed"]);
-      start_run(configs, gddr5, files);
-    } else if (standard == "HBM") {
-      HBM* hbm = new HBM(configs["org"], configs["speed"]);
-      start_run(configs, hbm, files);
-    } else if (standard == "WideIO") {
-      // total cap: 1GB, 1/4 of others
-      WideIO* wio = new WideIO(configs["org"], configs["speed"]);
-      start_run(configs, wio, files);
-    } else if (standard == "WideIO2") {
-      // total cap: 2GB, 1/2 of others
-      WideIO2* wio2 = new WideIO2(configs["org"], configs["speed"], configs.get_channels());
-      if (configs.contains("extend_channel_width") &&
-          configs["extend_channel_width"] == "true") {
-        wio2->channel_width *= 2;
+    if (vm.count("sweep")) {
+      int jobs = thread::hardware_concurrency();
+      if (vm.count("sweep-jobs")) {
+        jobs = atoi(vm["sweep-jobs"].as<string>().c_str());
       }
-      start_run(configs, wio2, files);
-    }
-    // Various refresh mechanisms
-      else if (standard == "DSARP") {
-      DSARP* dsddr3_dsarp = new DSARP(configs["org"], configs["speed"], DSARP::Type::DSARP, configs.get_subarrays());
-      start_run(configs, dsddr3_dsarp, files);
-    } else if (standard == "ALDRAM") {
-      ALDRAM* aldram = new ALDRAM(configs["org"], configs["speed"]);
-      start_run(configs, aldram, files);
-    } else if (standard == "TLDRAM") {
-      TLDRAM* tldram = new TLDRAM(configs["org"], configs["speed"], configs.get_subarrays());
-      start_run(configs, tldram, files);
-    } else if (standard == "HMC") {
-      HMC* hmc = new HMC(configs["org"], configs["speed"], configs["maxblock"],
-          configs["link_width"], configs["lane_speed"],
-          configs.get_int_value("source_mode_host_links"),
-          configs.get_int_value("payload_flits"));
-      start_run(configs, hmc, files);
+      return run_sweep(configs, vm["sweep"].as<string>(), files, max(jobs, 1));
     }
 
+    Stats::statlist.output(stats_out);
+    run_standard(configs, files);
+
     cout << "Simulation done. Statistics written to " << stats_out << endl ;
 
     return 0;
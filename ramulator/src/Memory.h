@@ -1,6 +1,8 @@
 #ifndef __MEMORY_H
 #define __MEMORY_H
 
+#include "AddrMapping.h"
+#include "Checkpoint.h"
 #include "Config.h"
 #include "DRAM.h"
 #include "Request.h"
@@ -8,6 +10,8 @@
 #include "HMC_Controller.h"
 #include "SpeedyController.h"
 #include "Statistics.h"
+#include "TickPool.h"
+#include "TimeSeries.h"
 #include "GDDR5.h"
 #include "HBM.h"
 #include "HMC.h"
@@ -19,7 +23,10 @@
 #include <functional>
 #include <cmath>
 #include <cassert>
+#include <climits>
+#include <memory>
 #include <tuple>
+#include <type_traits>
 
 using namespace std;
 
@@ -37,6 +44,82 @@ public:
     virtual void finish(void) = 0;
     virtual long page_allocator(long addr, int coreid) = 0;
     virtual void record_core(int coreid) = 0;
+    // true once no request is left anywhere in the memory
+    virtual bool is_drained() = 0;
+    // saves or restores the page table and the DRAM state of a drained memory
+    virtual void checkpoint(Checkpoint& ckpt) = 0;
+    // functional access for sampling: updates the open rows, without timing
+    virtual void warm(Request req) = 0;
+    // memory cycles simulated and bytes transferred so far
+    virtual void get_totals(long& cycles, double& bytes) = 0;
+};
+
+// Private copy of the statistics a controller shares with the others. A
+// controller ticked by a worker thread counts into its batch, and detach()
+// adds the batch to the shared statistics before they are read. The counts
+// are integers, so the totals do not depend on the order of the additions.
+template <class Ctrl>
+class ControllerStatBatch
+{
+public:
+    typedef ScalarStat* Ctrl::*ScalarMember;
+    typedef VectorStat* Ctrl::*VectorMember;
+
+private:
+    vector<ScalarMember> scalar_members;
+    vector<VectorMember> vector_members;
+    Ctrl* ctrl;
+    vector<ScalarStat*> shared_scalars;
+    vector<VectorStat*> shared_vectors;
+    vector<unique_ptr<ScalarStat>> scalars;
+    vector<unique_ptr<VectorStat>> vectors;
+
+public:
+    ControllerStatBatch(Ctrl* ctrl, vector<ScalarMember> scalar_members,
+                        vector<VectorMember> vector_members)
+        : scalar_members(scalar_members), vector_members(vector_members), ctrl(ctrl)
+    {
+        for (auto member : scalar_members) {
+            shared_scalars.push_back(ctrl->*member);
+            scalars.emplace_back(new ScalarStat());
+            scalars.back()->flags(0);
+            *scalars.back() = 0;
+        }
+        for (auto member : vector_members) {
+            shared_vectors.push_back(ctrl->*member);
+            vectors.emplace_back(new VectorStat());
+            vectors.back()->init(shared_vectors.back()->size());
+            vectors.back()->flags(0);
+        }
+        attach();
+    }
+
+    // points the controller to the batch
+    void attach()
+    {
+        for (unsigned int i = 0; i < scalars.size(); i++)
+            ctrl->*scalar_members[i] = scalars[i].get();
+        for (unsigned int i = 0; i < vectors.size(); i++)
+            ctrl->*vector_members[i] = vectors[i].get();
+    }
+
+    // adds the batch to the shared statistics and points the controller
+    // back to them, e.g. for Controller::record_core()
+    void detach()
+    {
+        for (unsigned int i = 0; i < scalars.size(); i++) {
+            (*shared_scalars[i]) += scalars[i]->value();
+            (*scalars[i]) = 0;
+            ctrl->*scalar_members[i] = shared_scalars[i];
+        }
+        for (unsigned int i = 0; i < vectors.size(); i++) {
+            for (unsigned int j = 0; j < vectors[i]->size(); j++) {
+                (*shared_vectors[i])[j] += (*vectors[i])[j].value();
+                (*vectors[i])[j] = 0;
+            }
+            ctrl->*vector_members[i] = shared_vectors[i];
+        }
+    }
 };
 
 template <class T, template<typename> class Controller = Controller >
@@ -90,6 +173,10 @@ protected:
   ScalarStat write_req_queue_length_avg;
   ScalarStat write_req_queue_length_sum;
 
+  ScalarStat write_coalesced;
+  ScalarStat read_write_turnarounds;
+  ScalarStat write_mode_cycles;
+
 #ifndef INTEGRATED_WITH_GEM5
   VectorStat record_read_hits;
   VectorStat record_read_misses;
@@ -107,6 +194,10 @@ public:
         MAX,
     } type = Type::RoBaRaCoCh;
 
+    std::map<std::string, Type> name_to_type = {
+      {"ChRaBaRoCo", Type::ChRaBaRoCo},
+      {"RoBaRaCoCh", Type::RoBaRaCoCh}};
+
     enum class Translation {
       None,
       Random,
@@ -125,6 +216,13 @@ public:
     vector<Controller<T>*> ctrls;
     T * spec;
     vector<int> addr_bits;
+    unique_ptr<AddrMapping> mapping;
+
+    // ticks the controllers on controller_threads threads, see tick()
+    unique_ptr<TickPool> tick_pool;
+    // --stats-series, see tick()
+    unique_ptr<TimeSeries> series;
+    vector<unique_ptr<ControllerStatBatch<Controller<T>>>> stat_batches;
 
     int tx_bits;
     int cacheline_size;
@@ -144,11 +242,6 @@ public:
         int tx = (spec->prefetch_size * spec->channel_width / 8);
         tx_bits = calc_log2(tx);
         assert((1<<tx_bits) == tx);
-        // If hi address bits will not be assigned to Rows
-        // then the chips must not be LPDDRx 6Gb, 12Gb etc.
-        if (type != Type::RoBaRaCoCh && spec->standard_name.substr(0, 5) == "LPDDR")
-            assert((sz[int(T::Level::Row)] & (sz[int(T::Level::Row)] - 1)) == 0);
-
         max_address = spec->channel_width / 8;
 
         for (unsigned int lev = 0; lev < addr_bits.size(); lev++) {
@@ -158,6 +251,20 @@ public:
 
         addr_bits[int(T::Level::MAX) - 1] -= calc_log2(spec->prefetch_size);
 
+        // Initiating addressing
+        string layout = configs["address_mapping"];
+        if (layout == "" || name_to_type.count(layout)) {
+          if (layout != "")
+            type = name_to_type[layout];
+          layout = preset_mapping();
+        }
+        mapping.reset(new AddrMapping(vector<string>(spec->level_name, spec->level_name + addr_bits.size()),
+            addr_bits, tx_bits, layout, configs["address_hash"], configs["address_xor"]));
+        // If hi address bits will not be assigned to Rows
+        // then the chips must not be LPDDRx 6Gb, 12Gb etc.
+        if (mapping->highest() != int(T::Level::Row) && spec->standard_name.substr(0, 5) == "LPDDR")
+            assert((sz[int(T::Level::Row)] & (sz[int(T::Level::Row)] - 1)) == 0);
+
         // Initiating translation
         if (configs.contains("translation")) {
           translation = name_to_translation[configs["translation"]];
@@ -390,6 +497,22 @@ public:
             .desc("Write queue length average per memory cycle.")
             .precision(6)
             ;
+
+        write_coalesced
+            .name("write_coalesced")
+            .desc("Writes merged into a queued write to the same address.")
+            .precision(0)
+            ;
+        read_write_turnarounds
+            .name("read_write_turnarounds")
+            .desc("Reads served after a write and writes served after a read.")
+            .precision(0)
+            ;
+        write_mode_cycles
+            .name("write_mode_cycles")
+            .desc("Memory cycles in write mode with writes queued, over all channels.")
+            .precision(0)
+            ;
 #ifndef INTEGRATED_WITH_GEM5
         record_read_hits
             .init(configs.get_core_num())
@@ -448,6 +571,9 @@ public:
           ctrl->req_queue_length_sum = &req_queue_length_sum;
           ctrl->read_req_queue_length_sum = &read_req_queue_length_sum;
           ctrl->write_req_queue_length_sum = &write_req_queue_length_sum;
+          ctrl->write_coalesced = &write_coalesced;
+          ctrl->read_write_turnarounds = &read_write_turnarounds;
+          ctrl->write_mode_cycles = &write_mode_cycles;
 
           ctrl->record_read_hits = &record_read_hits;
           ctrl->record_read_misses = &record_read_misses;
@@ -456,10 +582,66 @@ public:
           ctrl->record_write_misses = &record_write_misses;
           ctrl->record_write_conflicts = &record_write_conflicts;
         }
+
+        if (configs.contains("controller_threads"))
+            start_controller_threads(configs.get_int_value("controller_threads"));
+
+        if (configs["stats_series"] != "") {
+            series.reset(new TimeSeries(configs));
+            series->before_dump = [this]() { flush_stat_batches(); };
+        }
+    }
+
+    // Controllers share no state while they tick, except for the statistics
+    // above (given to each controller as a ControllerStatBatch) and the
+    // callbacks of completed reads (deferred to the end of the tick). ALDRAM
+    // changes its shared timing table on refresh, and the command trace printed
+    // to stdout would interleave, so these stay on one thread. DRAMPower is fed
+    // through a ring per controller, which is written only by the thread that
+    // ticks it.
+    void start_controller_threads(int threads)
+    {
+        threads = min(threads, int(ctrls.size()));
+        if (threads <= 1 || is_same<T, ALDRAM>::value)
+            return;
+        for (auto ctrl : ctrls)
+            if (ctrl->print_cmd_trace)
+                return;
+
+        for (auto ctrl : ctrls) {
+            ctrl->defer_callbacks = true;
+            stat_batches.emplace_back(new ControllerStatBatch<Controller<T>>(ctrl, {
+                &Controller<T>::read_transaction_bytes, &Controller<T>::write_transaction_bytes,
+                &Controller<T>::row_hits, &Controller<T>::row_misses, &Controller<T>::row_conflicts,
+                &Controller<T>::read_latency_sum, &Controller<T>::queueing_latency_sum,
+                &Controller<T>::req_queue_length_sum, &Controller<T>::read_req_queue_length_sum,
+                &Controller<T>::write_req_queue_length_sum, &Controller<T>::write_coalesced,
+                &Controller<T>::read_write_turnarounds, &Controller<T>::write_mode_cycles,
+            }, {
+                &Controller<T>::read_row_hits, &Controller<T>::read_row_misses,
+                &Controller<T>::read_row_conflicts, &Controller<T>::write_row_hits,
+                &Controller<T>::write_row_misses, &Controller<T>::write_row_conflicts,
+            }));
+        }
+        tick_pool.reset(new TickPool(threads, [this, threads](int shard) {
+            int begin = shard * ctrls.size() / threads;
+            int end = (shard + 1) * ctrls.size() / threads;
+            for (int i = begin; i < end; i++)
+                ctrls[i]->tick();
+        }));
+    }
+
+    void flush_stat_batches()
+    {
+        for (auto& batch : stat_batches) {
+            batch->detach();
+            batch->attach();
+        }
     }
 
     ~Memory()
     {
+        tick_pool.reset();
         for (auto ctrl: ctrls)
             delete ctrl;
         delete spec;
@@ -475,8 +657,10 @@ public:
       record_read_requests[coreid] = num_read_requests[coreid];
       record_write_requests[coreid] = num_write_requests[coreid];
 #endif
-      for (auto ctrl : ctrls) {
-        ctrl->record_core(coreid);
+      for (unsigned int i = 0; i < ctrls.size(); i++) {
+        if (tick_pool) stat_batches[i]->detach();
+        ctrls[i]->record_core(coreid);
+        if (tick_pool) stat_batches[i]->attach();
       }
     }
 
@@ -484,40 +668,98 @@ public:
     {
         ++num_dram_cycles;
 
+        bool is_active = false;
+        if (tick_pool) {
+          // callbacks run after all controllers ticked and in controller
+          // order, as if the controllers had ticked one after another
+          for (auto ctrl : ctrls)
+            is_active = is_active || ctrl->is_active();
+          tick_pool->run();
+          for (auto ctrl : ctrls)
+            ctrl->deliver_callbacks();
+        } else {
+          for (auto ctrl : ctrls) {
+            is_active = is_active || ctrl->is_active();
+            ctrl->tick();
+          }
+        }
+        if (is_active) {
+          ramulator_active_cycles++;
+        }
+        if (series) {
+          series->tick();
+        }
+    }
+
+    // Number of upcoming ticks up to and including the first one in which
+    // some controller may make progress; the ticks before it only advance
+    // the clocks and can be replaced by skip()
+    long ticks_to_next_event()
+    {
+        long ticks = LONG_MAX;
+        for (auto ctrl : ctrls)
+            ticks = min(ticks, ctrl->get_next_event() - ctrl->clk);
+        // a row of the time series holds the counts of the cores up to its
+        // tick, which the cores may change in skipped ticks
+        if (series)
+            ticks = min(ticks, series->ticks_to_dump());
+        return ticks;
+    }
+
+    void skip(long cycles)
+    {
+        num_dram_cycles += cycles;
+
         bool is_active = false;
         for (auto ctrl : ctrls) {
           is_active = is_active || ctrl->is_active();
-          ctrl->tick();
+          ctrl->skip(cycles);
         }
         if (is_active) {
-          ramulator_active_cycles++;
+          ramulator_active_cycles += cycles;
+        }
+        if (series) {
+          series->skip(cycles);
         }
     }
 
-    bool send(Request req)
+    // Decodes the address of req into its address vector
+    void map_address(Request& req)
     {
         req.addr_vec.resize(addr_bits.size());
         req.burst_count = cacheline_size / (1 << tx_bits);
         long addr = req.addr;
-        int coreid = req.coreid;
 
         // Each transaction size is 2^tx_bits, so first clear the lowest tx_bits bits
         clear_lower_bits(addr, tx_bits);
 
+        mapping->decode(addr, req.addr_vec.data());
+    }
+
+    // The address_mapping of type: the levels from the most significant bits
+    string preset_mapping()
+    {
+        string layout;
         switch(int(type)){
             case int(Type::ChRaBaRoCo):
-                for (int i = addr_bits.size() - 1; i >= 0; i--)
-                    req.addr_vec[i] = slice_lower_bits(addr, addr_bits[i]);
+                for (int i = 0; i < int(T::Level::MAX); i++)
+                    layout += spec->level_name[i];
                 break;
             case int(Type::RoBaRaCoCh):
-                req.addr_vec[0] = slice_lower_bits(addr, addr_bits[0]);
-                req.addr_vec[addr_bits.size() - 1] = slice_lower_bits(addr, addr_bits[addr_bits.size() - 1]);
-                for (int i = 1; i <= int(T::Level::Row); i++)
-                    req.addr_vec[i] = slice_lower_bits(addr, addr_bits[i]);
+                for (int i = int(T::Level::Row); i >= 1; i--)
+                    layout += spec->level_name[i];
+                layout += spec->level_name[int(T::Level::Column)] + spec->level_name[0];
                 break;
             default:
                 assert(false);
         }
+        return layout;
+    }
+
+    bool send(Request req)
+    {
+        map_address(req);
+        int coreid = req.coreid;
 
         if(ctrls[req.addr_vec[0]]->enqueue(req)) {
             // tally stats here to avoid double counting for requests that aren't enqueued
@@ -536,6 +778,19 @@ public:
         return false;
     }
 
+    void warm(Request req)
+    {
+        map_address(req);
+        ctrls[req.addr_vec[0]]->warm(req);
+    }
+
+    void get_totals(long& cycles, double& bytes)
+    {
+        flush_stat_batches();
+        cycles = long(num_dram_cycles.value());
+        bytes = read_transaction_bytes.value() + write_transaction_bytes.value();
+    }
+
     int pending_requests()
     {
         int reqs = 0;
@@ -545,11 +800,30 @@ public:
         return reqs;
     }
 
+    bool is_drained()
+    {
+        return pending_requests() == 0;
+    }
+
+    void checkpoint(Checkpoint& ckpt)
+    {
+        ckpt.section("memory");
+        ckpt.io(free_physical_pages);
+        ckpt.io(free_physical_pages_remaining);
+        ckpt.io(page_translation);
+        for (auto ctrl : ctrls)
+            ctrl->checkpoint(ckpt);
+    }
+
     void finish(void) {
       dram_capacity = max_address;
       int *sz = spec->org_entry.count;
       maximum_bandwidth = spec->speed_entry.rate * 1e6 * spec->channel_width * sz[int(T::Level::Channel)] / 8;
 
+      flush_stat_batches();
+      if (series) {
+        series->finish();
+      }
       long dram_cycles = num_dram_cycles.value();
       long total_read_req = num_read_requests.total();
       for (auto ctrl : ctrls) {
@@ -633,12 +907,6 @@ private:
             n ++;
         return n;
     }
-    int slice_lower_bits(long& addr, int bits)
-    {
-        int lbits = addr & ((1<<bits) - 1);
-        addr >>= bits;
-        return lbits;
-    }
     void clear_lower_bits(long& addr, int bits)
     {
         addr >>= bits;
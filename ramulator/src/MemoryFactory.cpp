@@ -4,6 +4,8 @@
 #include "WideIO2.h"
 #include "HBM.h"
 #include "SALP.h"
+#include "HMC.h"
+#include "HMC_Memory.h"
 
 using namespace ramulator;
 
@@ -76,4 +78,26 @@ MemoryBase *MemoryFactory<SALP>::create(Config& configs, int cacheline) {
     return (MemoryBase *)populate_memory(configs, spec, channels, ranks);
 }
 
+
+template <>
+MemoryBase *MemoryFactory<HMC>::create(Config& configs, int cacheline) {
+    HMC *spec = new HMC(configs["org"], configs["speed"], configs["maxblock"],
+        configs["link_width"], configs["lane_speed"],
+        configs.get_int_value("source_mode_host_links"),
+        configs.get_int_value("payload_flits"));
+
+    configs.set_cacheline_size(cacheline);
+
+    // one controller per vault of every stack
+    int vaults = spec->org_entry.count[int(HMC::Level::Vault)] * configs.get_stacks();
+    vector<Controller<HMC> *> ctrls;
+    for (int c = 0; c < vaults; c++) {
+        DRAM<HMC>* vault = new DRAM<HMC>(spec, HMC::Level::Vault);
+        vault->id = c;
+        vault->regStats("");
+        ctrls.push_back(new Controller<HMC>(configs, vault));
+    }
+    return (MemoryBase *)new Memory<HMC, Controller>(configs, ctrls);
+}
+
 }
@@ -10,6 +10,7 @@
 
 #include "WideIO2.h"
 #include "SALP.h"
+#include "HMC.h"
 
 using namespace std;
 
@@ -81,6 +82,8 @@ template <>
 MemoryBase *MemoryFactory<WideIO2>::create(Config& configs, int cacheline);
 template <>
 MemoryBase *MemoryFactory<SALP>::create(Config& configs, int cacheline);
+template <>
+MemoryBase *MemoryFactory<HMC>::create(Config& configs, int cacheline);
 
 } /*namespace ramulator*/
 
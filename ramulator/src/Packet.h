@@ -6,6 +6,7 @@
 #include <cassert>
 
 #include <map>
+#include <vector>
 
 namespace ramulator
 {
@@ -82,6 +83,9 @@ class Packet {
 
   // keeps orginal req to facilitate further extraction
   Request req;
+  // stack of the host links or the PIM core the request came from, where its
+  // response returns to
+  int src_cub = 0;
 
   Packet() {}
   Packet(Type type, int CUB, long ADRS, int TAG, int LNG, int SLID, Command CMD):
@@ -127,6 +131,50 @@ class Packet {
   }
 };
 
+// The packets in flight in the HMC. A packet takes a slot from its request
+// to its response, which replaces it in the same slot, so the links, the
+// switches and the vaults pass slot numbers instead of copying packets. The
+// requests of the host have the slot of their tag on their link, reserved up
+// front; those of the PIM cores, which have no tags, take the other slots.
+class PacketPool {
+ public:
+  // reserves the slots of the tags of the host links
+  void init(int links, int max_tags) {
+    this->max_tags = max_tags;
+    tagged = links * max_tags;
+    slots.resize(tagged);
+  }
+
+  Packet& operator[](int slot) { return slots[slot]; }
+
+  int tagged_slot(int slid, int tag) { return slid * max_tags + tag; }
+
+  // a slot for a packet without a tag; may move the packets, so no reference
+  // to one is kept across it
+  int alloc() {
+    if (free_slots.empty()) {
+      slots.emplace_back();
+      return slots.size() - 1;
+    }
+    int slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+  }
+
+  // the tagged slots are freed with their tag
+  void release(int slot) {
+    if (slot >= tagged) {
+      free_slots.push_back(slot);
+    }
+  }
+
+ private:
+  std::vector<Packet> slots;
+  std::vector<int> free_slots;
+  int tagged = 0;
+  int max_tags = 0;
+};
+
 extern std::map<int, enum Packet::Command> write_cmd_map;
 
 extern std::map<int, enum Packet::Command> read_cmd_map;
@@ -0,0 +1,192 @@
+#include "Prefetcher.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+using namespace ramulator;
+
+string Prefetcher::type_name[int(Type::MAX)] = {
+    "none", "next_line", "stream", "ampm"
+};
+
+Prefetcher* Prefetcher::create(const Config& configs, const string& prefix,
+    const string& level_string, int block_size, int mshr_entry_num){
+    string name = configs[prefix + "_prefetcher"];
+    if (name == "")
+        return nullptr;
+    int i = 0;
+    while (i < int(Type::MAX) && name != type_name[i])
+        i++;
+    switch (Type(i)) {
+        case Type::None:
+            return nullptr;
+        case Type::NextLine:
+            return new NextLinePrefetcher(configs, prefix, level_string, block_size, mshr_entry_num);
+        case Type::Stream:
+            return new StreamPrefetcher(configs, prefix, level_string, block_size, mshr_entry_num);
+        case Type::AMPM:
+            return new AMPMPrefetcher(configs, prefix, level_string, block_size, mshr_entry_num);
+        default:
+            cerr << "Unknown " << prefix << "_prefetcher: " << name << endl;
+            exit(1);
+    }
+}
+
+Prefetcher::Prefetcher(const Config& configs, const string& prefix,
+    const string& level_string, int block_size, int mshr_entry_num){
+    mshr_reserve = mshr_entry_num / 4;
+    if (configs.contains(prefix + "_prefetch_degree"))
+        degree = configs.get_int_value(prefix + "_prefetch_degree");
+    if (configs.contains(prefix + "_prefetch_distance"))
+        distance = configs.get_int_value(prefix + "_prefetch_distance");
+    if (configs.contains(prefix + "_prefetch_mshr_reserve"))
+        mshr_reserve = configs.get_int_value(prefix + "_prefetch_mshr_reserve");
+    if (degree <= 0 || distance <= 0 || mshr_reserve < 0 || mshr_reserve >= mshr_entry_num) {
+        cerr << prefix << "_prefetch_degree and _distance must be positive, "
+             << "_mshr_reserve less than the " << mshr_entry_num << " MSHR entries" << endl;
+        exit(1);
+    }
+    page_lines = max(4096 / block_size, 1);
+
+    // regStats
+    prefetch_issued.name(level_string + "_prefetch_issued")
+                   .desc("prefetches sent to the lower level")
+                   .precision(0)
+                   ;
+    prefetch_dropped.name(level_string + "_prefetch_dropped")
+                    .desc("prefetches dropped for lack of MSHR entries or lines")
+                    .precision(0)
+                    ;
+    prefetch_useful.name(level_string + "_prefetch_useful")
+                   .desc("demand hits on prefetched lines")
+                   .precision(0)
+                   ;
+    prefetch_late.name(level_string + "_prefetch_late")
+                 .desc("demand misses on prefetches still in flight")
+                 .precision(0)
+                 ;
+    prefetch_demand_misses.name(level_string + "_prefetch_demand_misses")
+                          .desc("demand misses accepted, late prefetches included")
+                          .precision(0)
+                          ;
+    prefetch_accuracy.name(level_string + "_prefetch_accuracy")
+                     .desc("useful and late prefetches per prefetch issued")
+                     .precision(6)
+                     ;
+    prefetch_coverage.name(level_string + "_prefetch_coverage")
+                     .desc("useful prefetches per useful prefetch or demand miss")
+                     .precision(6)
+                     ;
+    prefetch_lateness.name(level_string + "_prefetch_lateness")
+                     .desc("late prefetches per useful or late prefetch")
+                     .precision(6)
+                     ;
+}
+
+void Prefetcher::calc_stats(){
+    double useful = prefetch_useful.value(), late = prefetch_late.value();
+    if (prefetch_issued.value())
+        prefetch_accuracy = (useful + late) / prefetch_issued.value();
+    if (useful + prefetch_demand_misses.value())
+        prefetch_coverage = useful / (useful + prefetch_demand_misses.value());
+    if (useful + late)
+        prefetch_lateness = late / (useful + late);
+}
+
+void NextLinePrefetcher::access(long line, bool miss, bool prefetch_hit, vector<long>& lines){
+    if (!miss && !prefetch_hit)
+        return;
+    for (int i = 0; i < degree; i++)
+        lines.push_back(line + distance + i);
+}
+
+StreamPrefetcher::StreamPrefetcher(const Config& configs, const string& prefix,
+    const string& level_string, int block_size, int mshr_entry_num)
+    : Prefetcher(configs, prefix, level_string, block_size, mshr_entry_num), table(streams){
+}
+
+void StreamPrefetcher::access(long line, bool miss, bool prefetch_hit, vector<long>& lines){
+    long page = line / page_lines;
+    Stream* stream = &table[0];
+    for (auto& s : table) {
+        if (s.page == page) {
+            stream = &s;
+            break;
+        }
+        if (s.last_use < stream->last_use)
+            stream = &s;
+    }
+    clk++;
+    if (stream->page != page) {
+        *stream = Stream();
+        stream->page = page;
+        stream->last_line = line;
+        stream->last_use = clk;
+        return;
+    }
+    stream->last_use = clk;
+
+    long stride = line - stream->last_line;
+    if (stride == 0)
+        return;
+    stream->last_line = line;
+    if (stride != stream->stride) {
+        stream->stride = stride;
+        return;
+    }
+    for (int i = 0; i < degree; i++) {
+        long next = line + stride * (distance + i);
+        if (next < 0 || next / page_lines != page)
+            break;
+        lines.push_back(next);
+    }
+}
+
+AMPMPrefetcher::AMPMPrefetcher(const Config& configs, const string& prefix,
+    const string& level_string, int block_size, int mshr_entry_num)
+    : Prefetcher(configs, prefix, level_string, block_size, mshr_entry_num), table(zones){
+    for (auto& z : table)
+        z.map.assign(page_lines, INIT);
+}
+
+void AMPMPrefetcher::access(long line, bool miss, bool prefetch_hit, vector<long>& lines){
+    long zone = line / page_lines;
+    Zone* z = &table[0];
+    for (auto& entry : table) {
+        if (entry.zone == zone) {
+            z = &entry;
+            break;
+        }
+        if (entry.last_use < z->last_use)
+            z = &entry;
+    }
+    if (z->zone != zone) {
+        z->zone = zone;
+        fill(z->map.begin(), z->map.end(), INIT);
+    }
+    z->last_use = ++clk;
+
+    // Prefetches i + k * distance when i - k and i - 2k were accessed, and
+    // i - k * distance when i + k and i + 2k were, for the smallest strides
+    // k first
+    auto& map = z->map;
+    int i = int(line - zone * page_lines);
+    map[i] = ACCESS;
+    int issued = 0;
+    for (int k = 1; k <= page_lines / 2 && issued < degree; k++) {
+        int ahead = k * distance;
+        if (i + ahead < page_lines && i - 2 * k >= 0 && map[i + ahead] == INIT
+            && map[i - k] == ACCESS && map[i - 2 * k] == ACCESS) {
+            map[i + ahead] = PREFETCH;
+            lines.push_back(line + ahead);
+            issued++;
+        }
+        if (issued < degree && i - ahead >= 0 && i + 2 * k < page_lines && map[i - ahead] == INIT
+            && map[i + k] == ACCESS && map[i + 2 * k] == ACCESS) {
+            map[i - ahead] = PREFETCH;
+            lines.push_back(line - ahead);
+            issued++;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef __PREFETCHER_H
+#define __PREFETCHER_H
+
+#include "Config.h"
+#include "Statistics.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ramulator
+{
+
+// A hardware prefetcher of one cache level, set up in the configuration file
+// with the prefix of the level (l1, l2 or l3):
+//   l1_prefetcher = none|next_line|stream|ampm
+//   l1_prefetch_degree        lines prefetched per trigger (2)
+//   l1_prefetch_distance      lines ahead of the access (1)
+//   l1_prefetch_mshr_reserve  MSHR entries kept free for demand misses
+//                             (a quarter of them)
+//
+// The prefetcher only sees the demand accesses the cache accepts, in line
+// numbers (address / block size), and proposes lines. The cache drops the
+// ones it has or waits for, and all of them while fewer than
+// prefetch_mshr_reserve MSHR entries are free.
+class Prefetcher {
+public:
+    enum class Type {
+        None,
+        NextLine,  // the lines after each miss and each first hit on a prefetched line
+        Stream,    // a constant stride within a 4KB page, seen twice in a row
+        AMPM,      // access map pattern matching over 4KB zones
+        MAX
+    };
+    static std::string type_name[int(Type::MAX)];
+
+    // the prefetcher of the level named by prefix, or nullptr for none
+    static Prefetcher* create(const Config& configs, const std::string& prefix,
+        const std::string& level_string, int block_size, int mshr_entry_num);
+    virtual ~Prefetcher() {}
+
+    // Trains on a demand access to line and appends the lines to prefetch.
+    // prefetch_hit is set for the first demand hit on a prefetched line.
+    virtual void access(long line, bool miss, bool prefetch_hit,
+        std::vector<long>& lines) = 0;
+
+    // computes accuracy, coverage and lateness at the end of the run
+    void calc_stats();
+
+    int degree = 2;
+    int distance = 1;
+    int mshr_reserve;
+
+    ScalarStat prefetch_issued;
+    ScalarStat prefetch_dropped;
+    // demand hits on a prefetched line that had arrived
+    ScalarStat prefetch_useful;
+    // demand misses on a prefetched line still in flight
+    ScalarStat prefetch_late;
+    // demand misses the prefetcher did not cover, late ones included
+    ScalarStat prefetch_demand_misses;
+    ScalarStat prefetch_accuracy;
+    ScalarStat prefetch_coverage;
+    ScalarStat prefetch_lateness;
+
+protected:
+    // lines of a 4KB page or zone
+    int page_lines;
+
+    Prefetcher(const Config& configs, const std::string& prefix,
+        const std::string& level_string, int block_size, int mshr_entry_num);
+};
+
+class NextLinePrefetcher : public Prefetcher {
+public:
+    NextLinePrefetcher(const Config& configs, const std::string& prefix,
+        const std::string& level_string, int block_size, int mshr_entry_num)
+        : Prefetcher(configs, prefix, level_string, block_size, mshr_entry_num) {}
+    void access(long line, bool miss, bool prefetch_hit, std::vector<long>& lines);
+};
+
+class StreamPrefetcher : public Prefetcher {
+public:
+    StreamPrefetcher(const Config& configs, const std::string& prefix,
+        const std::string& level_string, int block_size, int mshr_entry_num);
+    void access(long line, bool miss, bool prefetch_hit, std::vector<long>& lines);
+
+private:
+    static const int streams = 16;
+    struct Stream {
+        long page = -1;
+        long last_line;
+        long stride = 0;
+        long last_use = 0;
+    };
+    std::vector<Stream> table;
+    long clk = 0;
+};
+
+class AMPMPrefetcher : public Prefetcher {
+public:
+    AMPMPrefetcher(const Config& configs, const std::string& prefix,
+        const std::string& level_string, int block_size, int mshr_entry_num);
+    void access(long line, bool miss, bool prefetch_hit, std::vector<long>& lines);
+
+private:
+    static const int zones = 64;
+    enum State : uint8_t {INIT, ACCESS, PREFETCH};
+    struct Zone {
+        long zone = -1;
+        long last_use = 0;
+        std::vector<State> map;
+    };
+    std::vector<Zone> table;
+    long clk = 0;
+};
+
+} /*namespace ramulator*/
+
+#endif /*__PREFETCHER_H*/
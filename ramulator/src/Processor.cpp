@@ -1,5 +1,11 @@
 #include "Processor.h"
 #include <stdexcept>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cassert>
 
@@ -15,9 +21,11 @@ Processor::Processor(const Config& configs,
     no_core_caches(!configs.has_core_caches()),
     no_shared_cache(!configs.has_l3_cache()),
     cachesys(new CacheSystem(configs, send_memory)),
-    llc(l3_size, l3_assoc, l3_blocksz,
+    llc(configs.contains("l3_size") ? configs.get_int_value("l3_size") : l3_size,
+         configs.contains("l3_assoc") ? configs.get_int_value("l3_assoc") : l3_assoc,
+         l3_blocksz,
          mshr_per_bank * trace_list.size(),
-         Cache::Level::L3, cachesys, configs.pim_mode_enabled()), memory(memory){
+         Cache::Level::L3, cachesys, configs), memory(memory){
 
   //set initial parameters
   assert(cachesys != nullptr);
@@ -30,6 +38,8 @@ Processor::Processor(const Config& configs,
   else if (configs.get_trace_format() == Config::Format::ZSIM)
       zsim_trace = true;
   cycle_time = configs.get_cpu_tick()/1000.0;
+  cachesys->warm_memory = std::bind(&MemoryBase::warm, &memory, std::placeholders::_1);
+  shared_llc = !no_shared_cache && cachesys->last_level == Cache::Level::L3;
 
   //create cores
   if (no_shared_cache) {
@@ -69,220 +79,17 @@ Processor::Processor(const Config& configs,
   //bind cores to memory
   ipcs.resize(number_cores);
   for (int i = 0 ; i < number_cores ; ++i) {
-    cores[i]->callback = std::bind(&Processor::receive, this,placeholders::_1);
+    cores[i]->callback = Request::Callback::member<Processor, &Processor::receive>(this);
     ipcs[i] = -1;  
   }
 
-  //if pim_mode and pin trace and single trace
-  if( !pisa_trace && !zsim_trace && !configs.get_split_trace()){
-    long bubble_cnt;
-    long req_addr = -1;
-    Request::Type req_type;
-    bool more_reqs = trace.get_unfiltered_request(bubble_cnt, req_addr, req_type);
-
-    while(more_reqs){
-        MemoryBase *ptr_mem = &memory;
-        Memory<HMC,Controller>* ptr = dynamic_cast<Memory<HMC,Controller>*>(ptr_mem);
-        if(ptr != NULL){
-            long tmp = req_addr;
-            ptr -> clear_higher_bits(tmp, ptr->max_address-1ll);
-            ptr -> clear_lower_bits(tmp, ptr -> tx_bits);
-            int max_block_col_bits =  ptr->spec->maxblock_entry.flit_num_bits - ptr->tx_bits;
-            ptr->slice_lower_bits(tmp, max_block_col_bits);
-            int vault_target = ptr->slice_lower_bits(tmp, ptr->addr_bits[int(HMC::Level::Vault)]);
-
-            Core* core = cores[vault_target % number_cores].get();
-            core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-            core -> rqst_queue.req_addr.push_back(req_addr);
-            core -> rqst_queue.req_type.push_back(req_type);
-            core -> rqst_queue.numberInstructionsInQueue++;
-        }
-        else{
-            cout << "Bad conversion \n";
-        }
-        more_reqs = trace.get_unfiltered_request(bubble_cnt, req_addr, req_type);
-    }
-    for(int i = 0; i < cores.size(); i++){
-          Core* core = cores[i].get();
-          cout << "Core " << i << " got " << core->rqst_queue.numberInstructionsInQueue << endl;
-          if(!core -> rqst_queue.is_empty()){
-              core -> bubble_cnt = core -> rqst_queue.bubble_cnt.front();
-              core -> req_addr = core -> rqst_queue.req_addr.front();
-              core -> req_type = core -> rqst_queue.req_type.front();
-              core -> more_reqs = true;
-              core->rqst_queue.pop_front();
-          }
-          else{
-              core -> more_reqs = false;
-          }
-    }
-    cout << endl;
-  }
-  //if pim mode and pisa trace and single trace
-  else if(pisa_trace && !zsim_trace && !configs.get_split_trace()){
-    long bubble_cnt;
-    long req_addr = -1;
-    unsigned size = 0;
-    Request::Type req_type;
-    long totalReads = 0;
-    long totalWrites = 0;
-    bool more_reqs = trace.get_pisa_request(bubble_cnt, req_addr, req_type, size);
-    (req_type == Request::Type::READ) ? totalReads++ : totalWrites++;
-
-    vector<int> round_robin(32, 0);
-    int number_cores_per_vault = number_cores/32;
-    while(more_reqs){
-        MemoryBase *ptr_mem = &memory;
-        Memory<HMC,Controller>* ptr = dynamic_cast<Memory<HMC,Controller>*>(ptr_mem);
-        if(ptr != NULL){
-            long tmp = req_addr;
-            ptr -> clear_higher_bits(tmp, ptr->max_address-1ll);
-            ptr -> clear_lower_bits(tmp, ptr -> tx_bits);
-            int max_block_col_bits =  ptr->spec->maxblock_entry.flit_num_bits - ptr->tx_bits;
-            ptr->slice_lower_bits(tmp, max_block_col_bits);
-            int vault_target = ptr->slice_lower_bits(tmp, ptr->addr_bits[int(HMC::Level::Vault)]);
-
-            if(number_cores <= 32){
-                Core* core = cores[vault_target % number_cores].get();
-                core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-                core -> rqst_queue.req_addr.push_back(req_addr);
-                core -> rqst_queue.req_type.push_back(req_type);
-                core -> rqst_queue.numberInstructionsInQueue++;
-            }
-            else{
-                int core_to_schedule = 32*round_robin[vault_target] + vault_target;
-                round_robin[vault_target] = (round_robin[vault_target] + 1) % number_cores_per_vault;
-                if(core_to_schedule < number_cores){
-                    Core* core = cores[core_to_schedule].get();
-                    core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-                    core -> rqst_queue.req_addr.push_back(req_addr);
-                    core -> rqst_queue.req_type.push_back(req_type);
-                    core -> rqst_queue.numberInstructionsInQueue++;
-                }
-            }
-        }
-        else{
-            cout << "Bad conversion \n";
-        }
-        more_reqs = trace.get_pisa_request(bubble_cnt, req_addr, req_type,size);
-        (req_type == Request::Type::READ) ? totalReads++ : totalWrites++;
-    }
-    cout << "Total Reads: " << totalReads << " Total Writes: " << totalWrites << endl;
-    for(int i = 0; i < cores.size(); i++){
-          Core* core = cores[i].get();
-          cout << "Core " << i << " got " << core->rqst_queue.numberInstructionsInQueue << endl;
-          if(!core -> rqst_queue.is_empty()){
-              core -> bubble_cnt = core -> rqst_queue.bubble_cnt.front();
-              core -> req_addr = core -> rqst_queue.req_addr.front();
-              core -> req_type = core -> rqst_queue.req_type.front();
-              core -> more_reqs = true;
-              core->rqst_queue.pop_front();
-
-          }
-          else{
-              core -> more_reqs = false;
-          }
-    }
-    cout << endl;
-  }
-  //if pim mode and zsim trace and single trace
-  else if(!pisa_trace && zsim_trace && !configs.get_split_trace()){
-    long bubble_cnt;
-    long req_addr = -1;
-    unsigned cpu_id = 0;
-    Request::Type req_type;
-    long totalReads = 0;
-    long totalWrites = 0;
-    if(configs.get_disable_per_scheduling() == false){
-        cout << "Perfect scheduling enabled \n";
-    }
-    else{
-        cout << "Perfect scheduling disabled \n";
-    }
-    bool more_reqs = trace.get_zsim_request(bubble_cnt, req_addr, req_type, cpu_id);
-    (req_type == Request::Type::READ) ? totalReads++ : totalWrites++;
-    vector<int> round_robin(32, 0);
-    int number_cores_per_vault = number_cores/32;
-    vector<int> offset_counter(256,0);
-    while(more_reqs){
-        if(req_addr != -1){
-            if(configs.get_disable_per_scheduling() == false){
-                MemoryBase *ptr_mem = &memory;
-                Memory<HMC,Controller>* ptr = dynamic_cast<Memory<HMC,Controller>*>(ptr_mem);
-                if(ptr != NULL){
-                    req_addr = ptr->page_allocator(req_addr, 0);
-                    long tmp = req_addr;
-                    ptr -> clear_higher_bits(tmp, ptr->max_address-1ll);
-                    ptr -> clear_lower_bits(tmp, ptr -> tx_bits);
-                    int max_block_col_bits =  ptr->spec->maxblock_entry.flit_num_bits - ptr->tx_bits;
-                    ptr->slice_lower_bits(tmp, max_block_col_bits);
-                    int vault_target = ptr->slice_lower_bits(tmp, ptr->addr_bits[int(HMC::Level::Vault)]);
-
-                    if(number_cores <= 32){
-                        Core* core = cores[vault_target % number_cores].get();
-                        core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-                        core -> rqst_queue.req_addr.push_back(req_addr);
-                        core -> rqst_queue.req_type.push_back(req_type);
-                        core -> rqst_queue.numberInstructionsInQueue++;
-                    }
-                    else{
-                        int core_to_schedule = 32*round_robin[vault_target] + vault_target;
-                        round_robin[vault_target] = (round_robin[vault_target] + 1) % number_cores_per_vault;
-                        if(core_to_schedule < number_cores){
-                            Core* core = cores[core_to_schedule].get();
-                            core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-                            core -> rqst_queue.req_addr.push_back(req_addr);
-                            core -> rqst_queue.req_type.push_back(req_type);
-                            core -> rqst_queue.numberInstructionsInQueue++;
-                        }
-                    }
-                }
-                else{
-                    cout << "Bad conversion \n";
-                }
-            }
-            else{
-                if(number_cores <= 256){
-                    req_addr = memory.page_allocator(req_addr, cpu_id);
-                    Core* core = cores[cpu_id % number_cores].get();
-                    core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-                    core -> rqst_queue.req_addr.push_back(req_addr);
-                    core -> rqst_queue.req_type.push_back(req_type);
-                    core -> rqst_queue.numberInstructionsInQueue++;
-                }
-                else{
-                    int new_cpu_id = cpu_id + offset_counter[cpu_id]*256;
-                    offset_counter[cpu_id]++;
-                    req_addr = memory.page_allocator(req_addr, new_cpu_id);
-                    Core* core = cores[new_cpu_id % number_cores].get();
-                    core -> rqst_queue.bubble_cnt.push_back(bubble_cnt);
-                    core -> rqst_queue.req_addr.push_back(req_addr);
-                    core -> rqst_queue.req_type.push_back(req_type);
-                    core -> rqst_queue.numberInstructionsInQueue++;
-                }
-            }
-        }
-        more_reqs = trace.get_zsim_request(bubble_cnt, req_addr, req_type,cpu_id);
-        (req_type == Request::Type::READ) ? totalReads++ : totalWrites++;
-    }
-
-    cout << "Total Reads: " << totalReads << " Total Writes: " << totalWrites << endl;
-    for(int i = 0; i < cores.size(); i++){
-          Core* core = cores[i].get();
-          cout << "Core " << i << " got " << core->rqst_queue.numberInstructionsInQueue << endl;
-          if(!core -> rqst_queue.is_empty()){
-              core -> bubble_cnt = core -> rqst_queue.bubble_cnt.front();
-              core -> req_addr = core -> rqst_queue.req_addr.front();
-              core -> req_type = core -> rqst_queue.req_type.front();
-              core -> more_reqs = true;
-              core->rqst_queue.pop_front();
-
-          }
-          else{
-              core -> more_reqs = false;
-          }
+  //if single trace, records are read on demand and handed to the cores
+  if(!configs.get_split_trace()){
+    dispatcher.reset(new TraceDispatcher(configs, trace, memory, number_cores));
+    for (int i = 0 ; i < number_cores ; ++i) {
+      cores[i]->dispatcher = dispatcher.get();
+      cores[i]->get_next_request();
     }
-    cout << endl;
   }
 
   //done with configuration, set stats
@@ -343,6 +150,39 @@ void Processor::tick() {
   }
 }
 
+long Processor::ticks_to_next_event() {
+  long ticks = LONG_MAX;
+  for (unsigned int i = 0 ; i < cores.size() ; i++) {
+    long core_ticks = cores[i]->ticks_to_next_event();
+    if (core_ticks == 1 || (core_ticks != LONG_MAX && !skip_bubbles)) {
+      return 1;
+    }
+    ticks = min(ticks, core_ticks);
+  }
+  if (!(no_core_caches && no_shared_cache)) {
+    long next_clk = cachesys->get_next_event();
+    if (next_clk != LONG_MAX) {
+      ticks = min(ticks, next_clk - cachesys->clk);
+    }
+  }
+  return ticks;
+}
+
+void Processor::skip(long cycles) {
+  long first = long(cpu_cycles.value());
+  for (long c = (first / 1000000 + 1) * 1000000 ; c <= first + cycles ; c += 1000000)
+    printf("CPU heartbeat, cycles: %d \n", int(c));
+  cpu_cycles += cycles;
+
+  if (!(no_core_caches && no_shared_cache)) {
+    cachesys->clk += cycles;
+  }
+
+  for (unsigned int i = 0 ; i < cores.size() ; i++) {
+    cores[i]->skip(cycles);
+  }
+}
+
 void Processor::receive(Request& req) {
   if (!no_shared_cache) {
     llc.callback(req);
@@ -355,8 +195,23 @@ void Processor::receive(Request& req) {
     }
   }
 
+    if (req.type == Request::Type::READ && req.arrive != -1) {
+      memory_reads++;
+      memory_read_latency += req.depart - req.arrive;
+    }
+
     Core* core = cores[req.coreid].get();
     core->receive(req);
+
+    // Loads of other cores may have found the line on its way in the shared
+    // L3 (or in a prefetch of it)
+    if (shared_llc) {
+      for (auto& other : cores) {
+        if (other.get() != core) {
+          other->window.set_ready(req.addr);
+        }
+      }
+    }
 }
 
 void Processor::calc_stats(){
@@ -373,6 +228,13 @@ for (unsigned int i = 0 ; i < cores.size(); ++i){
       }
     }
 
+    llc.calc_stats();
+    for (auto& core : cores) {
+      for (auto& cache : core->caches) {
+        cache->calc_stats();
+      }
+    }
+
     ipc = total_instructions/cpu_cycles.value();
     average_idle_cycles = total_idle_cycles.value()/cores.size();
 
@@ -425,6 +287,53 @@ bool Processor::has_reached_limit() {
   return true;
 }
 
+void Processor::drain() {
+  for (unsigned int i = 0 ; i < cores.size() ; ++i) {
+    cores[i]->draining = true;
+  }
+}
+
+bool Processor::is_drained() {
+  for (unsigned int i = 0 ; i < cores.size() ; ++i) {
+    if (!cores[i]->window.is_empty()) {
+      return false;
+    }
+  }
+  return cachesys->is_empty();
+}
+
+void Processor::checkpoint(Checkpoint& ckpt) {
+  ckpt.section("processor");
+  if (dispatcher) {
+    dispatcher->checkpoint(ckpt);
+  }
+  for (unsigned int i = 0 ; i < cores.size() ; ++i) {
+    cores[i]->checkpoint(ckpt);
+  }
+  llc.checkpoint(ckpt);
+}
+
+void Processor::resume() {
+  for (unsigned int i = 0 ; i < cores.size() ; ++i) {
+    cores[i]->draining = false;
+  }
+}
+
+long Processor::warm(long insts) {
+  assert(is_drained());
+  long warmed = 0;
+  bool progress = true;
+  while (warmed < insts && progress) {
+    progress = false;
+    for (unsigned int i = 0 ; i < cores.size() && warmed < insts ; ++i) {
+      if (cores[i]->warm(warmed)) {
+        progress = true;
+      }
+    }
+  }
+  return warmed;
+}
+
 Core::Core(const Config& configs, int coreid, function<bool(Request)> send_next,
     Cache* llc, std::shared_ptr<CacheSystem> cachesys, MemoryBase& memory)
     : id(coreid), no_core_caches(!configs.has_core_caches()),
@@ -433,6 +342,21 @@ Core::Core(const Config& configs, int coreid, function<bool(Request)> send_next,
 
 
   cpu_type = configs.get_cpu_type();
+  expected_limit_insts = configs.get_expected_limit_insts();
+
+  // out-of-order core: the defaults are a 4-wide core with a 128-entry
+  // window, no load/store queue and no limit on the lines in flight
+  int width = configs.contains("core_width") ? configs.get_int_value("core_width") : window.ipc;
+  int rob_size = configs.contains("rob_size") ? configs.get_int_value("rob_size") : window.depth;
+  if (configs.contains("lsq_size"))
+    lsq_size = configs.get_int_value("lsq_size");
+  if (configs.contains("core_mshrs"))
+    core_mshrs = configs.get_int_value("core_mshrs");
+  if (width <= 0 || rob_size <= 0 || lsq_size < 0 || core_mshrs < 0) {
+    cerr << "core_width and rob_size must be positive, lsq_size and core_mshrs not negative" << endl;
+    exit(1);
+  }
+  window.init(width, rob_size, l1_blocksz);
   inFlightMemoryAccess = 0;
 
   if(configs.pim_mode_enabled()){
@@ -441,6 +365,14 @@ Core::Core(const Config& configs, int coreid, function<bool(Request)> send_next,
     l2_blocksz = 1 << 6;
     l2_mshr_num = 16;
   }
+  if (configs.contains("l1_size"))
+    l1_size = configs.get_int_value("l1_size");
+  if (configs.contains("l1_assoc"))
+    l1_assoc = configs.get_int_value("l1_assoc");
+  if (configs.contains("l2_size"))
+    l2_size = configs.get_int_value("l2_size");
+  if (configs.contains("l2_assoc"))
+    l2_assoc = configs.get_int_value("l2_assoc");
 
   if (no_core_caches) {
     send = send_next;
@@ -448,11 +380,11 @@ Core::Core(const Config& configs, int coreid, function<bool(Request)> send_next,
     // L2 caches[0]
     caches.emplace_back(new Cache(
         l2_size, l2_assoc, l2_blocksz, l2_mshr_num,
-        Cache::Level::L2, cachesys,configs.pim_mode_enabled()));
+        Cache::Level::L2, cachesys, configs));
     // L1 caches[1]
     caches.emplace_back(new Cache(
         l1_size, l1_assoc, l1_blocksz, l1_mshr_num,
-        Cache::Level::L1, cachesys,configs.pim_mode_enabled()));
+        Cache::Level::L1, cachesys, configs));
     send = bind(&Cache::send, caches[1].get(), placeholders::_1);
 
     if (llc != nullptr) {
@@ -513,11 +445,49 @@ void Core::load_trace(string trace_base_name){
     trace_per_core.init_trace(trace_base_name+"."+std::to_string(id));
 }
 
+void Core::checkpoint(Checkpoint& ckpt){
+    ckpt.section("core " + to_string(id));
+    assert(window.is_empty());
+    if (split_trace) {
+        trace_per_core.checkpoint(ckpt, Config::Format::ZSIM);
+    }
+    ckpt.io(more_reqs);
+    ckpt.io(bubble_cnt);
+    ckpt.io(req_addr);
+    ckpt.io(req_type);
+    ckpt.io(lock_core);
+    ckpt.io(inFlightMemoryAccess);
+    for (auto& cache : caches) {
+        cache->checkpoint(ckpt);
+    }
+}
+
 void Core::get_first_request(){
     unsigned int cpu_id;
     more_reqs = trace_per_core.get_zsim_request(bubble_cnt, req_addr, req_type,cpu_id);
     req_addr = memory.page_allocator(req_addr, id);
 }
+void Core::get_next_request(){
+    if(dispatcher == nullptr){
+        more_reqs = false;
+        return;
+    }
+    switch(dispatcher->get_request(id, bubble_cnt, req_addr, req_type)){
+        case TraceDispatcher::Status::READY:
+            more_reqs = true;
+            break;
+        case TraceDispatcher::Status::END:
+            more_reqs = false;
+            if (!reached_limit) {
+                record_cycs = clk;
+                record_insts = long(cpu_inst.value());
+                memory.record_core(id);
+                reached_limit = true;
+            }
+            break;
+    }
+}
+
 double Core::calc_ipc()
 {
     printf("[%d]retired: %ld, clk, %ld\n", id, retired, clk);
@@ -527,6 +497,7 @@ double Core::calc_ipc()
 
 void Core::tick_outOrder(){
     retired += window.retire();
+    if (draining) return;
     //if(retired == 0 ) {cout << "Core " << id << " retired 0 instructions \n";}
     if (expected_limit_insts == 0 && !more_reqs){
         return;
@@ -534,29 +505,30 @@ void Core::tick_outOrder(){
 
     if(lock_core){return;}
 
-    // bubbles (non-memory operations)
-    int inserted = 0;
-    while (bubble_cnt > 0) {
-        if (inserted == window.ipc){idle_cycles++; return;}
-        if (window.is_full()){ return;}
-
-        window.insert(true, -1);
-        inserted++;
-        bubble_cnt--;
-        cpu_inst++;
-        non_memory_inst++;
-        if (long(cpu_inst.value()) == expected_limit_insts && !reached_limit) {
+    // bubbles (non-memory operations), inserted together
+    int inserted = min(bubble_cnt, long(min(window.ipc, window.depth - window.load)));
+    if (inserted > 0) {
+        long before = long(cpu_inst.value());
+        window.insert_bubbles(inserted);
+        bubble_cnt -= inserted;
+        cpu_inst += inserted;
+        non_memory_inst += inserted;
+        if (before < expected_limit_insts && before + inserted >= expected_limit_insts && !reached_limit) {
           record_cycs = clk;
-          record_insts = long(cpu_inst.value());
+          record_insts = expected_limit_insts;
           memory.record_core(id);
           reached_limit = true;
         }
     }
+    if (bubble_cnt > 0) {
+        if (inserted == window.ipc) idle_cycles++;
+        return;
+    }
 
     if (req_type == Request::Type::READ) {
         // read request
         if (inserted == window.ipc) {idle_cycles++; return;}
-        if (window.is_full()){ return;}
+        if (window.is_full() || lsq_full() || mshrs_full(req_addr)){ return;}
 
        Request req(req_addr, req_type, callback, id);
        if (!send(req)) return;
@@ -568,9 +540,18 @@ void Core::tick_outOrder(){
     else if(req_type == Request::Type::WRITE){
         // write request
         assert(req_type == Request::Type::WRITE);
+        // with a load/store queue, a store also takes a window entry,
+        // otherwise it bypasses the window
+        if (lsq_size) {
+            if (inserted == window.ipc) {idle_cycles++; return;}
+            if (window.is_full() || lsq_full()){ return;}
+        }
 
         Request req(req_addr, req_type, callback, id);
         if (!send(req)) return;
+        if (lsq_size) {
+            window.insert(true, req_addr);
+        }
         cpu_inst++;
         memory_inst++;
 
@@ -584,24 +565,17 @@ void Core::tick_outOrder(){
         //lock_core = true;
     }
 
-    //get next request
+    advance_trace();
+}
+
+void Core::advance_trace(){
     if(split_trace){
         unsigned int cpu_id;
         more_reqs = trace_per_core.get_zsim_request(bubble_cnt, req_addr, req_type,cpu_id);
         req_addr = memory.page_allocator(req_addr, id);
     }
     else{
-        if(!rqst_queue.is_empty()){
-            more_reqs = true;
-            bubble_cnt = rqst_queue.bubble_cnt.front();
-           // cout << "bubble count: " << bubble_cnt << endl;
-            req_addr = rqst_queue.req_addr.front();
-            req_type = rqst_queue.req_type.front();
-            rqst_queue.pop_front();
-        }
-        else{
-            more_reqs = false;
-        }
+        get_next_request();
     }
 
     if (!more_reqs) {
@@ -614,8 +588,35 @@ void Core::tick_outOrder(){
      }
 }
 
+bool Core::warm(long& insts){
+    if(lock_core){return false;}
+    if(!more_reqs){return false;}
+
+    // instructions are counted as in tick_outOrder(), but not in cpu_inst
+    insts += bubble_cnt;
+    bubble_cnt = 0;
+    if (req_type != Request::Type::INSTRUCTION) {
+        insts++;
+    }
+
+    Request req(req_addr, req_type == Request::Type::WRITE ?
+        Request::Type::WRITE : Request::Type::READ, id);
+    if (!no_core_caches) {
+        caches[1]->warm(req);
+    } else if (llc != nullptr) {
+        llc->warm(req);
+    } else {
+        memory.warm(req);
+    }
+
+    advance_trace();
+    return true;
+}
+
 void Core::tick_inOrder(){
 
+    if (draining) return;
+
     if (expected_limit_insts == 0 && !more_reqs){
         return;
     }
@@ -683,16 +684,7 @@ void Core::tick_inOrder(){
         lock_core = true;
     }
 
-    if(!rqst_queue.is_empty()){
-        more_reqs = true;
-        bubble_cnt = rqst_queue.bubble_cnt.front();
-        req_addr = rqst_queue.req_addr.front();
-        req_type = rqst_queue.req_type.front();
-        rqst_queue.pop_front();
-    }
-    else{
-        more_reqs = false;
-    }
+    get_next_request();
 
 
     if (!more_reqs) {
@@ -718,6 +710,63 @@ void Core::tick()
         cout << "Something is wrong \n";
 }
 
+bool Core::is_idle()
+{
+    if(cpu_type == "inOrder")
+        return (expected_limit_insts == 0 && !more_reqs) || inFlightMemoryAccess >= 1 || draining;
+    if(cpu_type != "outOrder")
+        return false;
+
+    if (window.load > 0 && window.ready_list.at(window.tail))
+        return false;
+    if ((expected_limit_insts == 0 && !more_reqs) || lock_core || draining)
+        return true;
+    if (!more_reqs)
+        return false;
+    // the next instruction needs a free slot in the window, and a memory
+    // access a free load/store queue entry and MSHR
+    if (bubble_cnt > 0)
+        return window.is_full();
+    if (req_type == Request::Type::READ)
+        return window.is_full() || lsq_full() || mshrs_full(req_addr);
+    if (req_type == Request::Type::WRITE && lsq_size)
+        return window.is_full() || lsq_full();
+    return false;
+}
+
+long Core::ticks_to_next_event()
+{
+    if (is_idle())
+        return LONG_MAX;
+    // While all entries of the window are ready and there are more bubbles
+    // before the next access than a tick inserts, every tick retires ipc
+    // entries and inserts ipc bubbles, up to the tick that reaches the
+    // instruction limit.
+    if (cpu_type != "outOrder" || draining || lock_core || !more_reqs
+        || window.pending_lines > 0 || window.load < window.ipc)
+        return 1;
+    long ticks = (bubble_cnt - 1) / window.ipc;
+    long insts = long(cpu_inst.value());
+    if (!reached_limit && insts < expected_limit_insts)
+        ticks = min(ticks, (expected_limit_insts - insts - 1) / window.ipc);
+    return ticks + 1;
+}
+
+void Core::skip(long cycles)
+{
+    clk += cycles;
+    if (is_idle())
+        return;
+    // the bubbles of the ticks counted by ticks_to_next_event()
+    long insts = cycles * window.ipc;
+    window.stream_bubbles(insts);
+    retired += insts;
+    bubble_cnt -= insts;
+    cpu_inst += insts;
+    non_memory_inst += insts;
+    idle_cycles += cycles;
+}
+
 bool Core::finished()
 {
     return !more_reqs; 
@@ -729,7 +778,7 @@ bool Core::has_reached_limit() {
 }
 
 void Core::receive(Request& req){
-    window.set_ready(req.addr, ~(l1_blocksz - 1l));
+    window.set_ready(req.addr);
 
     if (req.arrive != -1 && req.depart > last) {
         memory_access_cycles += (req.depart - max(last, req.arrive));
@@ -737,6 +786,25 @@ void Core::receive(Request& req){
     }
 }
 
+void Window::init(int ipc, int depth, int line_size)
+{
+    this->ipc = ipc;
+    this->depth = depth;
+    ready_list.assign(depth, false);
+    addr_list.assign(depth, -1);
+    load = head = tail = 0;
+    pending_lines = memory_entries = 0;
+
+    line_bits = 0;
+    while ((1 << line_bits) < line_size)
+        line_bits++;
+    int buckets = 1;
+    while (buckets < 2 * depth)
+        buckets <<= 1;
+    waiters.assign(buckets, -1);
+    next_waiter.assign(depth, -1);
+}
+
 bool Window::is_full()
 {
     return load == depth;
@@ -750,16 +818,53 @@ bool Window::is_empty()
 
 void Window::insert(bool ready, long addr)
 {
-    assert(load <= depth);
-
-    ready_list.at(head) = ready;
-    addr_list.at(head) = addr;
+    assert(load < depth);
+
+    ready_list[head] = ready;
+    addr_list[head] = addr;
+    if (addr != -1)
+        memory_entries++;
+    if (!ready) {
+        if (!is_pending(addr))
+            pending_lines++;
+        int b = bucket(addr >> line_bits);
+        next_waiter[head] = waiters[b];
+        waiters[b] = head;
+    }
 
     head = (head + 1) % depth;
     load++;
 }
 
 
+void Window::insert_bubbles(int n)
+{
+    assert(load + n <= depth);
+
+    // at most two ranges of the ring
+    int first = min(n, depth - head);
+    fill(ready_list.begin() + head, ready_list.begin() + head + first, true);
+    fill(addr_list.begin() + head, addr_list.begin() + head + first, -1);
+    fill(ready_list.begin(), ready_list.begin() + (n - first), true);
+    fill(addr_list.begin(), addr_list.begin() + (n - first), -1);
+
+    head = (head + n) % depth;
+    load += n;
+}
+
+
+void Window::stream_bubbles(long n)
+{
+    int old = min(n, long(load));
+    for (int i = 0; i < old; i++) {
+        if (addr_list[tail] != -1)
+            memory_entries--;
+        tail = (tail + 1) % depth;
+    }
+    load -= old;
+    insert_bubbles(old);
+}
+
 long Window::retire()
 {
     assert(load <= depth);
@@ -768,9 +873,11 @@ long Window::retire()
 
     int retired = 0;
     while (load > 0 && retired < ipc) {
-        if (!ready_list.at(tail))
+        if (!ready_list[tail])
             break;
 
+        if (addr_list[tail] != -1)
+            memory_entries--;
         tail = (tail + 1) % depth;
         load--;
         retired++;
@@ -780,19 +887,113 @@ long Window::retire()
 }
 
 
-void Window::set_ready(long addr, int mask)
+void Window::set_ready(long addr)
 {
-    if (load == 0) return;
+    long line = addr >> line_bits;
+    int* link = &waiters[bucket(line)];
+    bool woken = false;
+    while (*link != -1) {
+        int index = *link;
+        if ((addr_list[index] >> line_bits) == line) {
+            ready_list[index] = true;
+            *link = next_waiter[index];
+            woken = true;
+        } else {
+            link = &next_waiter[index];
+        }
+    }
+    if (woken)
+        pending_lines--;
+}
 
-    for (int i = 0; i < load; i++) {
-        int index = (tail + i) % depth;
-        if ((addr_list.at(index) & mask) != (addr & mask))
-            continue;
-        ready_list.at(index) = true;
+
+bool Window::is_pending(long addr)
+{
+    long line = addr >> line_bits;
+    for (int index = waiters[bucket(line)]; index != -1; index = next_waiter[index]) {
+        if ((addr_list[index] >> line_bits) == line)
+            return true;
     }
+    return false;
+}
+
+const char Trace::binary_magic[8] = {'R', 'A', 'M', 'T', 'R', 'A', 'C', 'E'};
+// record types by their code in the tag byte of a binary record
+static const char binary_types[7] = {0, 'L', 'S', 'P', 'I', 'R', 'W'};
+
+namespace {
+
+struct Token {
+    const char* begin;
+    const char* end;
+};
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// splits [p, end) at whitespace; at most max_tokens tokens are stored
+int split_tokens(const char* p, const char* end, Token* tokens, int max_tokens) {
+    int n = 0;
+    while (n < max_tokens) {
+        while (p != end && is_space(*p)) p++;
+        if (p == end) break;
+        tokens[n].begin = p;
+        while (p != end && !is_space(*p)) p++;
+        tokens[n].end = p;
+        n++;
+    }
+    return n;
+}
+
+inline int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 16;
+}
+
+// parses an integer in place the way std::stoul/std::stoi do: leading spaces
+// and sign are skipped, base 0 detects hex/octal prefixes, parsing stops at
+// the first invalid character (returned in next). Returns false if no digit
+// was found or the number does not fit in an unsigned long.
+bool parse_number(const char* p, const char* end, int base, long& value, const char** next = nullptr) {
+    while (p != end && is_space(*p)) p++;
+    bool negative = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+        negative = (*p == '-');
+        p++;
+    }
+    if ((base == 0 || base == 16) && end - p >= 3 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')
+        && digit_value(p[2]) < 16) {
+        p += 2;
+        base = 16;
+    }
+    else if (base == 0) {
+        base = (p != end && *p == '0') ? 8 : 10;
+    }
+    const char* start = p;
+    unsigned long result = 0;
+    while (p != end) {
+        int d = digit_value(*p);
+        if (d >= base) break;
+        if (result > (ULONG_MAX - d) / base) return false;
+        result = result * base + d;
+        p++;
+    }
+    if (p == start) return false;
+    value = negative ? -long(result) : long(result);
+    if (next) *next = p;
+    return true;
+}
+
+inline bool is_token(const Token& token, char c) {
+    return token.end - token.begin == 1 && token.begin[0] == c;
+}
+
 }
 
-Trace::Trace(const string& trace_fname) : file(trace_fname), trace_name(trace_fname){
+Trace::Trace(const string& trace_fname) : trace_name(trace_fname){
 
 #ifndef MAX_NUMBER_CORES
     #define MAX_NUMBER_CORES 256
@@ -800,10 +1001,11 @@ Trace::Trace(const string& trace_fname) : file(trace_fname), trace_name(trace_fn
 
     instructions.resize(MAX_NUMBER_CORES);
     for(int i = 0; i < MAX_NUMBER_CORES; i++) instructions[i] = 0;
-    if (!file.good()) {
+    if (!map(trace_fname)) {
         std::cerr << "Bad trace file: " << trace_fname << std::endl;
         exit(1);
     }
+    detect_binary();
 }
 
 bool Trace::init_trace(const string& trace_fname){
@@ -815,47 +1017,425 @@ bool Trace::init_trace(const string& trace_fname){
     instructions.resize(MAX_NUMBER_CORES);
     for(int i = 0; i < MAX_NUMBER_CORES; i++) instructions[i] = 0;
     trace_name = trace_fname;
-    file.open(trace_name);
 
-    if (!file.good()) {
+    if (!map(trace_name)) {
         std::cerr << "Bad trace file: " << trace_fname << std::endl;
         return false;
     }
+    detect_binary();
     cout << "Trace opended: " << trace_fname << endl;
     return true;
 }
 
+bool Trace::map(const string& trace_fname){
+    unmap();
+    // a preloaded trace is mapped from its binary image, whose descriptor
+    // stays open for the other runs
+    auto image = preloaded().find(trace_fname);
+    bool shared = image != preloaded().end();
+    int fd = shared ? image->second : open(trace_fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        if (!shared) close(fd);
+        return false;
+    }
+    size = st.st_size;
+    if (size > 0) {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            if (!shared) close(fd);
+            size = 0;
+            return false;
+        }
+        // the trace is read front to back
+        madvise(addr, size, MADV_SEQUENTIAL);
+        data = (const char*) addr;
+        mapped = true;
+    }
+    if (!shared) close(fd);
+    pos = data;
+    limit = data + size;
+
+    TraceStream::Codec codec = TraceStream::detect(data, size);
+    if (codec != TraceStream::Codec::NONE) {
+        cout << "Decompressing " << TraceStream::codec_name(codec) << " trace: " << trace_fname << endl;
+        stream.reset(new TraceStream(data, size, codec));
+        pos = limit = nullptr;
+        refill();
+    }
+    return true;
+}
+
+void Trace::unmap(){
+    // the stream reads from the mapping
+    stream.reset();
+    if (mapped) {
+        munmap((void*) data, size);
+    }
+    data = pos = limit = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+std::map<std::string, int>& Trace::preloaded(){
+    static std::map<std::string, int> traces;
+    return traces;
+}
+
+bool Trace::preload(const string& trace_fname, Config::Format format){
+    if (preloaded().count(trace_fname)) {
+        return true;
+    }
+    Trace trace;
+    // read the whole trace once, do not start over at its end
+    trace.pim_mode_enabled = true;
+    if (!trace.init_trace(trace_fname)) {
+        return false;
+    }
+    if (trace.is_binary() || format == Config::Format::BINARY) {
+        // a binary trace is read from its mapping anyway
+        return true;
+    }
+
+    // the image is a temporary file, removed at once: it lives as long as
+    // its descriptor, which forked processes inherit
+    const char* tmpdir = getenv("TMPDIR");
+    string image_fname = string(tmpdir ? tmpdir : "/tmp") + "/ramulator-trace-XXXXXX";
+    int fd = mkstemp(&image_fname[0]);
+    if (fd < 0) {
+        perror(image_fname.c_str());
+        return false;
+    }
+    unlink(image_fname.c_str());
+
+    // records are written in blocks
+    vector<char> block(sizeof(BinaryTraceHeader));
+    BinaryTraceHeader* header = (BinaryTraceHeader*) block.data();
+    memcpy(header->magic, binary_magic, sizeof(header->magic));
+    header->version = binary_version;
+    header->format = uint32_t(format);
+    block.reserve(1 << 16);
+    auto write_block = [&] () {
+        const char* from = block.data();
+        size_t left = block.size();
+        while (left > 0) {
+            ssize_t written = write(fd, from, left);
+            if (written < 0) {
+                return false;
+            }
+            from += written;
+            left -= written;
+        }
+        block.clear();
+        return true;
+    };
+
+    BinaryTraceRecord record, previous = BinaryTraceRecord();
+    long count = 0;
+    bool written = true;
+    while (written && trace.get_record(format, record)) {
+        encode_record(record, previous, block);
+        if (block.size() >= (1 << 16) - 64) {
+            written = write_block();
+        }
+        count++;
+    }
+    if (!written || !write_block()) {
+        perror(image_fname.c_str());
+        close(fd);
+        return false;
+    }
+    cout << "Preloaded " << count << " records of " << trace_fname << endl;
+    preloaded()[trace_fname] = fd;
+    return true;
+}
+
+void Trace::detect_binary(){
+    const BinaryTraceHeader* header = (const BinaryTraceHeader*) pos;
+    if (size_t(limit - pos) >= sizeof(BinaryTraceHeader) &&
+        std::equal(binary_magic, binary_magic + sizeof(binary_magic), header->magic)) {
+        if (header->version != binary_version) {
+            std::cerr << "Unsupported binary trace version " << header->version
+                      << " in " << trace_name << std::endl;
+            exit(1);
+        }
+        binary = true;
+        binary_format = Config::Format(header->format);
+        last_record = BinaryTraceRecord();
+        pos += sizeof(BinaryTraceHeader);
+    }
+    else {
+        binary = false;
+    }
+}
+
+void Trace::rewind(){
+    if (stream) {
+        stream->restart();
+        pos = limit = nullptr;
+        BinaryTraceHeader header;
+        if (binary) read_bytes((char*) &header, sizeof(header));
+    }
+    else {
+        pos = binary ? data + sizeof(BinaryTraceHeader) : data;
+    }
+    last_record = BinaryTraceRecord();
+    records = 0;
+}
+
+bool Trace::refill(){
+    return stream && stream->next_block(pos, limit);
+}
+
+bool Trace::next_line(const char*& line, const char*& line_end, bool& terminated){
+    if (pos == limit && !refill()) {
+        return false;
+    }
+    line = pos;
+    const char* newline = (const char*) memchr(pos, '\n', limit - pos);
+    terminated = (newline != nullptr);
+    if (terminated || !stream) {
+        line_end = terminated ? newline : limit;
+        pos = terminated ? newline + 1 : limit;
+        return true;
+    }
+    // the line continues in the next block
+    carry.assign(pos, limit);
+    pos = limit;
+    while (refill()) {
+        newline = (const char*) memchr(pos, '\n', limit - pos);
+        if (newline != nullptr) {
+            carry.append(pos, newline);
+            pos = newline + 1;
+            terminated = true;
+            break;
+        }
+        carry.append(pos, limit);
+        pos = limit;
+    }
+    line = carry.data();
+    line_end = line + carry.size();
+    return true;
+}
+
+bool Trace::read_bytes(char* out, size_t bytes){
+    if (size_t(limit - pos) >= bytes) {
+        memcpy(out, pos, bytes);
+        pos += bytes;
+        return true;
+    }
+    if (!stream) {
+        return false;
+    }
+    // the bytes continue in the next block
+    size_t copied = 0;
+    while (copied < bytes) {
+        if (pos == limit && !refill()) {
+            return false;
+        }
+        size_t n = std::min(bytes - copied, size_t(limit - pos));
+        memcpy(out + copied, pos, n);
+        pos += n;
+        copied += n;
+    }
+    return true;
+}
+
+bool Trace::get_record(Config::Format format, BinaryTraceRecord& record){
+    bool more = false;
+    if (binary) {
+        more = read_binary_record(record);
+    }
+    else {
+        switch (int(format)) {
+            case int(Config::Format::ZSIM): more = read_zsim_line(record); break;
+            case int(Config::Format::PISA): more = read_pisa_line(record); break;
+            case int(Config::Format::PIN): more = read_unfiltered_line(record); break;
+            case int(Config::Format::DRAM): more = read_dramtrace_line(record); break;
+            default: assert(false);
+        }
+    }
+    if (more) records++;
+    return more;
+}
+
+void Trace::checkpoint(Checkpoint& ckpt, Config::Format format){
+    // the byte offset of the next record and the state its decoding depends
+    // on; a compressed trace cannot seek, so it is read up to the position
+    // again
+    long position = records;
+    long offset = stream ? -1 : pos - data;
+    ckpt.io(position);
+    ckpt.io(offset);
+    ckpt.io(last_record);
+    ckpt.io(instructions);
+    if (ckpt.is_saving()) {
+        return;
+    }
+    if (!stream && offset >= 0) {
+        if (offset > long(size)) {
+            ckpt.fail("trace " + trace_name + " ends before the checkpoint");
+        }
+        pos = data + offset;
+        records = position;
+        return;
+    }
+    rewind();
+    fill(instructions.begin(), instructions.end(), 0);
+    BinaryTraceRecord record;
+    while (records < position && get_record(format, record));
+    if (records != position) {
+        ckpt.fail("trace " + trace_name + " ends before the checkpoint");
+    }
+}
+
+Trace::Position Trace::tell() const {
+    assert(can_seek());
+    Position position;
+    position.offset = pos - data;
+    position.records = records;
+    position.last_record = last_record;
+    position.instructions = instructions;
+    return position;
+}
+
+void Trace::seek(const Position& position){
+    assert(can_seek());
+    pos = data + position.offset;
+    records = position.records;
+    last_record = position.last_record;
+    instructions = position.instructions;
+}
+
+bool Trace::read_varint(uint64_t& value){
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos == limit && !refill()) {
+            return false;
+        }
+        uint8_t byte = *pos++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Trace::read_binary_record(BinaryTraceRecord& record){
+    if (pos == limit && !refill()) {
+        return false;
+    }
+    uint8_t tag = *pos++;
+    uint64_t bubble_cnt, delta, value;
+    if (!read_varint(bubble_cnt) || !read_varint(delta)) {
+        return false;
+    }
+    record = last_record;
+    record.bubble_cnt = bubble_cnt;
+    record.addr += (delta >> 1) ^ (0 - (delta & 1));
+    if (tag & 0x08) {
+        if (!read_varint(value)) return false;
+        record.threadID = value;
+    }
+    if (tag & 0x10) {
+        if (!read_varint(value)) return false;
+        record.processorID = value;
+    }
+    if (tag & 0x20) {
+        if (!read_varint(value)) return false;
+        record.size = value;
+    }
+    if ((tag & 0x07) == 7) {
+        if (pos == limit && !refill()) return false;
+        record.type = *pos++;
+    }
+    else {
+        record.type = binary_types[tag & 0x07];
+    }
+    last_record = record;
+    return true;
+}
+
+void Trace::encode_record(const BinaryTraceRecord& record,
+    BinaryTraceRecord& previous, vector<char>& out){
+    auto varint = [&out] (uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(char(value));
+    };
+    const char* type = (const char*) memchr(binary_types, record.type, sizeof(binary_types));
+    uint8_t tag = type != nullptr ? type - binary_types : 7;
+    if (record.threadID != previous.threadID) tag |= 0x08;
+    if (record.processorID != previous.processorID) tag |= 0x10;
+    if (record.size != previous.size) tag |= 0x20;
+
+    out.push_back(char(tag));
+    varint(record.bubble_cnt);
+    uint64_t delta = record.addr - previous.addr;
+    varint((delta << 1) ^ (0 - (delta >> 63)));
+    if (tag & 0x08) varint(record.threadID);
+    if (tag & 0x10) varint(record.processorID);
+    if (tag & 0x20) varint(record.size);
+    if ((tag & 0x07) == 7) out.push_back(record.type);
+    previous = record;
+}
+
 bool Trace::get_unfiltered_request(long& bubble_cnt, long& req_addr, Request::Type& req_type)
 {
-    string line;
-    getline(file, line);
-    if (file.eof()) {
+    BinaryTraceRecord record;
+    if (!get_record(Config::Format::PIN, record)) {
       if(!pim_mode_enabled){
-        file.clear();
-        file.seekg(0, file.beg);
+        rewind();
       }
        return false;
     }
+    bubble_cnt = record.bubble_cnt;
+    req_addr = record.addr;
+    req_type = (record.type == 'W') ? Request::Type::WRITE : Request::Type::READ;
+    return true;
+}
+
+bool Trace::read_unfiltered_line(BinaryTraceRecord& record)
+{
+    const char *line, *end;
+    bool terminated;
+    if (!next_line(line, end, terminated) || !terminated) {
+       return false;
+    }
 
-    size_t pos, end;
-    bubble_cnt = std::stoul(line, &pos, 10);
-    pos = line.find_first_not_of(' ', pos+1);
-    req_addr = std::stoul(line.substr(pos), &end, 0);
+    const char* p;
+    long value = 0;
+    record = BinaryTraceRecord();
+    if (!parse_number(line, end, 10, value, &p)) bad_line(line, end);
+    record.bubble_cnt = value;
+    if (!parse_number(p, end, 0, value, &p)) bad_line(line, end);
+    record.addr = value;
 
-    pos = line.find_first_not_of(' ', pos+end);
+    while (p != end && *p == ' ') p++;
 
-    if (pos == string::npos || line.substr(pos)[0] == 'R')
-        req_type = Request::Type::READ;
-    else if (line.substr(pos)[0] == 'W')
-        req_type = Request::Type::WRITE;
+    if (p == end || *p == 'R')
+        record.type = 'R';
+    else if (*p == 'W')
+        record.type = 'W';
     else{
-        cout << "line: " << line << endl;
-        cout << line.substr(pos)[0] << endl;
+        cout << "line: " << string(line, end) << endl;
+        cout << *p << endl;
         assert(false);
     }
     return true;
 }
 
+void Trace::bad_line(const char* line, const char* end){
+    std::cerr << "Bad number in trace " << trace_name << ": " << string(line, end) << std::endl;
+    exit(1);
+}
+
 bool Trace::get_filtered_request(long& bubble_cnt, long& req_addr, Request::Type& req_type)
 {
     static bool has_write = false;
@@ -869,13 +1449,13 @@ bool Trace::get_filtered_request(long& bubble_cnt, long& req_addr, Request::Type
         has_write = false;
         return true;
     }
-    string line;
-    getline(file, line);
+    const char *line, *end;
+    bool terminated;
+    bool more = next_line(line, end, terminated);
     line_num ++;
-    if (file.eof() || line.size() == 0) {
+    if (!more || !terminated || line == end) {
         if(!pim_mode_enabled){
-            file.clear();
-            file.seekg(0, file.beg);
+            rewind();
         }
         has_write = false;
         line_num = 0;
@@ -885,146 +1465,457 @@ bool Trace::get_filtered_request(long& bubble_cnt, long& req_addr, Request::Type
             return false;
         }
         else { // starting over the input trace file
-            getline(file, line);
+            next_line(line, end, terminated);
             line_num++;
         }
     }
 
-    size_t pos, end;
-    bubble_cnt = std::stoul(line, &pos, 10);
-
-    pos = line.find_first_not_of(' ', pos+1);
-    req_addr = stoul(line.substr(pos), &end, 0);
-
+    const char* p;
+    if (!parse_number(line, end, 10, bubble_cnt, &p) ||
+        !parse_number(p, end, 0, req_addr, &p)) {
+        bad_line(line, end);
+    }
 
     req_type = Request::Type::READ;
 
-    pos = line.find_first_not_of(' ', pos+end);
-    if (pos != string::npos){
+    if (parse_number(p, end, 0, write_addr)){
         has_write = true;
-        write_addr = stoul(line.substr(pos), NULL, 0);
     }
     return true;
 }
 
 bool Trace::get_dramtrace_request(long& req_addr, Request::Type& req_type)
 {
-    string line;
-    getline(file, line);
-    if (file.eof()) {
+    BinaryTraceRecord record;
+    if (!get_record(Config::Format::DRAM, record)) {
         return false;
     }
-    size_t pos;
-    req_addr = std::stoul(line, &pos, 16);
-
-    pos = line.find_first_not_of(' ', pos+1);
+    req_addr = record.addr;
+    req_type = (record.type == 'W') ? Request::Type::WRITE : Request::Type::READ;
+    return true;
+}
 
-    if (pos == string::npos || line.substr(pos)[0] == 'R')
-        req_type = Request::Type::READ;
-    else if (line.substr(pos)[0] == 'W')
-        req_type = Request::Type::WRITE;
+bool Trace::read_dramtrace_line(BinaryTraceRecord& record)
+{
+    const char *line, *end;
+    bool terminated;
+    if (!next_line(line, end, terminated) || !terminated) {
+        return false;
+    }
+    const char* p;
+    long value = 0;
+    record = BinaryTraceRecord();
+    if (!parse_number(line, end, 16, value, &p)) bad_line(line, end);
+    record.addr = value;
+
+    while (p != end && is_space(*p)) p++;
+
+    if (p == end || *p == 'R')
+        record.type = 'R';
+    else if (*p == 'W')
+        record.type = 'W';
     else assert(false);
     return true;
 }
 
-std::vector<std::string> Trace::split_str(std::string to_split){
-    std::vector<std::string> array;
-
-    std::istringstream iss(to_split);
-        for(std::string to_split; iss >> to_split; )
-            array.push_back(to_split);
-
-    return array;
+bool Trace::get_pisa_request(long& bubble_cnt, long& req_addr, Request::Type& req_type, unsigned& size){
+    BinaryTraceRecord record;
+    if (!get_record(Config::Format::PISA, record)) {
+        return false;
+    }
+    bubble_cnt = record.bubble_cnt;
+    req_addr = record.addr;
+    (record.type == 'L')? req_type = Request::Type::READ : req_type = Request::Type::WRITE;
+    size = record.size;
+    return true;
 }
 
+bool Trace::read_pisa_line(BinaryTraceRecord& record){
+    const char *line, *end;
+    bool terminated;
+    if (!next_line(line, end, terminated) || line == end) {
+        return false;
+    }
 
-bool Trace::get_pisa_request(long& bubble_cnt, long& req_addr, Request::Type& req_type, unsigned& size){
-    string linebuffer;
+    // thread, processor, cycle, type, address (hex), size
+    Token split[6];
+    int tokens = split_tokens(line, end, split, 6);
+    assert(tokens == 6);
+    long thread_id = 0, processor_id = 0, cycle = 0, addr = 0, req_size = 0;
+    if (!parse_number(split[0].begin, split[0].end, 10, thread_id) ||
+        !parse_number(split[1].begin, split[1].end, 10, processor_id) ||
+        !parse_number(split[2].begin, split[2].end, 10, cycle) ||
+        !parse_number(split[4].begin, split[4].end, 16, addr) ||
+        !parse_number(split[5].begin, split[5].end, 10, req_size)) {
+        bad_line(line, end);
+    }
 
-    if(getline(file, linebuffer)){
-        if (linebuffer.length() == 0) return false;
+    unsigned cycleNum = cycle;
+    int nInstructions = cycleNum - instructions[processor_id];
+    instructions[processor_id] = cycleNum;
+
+    record = BinaryTraceRecord();
+    record.threadID = thread_id;
+    record.processorID = processor_id;
+    record.bubble_cnt = unsigned(nInstructions);
+    record.addr = addr;
+    record.type = is_token(split[3], 'L') ? 'L' : 'S';
+    record.size = req_size;
+    return true;
+}
 
-        vector<string> split = split_str(linebuffer);
-        line l;
-        l.threadID = std::stoi(split[0],nullptr,10);
-        l.processorID = std::stoi(split[1],nullptr,10);
-        l.cycleNum = std::stoi(split[2],nullptr,10);
+bool Trace::get_zsim_request(long& bubble_cnt, long& req_addr, Request::Type& req_type, unsigned& cpu_id){
+    BinaryTraceRecord record;
+    if (!get_record(Config::Format::ZSIM, record)) {
+        return false;
+    }
+    if (record.type == 0) {
+        req_addr = -1;
+        return true;
+    }
+    bubble_cnt = record.bubble_cnt;
+    req_addr = record.addr;
+    if (record.type == 'L') req_type = Request::Type::READ;
+    else if (record.type == 'S') req_type = Request::Type::WRITE;
+    else if (record.type == 'I') req_type = Request::Type::INSTRUCTION;
 
-        int nInstructions = l.cycleNum - instructions[l.processorID];
-        instructions[l.processorID] = l.cycleNum;
-        l.cycleNum = nInstructions;
+    cpu_id = record.processorID;
+    return true;
+}
 
-        l.type = split[3];
-        l.addr  = std::stoul(split[4], nullptr, 16);
-        l.size = std::stoi(split[5],nullptr,10);
+bool Trace::read_zsim_line(BinaryTraceRecord& record){
+    const char *line, *end;
+    bool terminated;
+    if (!next_line(line, end, terminated) || line == end) {
+        return false;
+    }
 
-        bubble_cnt = l.cycleNum;
-        req_addr = l.addr;
-        (l.type == "L")? req_type = Request::Type::READ : req_type = Request::Type::WRITE;
-        size = l.size;
+    // thread, processor, instruction count or '-', L/S/P/I, address, size;
+    // the type is located first, the other fields are relative to it
+    // type 0 marks a line that could not be parsed
+    const int max_tokens = 16;
+    Token split[max_tokens];
+    int tokens = split_tokens(line, end, split, max_tokens);
+    record = BinaryTraceRecord();
+    if (tokens < 5) {
+        return true;
+    }
+    int type_position = 0;
+    for (int i = 0; i < tokens; i++) {
+        if (is_token(split[i], 'L') || is_token(split[i], 'S') ||
+            is_token(split[i], 'P') || is_token(split[i], 'I')) {
+            type_position = i;
+            break;
+        }
+    }
+    if ((type_position < 3) || ((type_position+1) >= tokens)) {
+        return true;
+    }
 
+    long thread_id, processor_id, cycle = 0, addr, req_size = 0;
+    if (!parse_number(split[type_position - 3].begin, split[type_position - 3].end, 10, thread_id) ||
+        !parse_number(split[type_position - 2].begin, split[type_position - 2].end, 10, processor_id)) {
+        return true;
+    }
+    if (unsigned(processor_id) > 512) {
         return true;
-      }
-    else{
-        return false;
     }
+    if (!is_token(split[type_position - 1], '-') &&
+        !parse_number(split[type_position - 1].begin, split[type_position - 1].end, 10, cycle)) {
+        return true;
+    }
+    if (!parse_number(split[type_position + 1].begin, split[type_position + 1].end, 10, addr)) {
+        return true;
+    }
+    if ((type_position+2) < tokens) {
+        parse_number(split[type_position + 2].begin, split[type_position + 2].end, 10, req_size);
+    }
+
+    record.threadID = thread_id;
+    record.processorID = processor_id;
+    record.bubble_cnt = unsigned(cycle);
+    record.addr = addr;
+    record.size = req_size;
+    record.type = *split[type_position].begin;
+    return true;
 }
 
-bool Trace::get_zsim_request(long& bubble_cnt, long& req_addr, Request::Type& req_type, unsigned& cpu_id){
-    string linebuffer;
-
-    if(getline(file, linebuffer)){
-		if (linebuffer.length() == 0){
-			return false;
-		}
-        vector<string> split = split_str(linebuffer);
-        line l;
-        try{
-            if(split.size() < 5){
-                req_addr = -1;
-                return true;
-            }
-            int type_position = 0;
-            for(int i = 0; i < split.size(); i++){
-                if((split[i] == "L") || (split[i] == "S") || (split[i] == "P") || (split[i] == "I")){
-                    type_position = i;
-                    break;
-                }
-            }
-            if((type_position >= 3) && ((type_position+1) < split.size())){
-                l.threadID = std::stoi(split[type_position - 3],nullptr,10);
-                l.processorID = std::stoi(split[type_position - 2],nullptr,10);
-                if(l.processorID > 512){
-                    req_addr = -1;
-                    return true;
-                }
-                if(split[type_position - 1] != "-")
-                    l.cycleNum = std::stoi(split[type_position - 1],nullptr,10);
-                else
-                    l.cycleNum = 0;
-                l.type = split[type_position];
-                l.addr  = std::stoul(split[type_position + 1], nullptr, 10);
-
-                bubble_cnt = l.cycleNum;
-                req_addr = l.addr;
-                if (l.type =="L") req_type = Request::Type::READ;
-                else if (l.type == "S") req_type = Request::Type::WRITE;
-                else if (l.type == "I") req_type = Request::Type::INSTRUCTION;
-
-                cpu_id = l.processorID;
-            }
-            else{
-                req_addr = -1;
-                return true;
-            }
+void TraceBuffer::push_back(const TraceRecord& record){
+    if (load == int(records.size())) {
+        // full: unwrap the records, oldest first, into twice the room
+        vector<TraceRecord> grown(2 * records.size());
+        for (int i = 0; i < load; i++) {
+            grown[i] = records[(tail + i) % records.size()];
         }
-        catch(std::exception e){
-            req_addr = -1;
-            return true;
+        records.swap(grown);
+        tail = 0;
+        head = load;
+    }
+    records[head] = record;
+    head = (head + 1) % records.size();
+    load++;
+    peak = max(peak, load);
+}
+
+TraceRecord TraceBuffer::pop_front(){
+    assert(!is_empty());
+    TraceRecord record = records[tail];
+    tail = (tail + 1) % records.size();
+    load--;
+    return record;
+}
+
+void TraceBuffer::checkpoint(Checkpoint& ckpt){
+    // only the buffered records, oldest first
+    ckpt.io(load);
+    ckpt.io(dispatched);
+    ckpt.io(peak);
+    if (ckpt.is_restoring()) {
+        records.resize(max(int(records.size()), load + 1));
+        tail = 0;
+        head = load;
+    }
+    for (int i = 0; i < load; i++) {
+        ckpt.io(records[(tail + i) % records.size()]);
+    }
+}
+
+TraceDispatcher::TraceDispatcher(const Config& configs, Trace& trace,
+    MemoryBase& memory, int number_cores)
+    : trace(trace), memory(memory), number_cores(number_cores),
+    buffers(number_cores), replays(number_cores), buffer_size(1 << 16){
+
+  // one round robin counter per vault of every stack
+  Memory<HMC, Controller>* ptr = dynamic_cast<Memory<HMC, Controller>*>(&memory);
+  routing.round_robin.resize(ptr != NULL ? ptr->ctrls.size() : 32, 0);
+  routing.offset_counter.resize(256, 0);
+
+  format = configs.get_trace_format();
+  if (trace.is_binary()) {
+    // records are routed as in the text trace the binary trace was converted from
+    format = trace.get_binary_format();
+  }
+  perfect_scheduling = !configs.get_disable_per_scheduling();
+
+  // records buffered per core
+  if (configs.contains("trace_buffer_size")) {
+    buffer_size = configs.get_int_value("trace_buffer_size");
+  }
+  assert(buffer_size > 0);
+  for (auto& buffer : buffers) {
+    buffer.init(buffer_size);
+  }
+
+  if (format == Config::Format::ZSIM) {
+    if (perfect_scheduling) {
+      cout << "Perfect scheduling enabled \n";
+    }
+    else {
+      cout << "Perfect scheduling disabled \n";
+    }
+  }
+  cout << "Streaming trace, " << buffer_size << " records buffered per core" << endl;
+}
+
+TraceDispatcher::Status TraceDispatcher::get_request(int coreid,
+    long& bubble_cnt, long& req_addr, Request::Type& req_type){
+  TraceBuffer& buffer = buffers[coreid];
+
+  while (buffer.is_empty()) {
+    if (replays[coreid].pending) {
+      replay(coreid);
+      continue;
+    }
+    if (trace_end) {
+      return Status::END;
+    }
+
+    TraceRecord record;
+    int target;
+    if (!read_record(routing, record, target)) {
+      trace_end = true;
+      cout << "Total Reads: " << total_reads << " Total Writes: " << total_writes << endl;
+      for (int i = 0; i < number_cores; i++) {
+        cout << "Core " << i << " got " << buffers[i].dispatched << endl;
+      }
+      for (int i = 0; i < number_cores; i++) {
+        if (buffers[i].peak > buffer_size) {
+          cerr << "Warning: core " << i << " buffered up to " << buffers[i].peak
+               << " records (trace_buffer_size is " << buffer_size
+               << "), a compressed trace cannot be read again" << endl;
         }
-        return true;
+      }
+      cout << endl;
+      continue;
     }
-    else{
-        return false;
-    }	
-}
\ No newline at end of file
+    if (format != Config::Format::PIN) {
+      (record.req_type == Request::Type::READ) ? total_reads++ : total_writes++;
+    }
+    if (target == -1) {
+      continue;
+    }
+    buffers[target].dispatched++;
+    Replay& dropped = replays[target];
+    if (dropped.pending) {
+      // read again after the first dropped record
+      continue;
+    }
+    if (buffers[target].is_full() && trace.can_seek()) {
+      dropped.pending = true;
+      dropped.first = record;
+      dropped.position = trace.tell();
+      dropped.routing = routing;
+      continue;
+    }
+    buffers[target].push_back(record);
+  }
+
+  TraceRecord record = buffer.pop_front();
+  bubble_cnt = record.bubble_cnt;
+  req_addr = record.req_addr;
+  req_type = record.req_type;
+  return Status::READY;
+}
+
+void TraceDispatcher::replay(int coreid){
+  TraceBuffer& buffer = buffers[coreid];
+  Replay& dropped = replays[coreid];
+  buffer.push_back(dropped.first);
+
+  Trace::Position current = trace.tell();
+  trace.seek(dropped.position);
+  dropped.pending = false;
+  while (trace.get_records() < current.records) {
+    TraceRecord record;
+    int target;
+    if (!read_record(dropped.routing, record, target)) {
+      cerr << "The trace changed while it was read" << endl;
+      exit(1);
+    }
+    if (target != coreid) {
+      continue;
+    }
+    if (buffer.is_full()) {
+      dropped.pending = true;
+      dropped.first = record;
+      dropped.position = trace.tell();
+      break;
+    }
+    buffer.push_back(record);
+  }
+  trace.seek(current);
+}
+
+void TraceDispatcher::checkpoint(Checkpoint& ckpt){
+  ckpt.section("trace");
+  trace.checkpoint(ckpt, format);
+  for (auto& buffer : buffers) {
+    buffer.checkpoint(ckpt);
+  }
+  for (auto& dropped : replays) {
+    ckpt.io(dropped.pending);
+    if (!dropped.pending) {
+      continue;
+    }
+    ckpt.io(dropped.first);
+    ckpt.io(dropped.position.offset);
+    ckpt.io(dropped.position.records);
+    ckpt.io(dropped.position.last_record);
+    ckpt.io(dropped.position.instructions);
+    ckpt.io(dropped.routing.round_robin);
+    ckpt.io(dropped.routing.offset_counter);
+  }
+  ckpt.io(trace_end);
+  ckpt.io(routing.round_robin);
+  ckpt.io(routing.offset_counter);
+  ckpt.io(total_reads);
+  ckpt.io(total_writes);
+}
+
+// The records of a vault go to the cores of its stack, see
+// Memory<HMC, Controller>::home_stack()
+int TraceDispatcher::schedule_by_vault(Memory<HMC, Controller>* ptr,
+    Routing& routing, int vault_target){
+  int stack = vault_target / ptr->vaults_per_stack;
+  int vault = vault_target % ptr->vaults_per_stack;
+  int first_core = ptr->first_core(stack, number_cores);
+  int stack_cores = ptr->first_core(stack + 1, number_cores) - first_core;
+  if (stack_cores == 0) {
+    // fewer cores than stacks
+    return vault_target % number_cores;
+  }
+  if (stack_cores <= ptr->vaults_per_stack) {
+    return first_core + vault % stack_cores;
+  }
+  int number_cores_per_vault = stack_cores/ptr->vaults_per_stack;
+  vector<int>& round_robin = routing.round_robin;
+  int core_to_schedule = ptr->vaults_per_stack*round_robin[vault_target] + vault;
+  round_robin[vault_target] = (round_robin[vault_target] + 1) % number_cores_per_vault;
+  if (core_to_schedule < stack_cores) {
+    return first_core + core_to_schedule;
+  }
+  return -1;
+}
+
+bool TraceDispatcher::read_record(Routing& routing, TraceRecord& record, int& coreid){
+  coreid = -1;
+  Memory<HMC,Controller>* ptr = dynamic_cast<Memory<HMC,Controller>*>(&memory);
+
+  //pin trace: scheduled by vault
+  if (format == Config::Format::PIN) {
+    if (!trace.get_unfiltered_request(record.bubble_cnt, record.req_addr, record.req_type)) {
+      return false;
+    }
+    if (ptr != NULL) {
+      coreid = ptr->get_vault(record.req_addr) % number_cores;
+    }
+    else {
+      cout << "Bad conversion \n";
+    }
+    return true;
+  }
+
+  //pisa trace: scheduled by vault
+  if (format == Config::Format::PISA) {
+    unsigned size = 0;
+    if (!trace.get_pisa_request(record.bubble_cnt, record.req_addr, record.req_type, size)) {
+      return false;
+    }
+    if (ptr != NULL) {
+      coreid = schedule_by_vault(ptr, routing, ptr->get_vault(record.req_addr));
+    }
+    else {
+      cout << "Bad conversion \n";
+    }
+    return true;
+  }
+
+  //zsim trace: scheduled by vault (perfect scheduling) or by cpu_id
+  unsigned cpu_id = 0;
+  if (!trace.get_zsim_request(record.bubble_cnt, record.req_addr, record.req_type, cpu_id)) {
+    return false;
+  }
+  if (record.req_addr == -1) {
+    return true;
+  }
+  if (perfect_scheduling) {
+    if (ptr != NULL) {
+      record.req_addr = ptr->page_allocator(record.req_addr, 0);
+      coreid = schedule_by_vault(ptr, routing, ptr->get_vault(record.req_addr));
+    }
+    else {
+      cout << "Bad conversion \n";
+    }
+  }
+  else if (number_cores <= 256) {
+    record.req_addr = memory.page_allocator(record.req_addr, cpu_id);
+    coreid = cpu_id % number_cores;
+  }
+  else {
+    int new_cpu_id = cpu_id + routing.offset_counter[cpu_id]*256;
+    routing.offset_counter[cpu_id]++;
+    record.req_addr = memory.page_allocator(record.req_addr, new_cpu_id);
+    coreid = new_cpu_id % number_cores;
+  }
+  return true;
+}
@@ -2,6 +2,7 @@
 #define __PROCESSOR_H
 
 #include "Cache.h"
+#include "Checkpoint.h"
 #include "Config.h"
 #include "Memory.h"
 #include "Request.h"
@@ -9,59 +10,58 @@
 #include "Controller.h"
 #include "HMC_Memory.h"
 #include "Statistics.h"
+#include "TraceStream.h"
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <string>
 #include <ctype.h>
 #include <functional>
+#include <map>
 #include <queue>
 #include <deque>
+#include <cstdint>
 namespace ramulator 
 {
 
-struct SqueduleQueue{
-    deque<long> bubble_cnt;
-    deque<long> req_addr;
-    deque<bool> memory_rqst_sent;
-    deque<unsigned> size;
-    deque<Request::Type> req_type;
-
-    int numberInstructionsInQueue = 0;
-    bool is_empty(){
-        if (numberInstructionsInQueue == 0 )
-            return true;
-        return false;
-    }
-    void pop_front(){
-        if(!is_empty()){
-   //         if(bubble_cnt.front()==0 && memory_rqst_sent.front()){
-                bubble_cnt.pop_front();
-                req_addr.pop_front();
-             //   memory_rqst_sent.pop_front();
-                req_type.pop_front();
-                numberInstructionsInQueue--;
-            //}
-        }
-    }
+// Record of a trace. The text readers decode each line into it, and a binary
+// trace (see ramulator-trace-convert) stores it, so a binary trace feeds the
+// cores exactly the requests of the text trace it was converted from.
+struct BinaryTraceRecord{
+    uint32_t threadID;
+    uint32_t processorID;
+    uint64_t bubble_cnt;
+    uint64_t addr;
+    uint32_t size;
+    char type;  // L, S, P, I (zsim, pisa) or R, W (pin, DRAM); 0 if the line could not be parsed
 };
 
-struct line{
-    unsigned threadID;
-    unsigned processorID;
-    unsigned cycleNum;
-    string type;
-    unsigned long addr;
-    unsigned size;
+// A binary trace is this header followed by its records, each one encoded
+// against the previous one (the first one against a record of zeros):
+//   a tag byte, with the type in bits 0-2 (0, L, S, P, I, R, W, or 7 for
+//   another type, stored in a byte after the fields), and bits 3-5 set when
+//   threadID, processorID or size differ from the previous record
+//   bubble_cnt, as a varint (7 bits per byte, lowest first)
+//   addr minus the previous addr, zigzag-encoded as a varint
+//   threadID, processorID and size, as varints, if flagged in the tag
+struct BinaryTraceHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t format;  // Config::Format of the text trace it was converted from
 };
 
+// The trace file is memory-mapped and parsed in place, without building a
+// string per line. Compressed traces (gzip, xz, zstd) are detected from their
+// first bytes and parsed from the blocks of a TraceStream instead.
 class Trace {
 public:
     Trace() {}
     Trace(const string& trace_fname);
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
     bool init_trace(const string& trace_fname);
     ~Trace(){
-        if(file.is_open()) file.close();
+        unmap();
     }
     // trace file format 1:
     // [# of bubbles(non-mem instructions)] [read address(dec or hex)] <optional: write address(evicted cacheline)>
@@ -73,36 +73,228 @@ public:
     // trace file format 2:
     // [address(hex)] [R/W]
     bool get_dramtrace_request(long& req_addr, Request::Type& req_type);
+
+    // decodes the next record, parsing a text trace of the given format or
+    // reading the next record of a binary trace
+    bool get_record(Config::Format format, BinaryTraceRecord& record);
+    bool is_binary() const {return binary;}
+    // format of the text trace a binary trace was converted from
+    Config::Format get_binary_format() const {return binary_format;}
+    // Saves or restores the position in the trace, the number of records
+    // read since its start and their byte offset. Restoring jumps to the
+    // offset, or reads a compressed trace up to the position again.
+    void checkpoint(Checkpoint& ckpt, Config::Format format);
+
+    // a point of the trace that can be read from again: the byte offset of
+    // the next record and the state its decoding depends on
+    struct Position {
+        long offset = 0;
+        long records = 0;
+        BinaryTraceRecord last_record;
+        std::vector<int> instructions;
+    };
+    // a compressed trace cannot seek
+    bool can_seek() const {return !stream;}
+    Position tell() const;
+    void seek(const Position& position);
+    // records read since the start of the trace
+    long get_records() const {return records;}
+
     long expected_limit_insts = 0;
     bool pim_mode_enabled = false;
 
+    static const char binary_magic[8];
+    static const uint32_t binary_version = 2;
+    // appends the encoding of record, against previous, to a binary trace,
+    // and makes it the previous record
+    static void encode_record(const BinaryTraceRecord& record,
+        BinaryTraceRecord& previous, std::vector<char>& out);
+
+    // Parses a text trace of the given format once into a temporary binary
+    // trace. Every Trace that opens trace_fname afterwards, also in a forked
+    // process, maps the binary trace instead of the file.
+    static bool preload(const string& trace_fname, Config::Format format);
+
 private:
-    std::ifstream file;
     std::string trace_name;
     std::vector<int> instructions;
 
-    std::vector<std::string> split_str(std::string to_split);
+    // mapped trace file and current read window: the whole file, or the
+    // current block of a compressed trace
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;  // data is a mapping (not set for an empty file)
+    const char* pos = nullptr;
+    const char* limit = nullptr;
+    std::unique_ptr<TraceStream> stream;
+    // a line split between two blocks of the stream
+    std::string carry;
+
+    bool binary = false;
+    Config::Format binary_format;
+    BinaryTraceRecord last_record;  // the next binary record is encoded against it
+    long records = 0;  // records read since the last rewind
+
+    // descriptors of the preloaded binary traces by file name
+    static std::map<std::string, int>& preloaded();
+
+    bool map(const string& trace_fname);
+    void unmap();
+    void detect_binary();
+    void rewind();
+    // returns the next line (without '\n'), false at the end of the trace
+    bool next_line(const char*& line, const char*& line_end, bool& terminated);
+    // moves the read window to the next block of the stream
+    bool refill();
+    bool read_bytes(char* out, size_t bytes);
+    bool read_varint(uint64_t& value);
+    // stops the run on a line whose number is missing or out of range
+    void bad_line(const char* line, const char* end);
+    bool read_binary_record(BinaryTraceRecord& record);
+    bool read_unfiltered_line(BinaryTraceRecord& record);
+    bool read_pisa_line(BinaryTraceRecord& record);
+    bool read_zsim_line(BinaryTraceRecord& record);
+    bool read_dramtrace_line(BinaryTraceRecord& record);
 };
 
+struct TraceRecord{
+    long bubble_cnt;
+    long req_addr;
+    Request::Type req_type;
+};
+
+// FIFO holding the records that are already assigned to one core, room for
+// capacity records. It only grows when a record does not fit.
+class TraceBuffer {
+public:
+    void init(int capacity){ this->capacity = capacity; records.resize(capacity); }
+    bool is_empty() const { return load == 0; }
+    bool is_full() const { return load >= capacity; }
+    void push_back(const TraceRecord& record);
+    TraceRecord pop_front();
+    void checkpoint(Checkpoint& ckpt);
+    long dispatched = 0;  // records of the trace assigned to the core
+    int peak = 0;  // most records buffered at once
+
+private:
+    std::vector<TraceRecord> records;
+    int capacity = 0;
+    int head = 0;
+    int tail = 0;
+    int load = 0;
+};
 
+// Reads a single (non split) trace on demand and hands its records to the
+// cores through per-core buffers of trace_buffer_size records, so the trace
+// never has to be held in memory as a whole. Records are assigned to cores
+// with the same vault-based or cpu_id-based policy used for PIM runs. The
+// trace is only read when a core runs out of records, up to the next record
+// of that core, so no core ever waits for another one. A record of a core
+// whose buffer is full is dropped, and the core reads the trace again from
+// its first dropped record once its buffer is empty, so the timing does not
+// depend on the buffer size. A compressed trace cannot be read again: its
+// buffers grow instead.
+class TraceDispatcher {
+public:
+    enum class Status {
+        READY,   // a record was returned
+        END      // no more records for this core
+    };
+
+    TraceDispatcher(const Config& configs, Trace& trace, MemoryBase& memory, int number_cores);
+    Status get_request(int coreid, long& bubble_cnt, long& req_addr, Request::Type& req_type);
+    // saves or restores the position in the trace and the buffered records
+    void checkpoint(Checkpoint& ckpt);
+
+private:
+    // state of the assignment of records to cores, which depends on the
+    // records assigned before
+    struct Routing {
+        std::vector<int> round_robin;
+        std::vector<int> offset_counter;
+    };
+
+    // records of a core dropped while its buffer was full: the first one,
+    // and the trace and routing state right after it
+    struct Replay {
+        bool pending = false;
+        TraceRecord first;
+        Trace::Position position;
+        Routing routing;
+    };
+
+    // reads the next record of the trace and computes the core it belongs to
+    // (-1 if the record is dropped); returns false at the end of the trace
+    bool read_record(Routing& routing, TraceRecord& record, int& coreid);
+    int schedule_by_vault(Memory<HMC, Controller>* ptr, Routing& routing, int vault_target);
+    // refills the buffer of a core with its dropped records, reading the
+    // trace again up to the current position
+    void replay(int coreid);
+
+    Trace& trace;
+    MemoryBase& memory;
+    Config::Format format;
+    bool perfect_scheduling = true;
+    int number_cores;
+
+    std::vector<TraceBuffer> buffers;
+    std::vector<Replay> replays;
+    int buffer_size;
+    bool trace_end = false;
+
+    Routing routing;
+    long total_reads = 0;
+    long total_writes = 0;
+};
+
+
+// Reorder buffer of an out-of-order core. Entries are inserted in program
+// order and retire in order, up to ipc per cycle, once they are ready. A load
+// is not ready until its cache line returns: the loads waiting for a line are
+// chained in a table indexed by the line address, so a response wakes them
+// without scanning the window, and the lines in the table are the misses the
+// core has in flight.
 class Window {
 public:
     int ipc = 4;
     int depth = 128;
 
-    Window() : ready_list(depth), addr_list(depth, -1) {}
+    Window() { init(ipc, depth, 64); }
+    void init(int ipc, int depth, int line_size);
     bool is_full();
     bool is_empty();
     void insert(bool ready, long addr);
+    // inserts n ready entries without a memory access
+    void insert_bubbles(int n);
+    // n bubbles pass through a window of ready entries: the n oldest
+    // entries retire and as many bubbles are inserted
+    void stream_bubbles(long n);
     long retire();
-    void set_ready(long addr, int mask);
-
+    // wakes the loads waiting for the line of addr
+    void set_ready(long addr);
+    // true if a load to the line of addr is waiting already
+    bool is_pending(long addr);
+    // lines waited for, and entries with a memory access (loads and stores)
+    int pending_lines = 0;
+    int memory_entries = 0;
 
     int load = 0;
     int head = 0;
     int tail = 0;
     std::vector<bool> ready_list;
     std::vector<long> addr_list;
+
+private:
+    int line_bits;
+    // first waiting entry of each bucket and the next one of each entry, -1
+    // at the end of a chain
+    std::vector<int> waiters;
+    std::vector<int> next_waiter;
+
+    // bucket of a line number (address >> line_bits)
+    int bucket(long line) const {
+        return (line ^ (line >> 16)) & (waiters.size() - 1);
+    }
 };
 
 
@@ -118,14 +310,23 @@ public:
     string cpu_type;
     bool pim_mode_enabled = false;
     function<bool(Request)> send;
-    SqueduleQueue rqst_queue;
+    TraceDispatcher* dispatcher = nullptr;
     bool lock_core = false;
-    long prevnumberInstructionsInQueue = 0;
+    // set before a checkpoint: the core retires, but issues nothing new
+    bool draining = false;
     Core(const Config& configs, int coreid,
         function<bool(Request)> send_next, Cache* llc,
         std::shared_ptr<CacheSystem> cachesys, MemoryBase& memory);
 
     void tick();
+    // true if tick() would only advance clk, which holds until a request
+    // returns from memory
+    bool is_idle();
+    // Number of upcoming ticks up to and including the first one that is
+    // not replaced by skip(): LONG_MAX while idle, more than 1 while the
+    // core only streams bubbles through a window of ready entries
+    long ticks_to_next_event();
+    void skip(long cycles);
     void receive(Request& req);
     double calc_ipc();
     bool finished();
@@ -133,9 +334,19 @@ public:
     void tick_inOrder();
     void tick_outOrder();
     void get_first_request();
+    void get_next_request();
+    // moves on to the next record of the trace, split or dispatched
+    void advance_trace();
+    // Functional warming of the next record: its instructions are consumed
+    // and its access updates the caches and the DRAM state, without timing.
+    // Adds the instructions to insts, false if the core cannot take a record.
+    bool warm(long& insts);
     void load_trace(string trace_base_name);
+    // Saves or restores the next request of the core, its trace position and
+    // its caches. The window has to be empty.
+    void checkpoint(Checkpoint& ckpt);
 
-    function<void(Request&)> callback;
+    Request::Callback callback;
 
     bool no_core_caches = true;
     bool no_shared_cache = true;
@@ -160,6 +371,14 @@ public:
     bool reached_limit = false;
 
     Window window;
+    // load/store queue entries (0: no load/store queue, stores bypass the
+    // window) and lines the core may wait for at once (0: no limit)
+    int lsq_size = 0;
+    int core_mshrs = 0;
+    bool lsq_full() {return lsq_size && window.memory_entries >= lsq_size;}
+    bool mshrs_full(long addr) {
+        return core_mshrs && window.pending_lines >= core_mshrs && !window.is_pending(addr);
+    }
 
     long bubble_cnt;
     long req_addr = -1;
@@ -182,10 +401,29 @@ public:
     Processor(const Config& configs, vector<string> trace_list,
         function<bool(Request)> send, MemoryBase& memory);
     void tick();
+    // Number of upcoming ticks up to and including the first one that may do
+    // more than advance the clocks, LONG_MAX while waiting for memory
+    long ticks_to_next_event();
+    void skip(long cycles);
+    // ticks in which cores only stream bubbles may be skipped as well
+    bool skip_bubbles = true;
     void receive(Request& req);
     bool finished();
     void calc_stats();
     bool has_reached_limit();
+    // Stops the cores from issuing, so that the requests in flight drain
+    // before a checkpoint
+    void drain();
+    // true once no request is left in the windows and the caches
+    bool is_drained();
+    // saves or restores the state of a drained processor
+    void checkpoint(Checkpoint& ckpt);
+    // lets the cores issue again after drain()
+    void resume();
+    // Functional warming of about insts instructions, taken round-robin from
+    // the cores. Has to be called on a drained processor. Returns the number
+    // of instructions warmed, less than insts only at the end of the traces.
+    long warm(long insts);
     bool pim_mode_enabled = false;
     bool pisa_trace = false;
     bool zsim_trace = false;
@@ -200,6 +438,8 @@ public:
 
     bool no_core_caches = true;
     bool no_shared_cache = true;
+    // the L3 is simulated and shared by the cores (cache_hierarchy = on)
+    bool shared_llc = false;
 
     int l3_size = 1 << 23;
     int l3_assoc = 1 << 3;
@@ -219,7 +459,11 @@ public:
     ScalarStat general_ipc;
     ScalarStat total_cpu_instructions;
     ScalarStat total_time;
+    // reads returned from memory and their latency in memory cycles
+    long memory_reads = 0;
+    long memory_read_latency = 0;
     Trace trace;
+    std::unique_ptr<TraceDispatcher> dispatcher;
     MemoryBase& memory;
 };
 
@@ -251,6 +251,12 @@ void Refresh<DSARP>::tick_ref() {
   if ((clk - refreshed) >= refresh_interval)
     inject_refresh(b_ref_rank);
 }
+
+// DSARP pulls in refreshes early, so it has to be ticked every cycle
+template<>
+long Refresh<DSARP>::get_next_refresh() {
+  return clk + 1;
+}
 /**** End DSARP specialization ****/
 
 template<>
@@ -270,12 +276,13 @@ Refresh<HMC>::Refresh(Controller<HMC>* ctrl): ctrl(ctrl) {
 
 template<>
 void Refresh<HMC>::refresh_target(Controller<HMC>* ctrl, int vault) {
-  vector<int> addr_vec(int(HMC::Level::MAX), -1);
+  AddrVec addr_vec;
+  addr_vec.resize(int(HMC::Level::MAX), -1);
   addr_vec[level_vault] = vault;
   for (int i = level_vault + 1 ; i < int(HMC::Level::MAX) ; ++i) {
     addr_vec[i] = -1;
   }
-  Request req(addr_vec, Request::Type::REFRESH, NULL, 0);
+  Request req(addr_vec, Request::Type::REFRESH, Request::Callback(), 0);
   bool res = ctrl->enqueue(req);
   assert(res);
 }
@@ -21,6 +21,7 @@
 #include <iostream>
 #include <vector>
 
+#include "Checkpoint.h"
 #include "Request.h"
 #include "DSARP.h"
 #include "ALDRAM.h"
@@ -86,6 +87,26 @@ public:
     }
   }
 
+  // clk of the next tick_ref() that injects a refresh
+  long get_next_refresh() {
+    return refreshed + ctrl->channel->spec->speed_entry.nREFI;
+  }
+
+  // Advances the clock over ticks that inject no refresh
+  void skip(long cycles) {
+    clk += cycles;
+  }
+
+  void checkpoint(Checkpoint& ckpt) {
+    ckpt.io(clk);
+    ckpt.io(refreshed);
+    ckpt.io(bank_ref_counters);
+    for (auto backlog : bank_refresh_backlog)
+      ckpt.io(*backlog);
+    ckpt.io(subarray_ref_counters);
+    ckpt.io(ctrl_write_mode);
+  }
+
 private:
   // Keeping track of refresh status of every bank: + means ahead of schedule, - means behind schedule
   vector<vector<int>*> bank_refresh_backlog;
@@ -101,12 +122,13 @@ private:
   // Refresh based on the specified address
   void refresh_target(Controller<T>* ctrl, int rank, int bank, int sa)
   {
-    vector<int> addr_vec(int(T::Level::MAX), -1);
+    AddrVec addr_vec;
+    addr_vec.resize(int(T::Level::MAX), -1);
     addr_vec[0] = ctrl->channel->id;
     addr_vec[1] = rank;
     addr_vec[2] = bank;
     addr_vec[3] = sa;
-    Request req(addr_vec, Request::Type::REFRESH, NULL, -1);
+    Request req(addr_vec, Request::Type::REFRESH, Request::Callback(), -1);
     bool res = ctrl->enqueue(req);
     assert(res);
   }
@@ -136,6 +158,7 @@ private:
 // where to look for these definitions when controller calls them!
 template<> Refresh<DSARP>::Refresh(Controller<DSARP>* ctrl);
 template<> void Refresh<DSARP>::tick_ref();
+template<> long Refresh<DSARP>::get_next_refresh();
 template<> Refresh<HMC>::Refresh(Controller<HMC>* ctrl);
 template<> void Refresh<HMC>::refresh_target(Controller<HMC>* ctrl, int vault);
 template<> void Refresh<HMC>::inject_refresh(bool b_ref_rank);
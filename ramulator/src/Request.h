@@ -1,24 +1,96 @@
 #ifndef __REQUEST_H
 #define __REQUEST_H
 
+#include <algorithm>
+#include <cassert>
 #include <vector>
-#include <functional>
 
 using namespace std;
 
 namespace ramulator
 {
 
+// The address of a request split up per level of the DRAM organization (e.g.,
+// channel, rank, bank, row, column). The levels are kept inline, so that
+// copying a request does not allocate.
+class AddrVec
+{
+public:
+    static const int CAPACITY = 8;
+
+    AddrVec() {}
+    AddrVec(const vector<int>& levels) {
+        resize(levels.size());
+        copy(levels.begin(), levels.end(), elems);
+    }
+
+    int size() const {return count;}
+    bool empty() const {return !count;}
+    void resize(int size, int value = 0) {
+        assert(size <= CAPACITY);
+        if (size > count)
+            fill(elems + count, elems + size, value);
+        count = size;
+    }
+
+    int& operator[](int level) {return elems[level];}
+    const int& operator[](int level) const {return elems[level];}
+    int* data() {return elems;}
+    const int* data() const {return elems;}
+    int* begin() {return elems;}
+    const int* begin() const {return elems;}
+    int* end() {return elems + count;}
+    const int* end() const {return elems + count;}
+
+private:
+    int elems[CAPACITY];
+    int count = 0;
+};
+
 class Request
 {
 public:
+    // Called when a read completes, e.g. to wake up the instruction that
+    // waits for it. It is a plain function with an opaque argument (usually
+    // the object that sent the request) instead of a std::function, which
+    // allocates when it binds a member function and every copy of the
+    // request would copy it.
+    struct Callback {
+        void (*func)(void*, Request&) = NULL;
+        void* arg = NULL;
+
+        Callback() {}
+        Callback(void (*func)(void*, Request&), void* arg) : func(func), arg(arg) {}
+
+        void operator()(Request& req) const {
+            if (func)
+                func(arg, req);
+        }
+
+        // calls obj->M(req)
+        template <typename C, void (C::*M)(Request&)>
+        static Callback member(C* obj) {
+            return Callback{[](void* obj, Request& req) {(static_cast<C*>(obj)->*M)(req);}, obj};
+        }
+
+        // calls (*f)(req), f must outlive the requests
+        template <typename F>
+        static Callback of(F* f) {
+            return Callback{[](void* f, Request& req) {(*static_cast<F*>(f))(req);}, f};
+        }
+    };
+
     bool is_first_command;
     long addr;
     // long addr_row;
-    vector<int> addr_vec;
+    AddrVec addr_vec;
     long reqid = -1;
     // specify which core this request sent from, for virtual address translation
     int coreid = -1;
+    // sent by a PIM core to the vaults, not by the host over the links
+    bool pim = false;
+    // HMC: the slot of its packet in the PacketPool of the memory
+    int packet = -1;
     long initial_addr = 0;
     bool instruction_request = false;
 
@@ -41,16 +113,15 @@ public:
 
     int burst_count = 0;
     int transaction_bytes = 0;
-    function<void(Request&)> callback; // call back with more info
+    Callback callback; // call back with more info
 
     Request(long addr, Type type, int coreid)
-        : is_first_command(true), addr(addr), coreid(coreid), type(type),
-      callback([](Request& req){}) {initial_addr == addr;}
+        : is_first_command(true), addr(addr), coreid(coreid), type(type) {initial_addr == addr;}
 
-    Request(long addr, Type type, function<void(Request&)> callback, int coreid)
+    Request(long addr, Type type, Callback callback, int coreid)
         : is_first_command(true), addr(addr), coreid(coreid), type(type), callback(callback) {initial_addr == addr;}
 
-    Request(vector<int>& addr_vec, Type type, function<void(Request&)> callback, int coreid)
+    Request(const AddrVec& addr_vec, Type type, Callback callback, int coreid)
         : is_first_command(true), addr_vec(addr_vec), coreid(coreid), type(type), callback(callback) {initial_addr == addr;}
 
     Request() {}
@@ -0,0 +1,359 @@
+#ifndef __REQUEST_QUEUE_H
+#define __REQUEST_QUEUE_H
+
+#include "DRAM.h"
+#include "Request.h"
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <vector>
+
+using namespace std;
+
+namespace ramulator
+{
+
+// A request queue of a memory controller. The requests are kept in arrival
+// order in q; the list nodes of removed requests are kept aside and reused,
+// so a queue stops allocating once it has been full.
+//
+// After index(), the queue also groups its requests by the deepest DRAM node
+// they access (the bank, or e.g. the subarray), their row and their type. All
+// requests of a group need the same next command and are row hits (or misses)
+// together, so the scheduler decides per group instead of per request. The
+// command and the row hit/open bits of a group are cached until a command
+// changes the state of a node on the group's path (see DRAM<T>::state_version).
+//
+// After index_addrs(), it also counts its requests per address in a hash
+// table, so has_addr() does not scan the queue.
+template <typename T>
+class RequestQueue
+{
+public:
+    typedef list<Request>::iterator iterator;
+
+    struct Group {
+        int row = -1;
+        Request::Type type;
+        vector<pair<long, iterator>> reqs;  // sequence number and request, in arrival order
+
+        long version = -1;  // path state version of the cached fields below
+        typename T::Command cmd;  // first command of the requests
+        bool hit = false;
+        bool open = false;
+    };
+
+    struct Bank {
+        DRAM<T>* node;  // deepest node of the channel
+        int rowgroup;  // the node a PRE to this bank closes rows in (bank or subarray)
+        vector<Group> groups;  // empty groups are kept for reuse
+    };
+
+    list<Request> q;
+    unsigned int max = 32;
+    unsigned int size() {return q.size();}
+
+    vector<Bank> banks;
+    vector<int> active;  // banks with queued requests
+    int rowgroups = 0;
+
+    bool indexed() {return banks.size() > 0;}
+
+    // Index the requests by the nodes of channel. first_cmd decodes the next
+    // command of a request.
+    void index(DRAM<T>* channel, function<typename T::Command(iterator)> first_cmd)
+    {
+        int leaf_level = int(T::Level::Row) - 1;
+        for (int l = 1; l <= leaf_level; l++)
+            if (!channel->spec->org_entry.count[l])
+                return;  // the tree stops early, keep scanning the list
+
+        this->channel = channel;
+        this->first_cmd = first_cmd;
+        gather(channel, leaf_level);
+
+        int scope = int(channel->spec->scope[int(T::Command::PRE)]);
+        int banks_per_rowgroup = 1;
+        for (int l = scope + 1; l <= leaf_level; l++)
+            banks_per_rowgroup *= channel->spec->org_entry.count[l];
+        for (unsigned int i = 0; i < banks.size(); i++)
+            banks[i].rowgroup = i / banks_per_rowgroup;
+        rowgroups = (banks.size() + banks_per_rowgroup - 1) / banks_per_rowgroup;
+        active_pos.assign(banks.size(), -1);
+
+        for (auto req = q.begin(); req != q.end(); ++req)
+            insert(req);
+    }
+
+    // Count the requests of each address, for has_addr()
+    void index_addrs()
+    {
+        addr_index = true;
+        rehash(16);
+    }
+
+    // Whether a request to addr is queued (after index_addrs())
+    bool has_addr(long addr)
+    {
+        assert(addr_index);
+        return addrs[addr_slot(addr)].count > 0;
+    }
+
+    iterator push_back(const Request& req)
+    {
+        if (spare.size()) {
+            spare.front() = req;
+            q.splice(q.end(), spare, spare.begin());
+        } else {
+            q.push_back(req);
+        }
+        auto itr = prev(q.end());
+        if (indexed())
+            insert(itr);
+        if (addr_index)
+            add_addr(req.addr);
+        return itr;
+    }
+
+    void erase(iterator req)
+    {
+        if (indexed())
+            remove(req);
+        if (addr_index)
+            remove_addr(req->addr);
+        spare.splice(spare.begin(), q, req);
+    }
+
+    void pop_back() {erase(prev(q.end()));}
+
+    // Call f(bank, group) for every group with queued requests
+    template <typename F>
+    void for_each_group(F f)
+    {
+        for (int id : active)
+            for (auto& group : banks[id].groups)
+                if (group.reqs.size())
+                    f(banks[id], group);
+    }
+
+    // Update the cached command and row hit/open bits of a group, if a command
+    // changed the state of the bank since they were computed
+    void refresh(Bank& bank, Group& group)
+    {
+        long version = 0;
+        for (DRAM<T>* node = bank.node; node; node = node->parent)
+            version += node->state_version;
+        if (version == group.version)
+            return;
+
+        auto req = group.reqs.front().second;
+        typename T::Command cmd = channel->spec->translate[int(req->type)];
+        group.cmd = first_cmd(req);
+        group.hit = channel->check_row_hit(cmd, req->addr_vec.data());
+        group.open = channel->check_row_open(cmd, req->addr_vec.data());
+        group.version = version;
+    }
+
+private:
+    list<Request> spare;  // list nodes of removed requests
+    long seq = 0;
+    DRAM<T>* channel = NULL;
+    function<typename T::Command(iterator)> first_cmd;
+    vector<int> active_pos;  // position of each bank in active, -1 if idle
+
+    // The hash table of addresses: open addressing with linear probing, at
+    // most half full. An entry is free when its count is 0.
+    struct AddrCount {
+        long addr = 0;
+        int count = 0;
+    };
+    bool addr_index = false;
+    vector<AddrCount> addrs;
+    int addr_shift;  // 64 - log2(addrs.size())
+
+    unsigned int addr_home(long addr)
+    {
+        return (uint64_t(addr) * 0x9E3779B97F4A7C15ull) >> addr_shift;
+    }
+
+    // the entry of addr, or the free entry it would take
+    unsigned int addr_slot(long addr)
+    {
+        unsigned int mask = addrs.size() - 1;
+        unsigned int i = addr_home(addr);
+        while (addrs[i].count && addrs[i].addr != addr)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void rehash(unsigned int slots)
+    {
+        addrs.assign(slots, AddrCount());
+        addr_shift = 64;
+        for (unsigned int n = slots; n > 1; n >>= 1)
+            addr_shift--;
+        for (auto& req : q) {
+            AddrCount& entry = addrs[addr_slot(req.addr)];
+            entry.addr = req.addr;
+            entry.count++;
+        }
+    }
+
+    void add_addr(long addr)
+    {
+        if (2 * q.size() > addrs.size())
+            rehash(2 * addrs.size());  // counts the new request as well
+        else {
+            AddrCount& entry = addrs[addr_slot(addr)];
+            entry.addr = addr;
+            entry.count++;
+        }
+    }
+
+    void remove_addr(long addr)
+    {
+        unsigned int mask = addrs.size() - 1;
+        unsigned int i = addr_slot(addr);
+        assert(addrs[i].count);
+        if (--addrs[i].count)
+            return;
+        // move back the entries after it that probed past it
+        for (unsigned int j = (i + 1) & mask; addrs[j].count; j = (j + 1) & mask) {
+            unsigned int home = addr_home(addrs[j].addr);
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                addrs[i] = addrs[j];
+                addrs[j].count = 0;
+                i = j;
+            }
+        }
+    }
+
+    void gather(DRAM<T>* node, int leaf_level)
+    {
+        if (int(node->level) == leaf_level) {
+            banks.push_back(Bank{node, 0, {}});
+            return;
+        }
+        for (auto child : node->children)
+            gather(child, leaf_level);
+    }
+
+    int bank_id(const Request& req)
+    {
+        int id = 0;
+        for (int l = 1; l < int(T::Level::Row); l++) {
+            assert(req.addr_vec[l] >= 0);
+            id = id * channel->spec->org_entry.count[l] + req.addr_vec[l];
+        }
+        return id;
+    }
+
+    Group* find(Bank& bank, const Request& req)
+    {
+        int row = req.addr_vec[int(T::Level::Row)];
+        for (auto& group : bank.groups)
+            if (group.reqs.size() && group.row == row && group.type == req.type)
+                return &group;
+        return NULL;
+    }
+
+    void insert(iterator req)
+    {
+        int id = bank_id(*req);
+        Bank& bank = banks[id];
+        Group* group = find(bank, *req);
+        if (!group) {
+            for (auto& g : bank.groups)
+                if (!g.reqs.size()) {
+                    group = &g;
+                    break;
+                }
+            if (!group) {
+                bank.groups.emplace_back();
+                group = &bank.groups.back();
+            }
+            group->row = req->addr_vec[int(T::Level::Row)];
+            group->type = req->type;
+            group->version = -1;
+        }
+        group->reqs.emplace_back(seq++, req);
+
+        if (active_pos[id] < 0) {
+            active_pos[id] = active.size();
+            active.push_back(id);
+        }
+    }
+
+    void remove(iterator req)
+    {
+        int id = bank_id(*req);
+        Bank& bank = banks[id];
+        Group* group = find(bank, *req);
+        assert(group);
+        auto& reqs = group->reqs;
+        for (auto itr = reqs.begin(); itr != reqs.end(); ++itr)
+            if (itr->second == req) {
+                reqs.erase(itr);
+                break;
+            }
+
+        for (auto& g : bank.groups)
+            if (g.reqs.size())
+                return;
+        // the bank became idle
+        int pos = active_pos[id];
+        active[pos] = active.back();
+        active_pos[active[pos]] = pos;
+        active.pop_back();
+        active_pos[id] = -1;
+    }
+};
+
+// A FIFO in a ring buffer that only grows, so unlike a std::deque it stops
+// allocating once it has held the most elements.
+template <typename E>
+class Ring
+{
+public:
+    unsigned int size() const {return count;}
+    bool empty() const {return !count;}
+    E& operator[](unsigned int i) {return ring[(head + i) & (ring.size() - 1)];}
+    E& front() {return (*this)[0];}
+
+    void push_back(const E& elem)
+    {
+        if (count == ring.size())
+            grow();
+        count++;
+        (*this)[count - 1] = elem;
+    }
+
+    void pop_front()
+    {
+        assert(count);
+        head = (head + 1) & (ring.size() - 1);
+        count--;
+    }
+
+private:
+    vector<E> ring;
+    unsigned int head = 0;
+    unsigned int count = 0;
+
+    void grow()
+    {
+        vector<E> bigger(ring.size() ? 2 * ring.size() : 16);  // a power of two
+        for (unsigned int i = 0; i < count; i++)
+            bigger[i] = (*this)[i];
+        ring.swap(bigger);
+        head = 0;
+    }
+};
+
+// Reads that wait for their data, oldest first
+typedef Ring<Request> RequestRing;
+
+} /*namespace ramulator*/
+
+#endif /*__REQUEST_QUEUE_H*/
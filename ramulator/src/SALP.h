@@ -35,6 +35,10 @@ public:
         Channel, Rank, Bank, SubArray, Row, Column, MAX
     };
 
+    string level_name[int(Level::MAX)] = {
+        "Ch", "Ra", "Ba", "Sa", "Ro", "Co"
+    };
+
     /*** Command ***/
     enum class Command : int
     { 
@@ -0,0 +1,189 @@
+#include "Sampler.h"
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+using namespace ramulator;
+
+Sampler::Sampler(const Config& configs, Processor& proc, MemoryBase& memory)
+    : proc(proc), memory(memory){
+    sample_insts = atol(configs["sample_insts"].c_str());
+    warmup_insts = atol(configs["sample_warmup_insts"].c_str());
+    period_insts = atol(configs["sample_period_insts"].c_str());
+    assert(sample_insts > 0 && warmup_insts >= 0);
+    assert(period_insts >= sample_insts + warmup_insts);
+
+    // regStats
+    sample_count.name("sample_count")
+                .desc("number of measured samples")
+                .precision(0)
+                ;
+    sample_ipc_mean.name("sample_ipc_mean")
+                   .desc("mean ipc of the samples")
+                   .precision(6)
+                   ;
+    sample_ipc_ci.name("sample_ipc_ci")
+                 .desc("half width of the 95% confidence interval of sample_ipc_mean")
+                 .precision(6)
+                 ;
+    sample_read_latency_mean.name("sample_read_latency_mean")
+                            .desc("mean DRAM read latency of the samples (ns)")
+                            .precision(6)
+                            ;
+    sample_read_latency_ci.name("sample_read_latency_ci")
+                          .desc("half width of the 95% confidence interval of sample_read_latency_mean (ns)")
+                          .precision(6)
+                          ;
+    sample_bandwidth_mean.name("sample_bandwidth_mean")
+                         .desc("mean DRAM bandwidth of the samples (GB/s)")
+                         .precision(6)
+                         ;
+    sample_bandwidth_ci.name("sample_bandwidth_ci")
+                       .desc("half width of the 95% confidence interval of sample_bandwidth_mean (GB/s)")
+                       .precision(6)
+                       ;
+    sampled_instructions.name("sampled_instructions")
+                        .desc("instructions of the trace, simulated in detail or warmed")
+                        .precision(0)
+                        ;
+    estimated_cpu_cycles.name("estimated_cpu_cycles")
+                        .desc("cpu cycles of the whole trace, from the mean cpi of the samples")
+                        .precision(0)
+                        ;
+    estimated_total_time.name("estimated_total_time")
+                        .desc("time of the whole trace, from the mean cpi of the samples (ns)")
+                        .precision(6)
+                        ;
+}
+
+long Sampler::detailed_insts(){
+    long insts = 0;
+    for (auto& core : proc.cores)
+        insts += long(core->cpu_inst.value());
+    return insts;
+}
+
+Sampler::Snapshot Sampler::snapshot(){
+    Snapshot s;
+    s.cycles = long(proc.cpu_cycles.value());
+    s.insts = detailed_insts();
+    s.reads = proc.memory_reads;
+    s.read_latency = proc.memory_read_latency;
+    memory.get_totals(s.memory_cycles, s.bytes);
+    return s;
+}
+
+void Sampler::warm(){
+    warmed += proc.warm(period_insts - warmup_insts - sample_insts);
+    phase_start = detailed_insts();
+    if (warmup_insts > 0) {
+        phase = Phase::WARMUP;
+    } else {
+        begin = snapshot();
+        phase = Phase::MEASURE;
+    }
+}
+
+void Sampler::start(){
+    warm();
+}
+
+void Sampler::tick(){
+    long insts = detailed_insts();
+    switch (phase) {
+        case Phase::WARMUP:
+            if (insts - phase_start >= warmup_insts) {
+                begin = snapshot();
+                phase_start = insts;
+                phase = Phase::MEASURE;
+            }
+            break;
+        case Phase::MEASURE:
+            if (insts - phase_start >= sample_insts) {
+                Snapshot end = snapshot();
+                double cycles = end.cycles - begin.cycles;
+                double ipc = (end.insts - begin.insts) / cycles;
+                ipcs.push_back(ipc);
+                cpis.push_back(cycles / (end.insts - begin.insts));
+
+                long reads = end.reads - begin.reads;
+                long memory_cycles = end.memory_cycles - begin.memory_cycles;
+                double bandwidth = memory_cycles ?
+                    (end.bytes - begin.bytes) / (memory_cycles * memory.clk_ns()) : 0;
+                bandwidths.push_back(bandwidth);
+                if (reads) {
+                    double latency = double(end.read_latency - begin.read_latency) / reads * memory.clk_ns();
+                    read_latencies.push_back(latency);
+                    printf("Sample %zu: ipc %f, read latency %f ns, bandwidth %f GB/s\n",
+                        ipcs.size(), ipc, latency, bandwidth);
+                } else {
+                    printf("Sample %zu: ipc %f, no reads, bandwidth %f GB/s\n",
+                        ipcs.size(), ipc, bandwidth);
+                }
+
+                proc.drain();
+                phase = Phase::DRAIN;
+            }
+            break;
+        case Phase::DRAIN:
+            if (proc.is_drained() && memory.is_drained()) {
+                proc.resume();
+                warm();
+            }
+            break;
+    }
+}
+
+void Sampler::mean_ci(const vector<double>& values, double& mean, double& ci){
+    mean = ci = 0;
+    if (values.empty())
+        return;
+    for (double v : values)
+        mean += v;
+    mean /= values.size();
+    if (values.size() < 2)
+        return;
+    double var = 0;
+    for (double v : values)
+        var += (v - mean) * (v - mean);
+    var /= values.size() - 1;
+    // normal approximation, z = 1.96 for 95%
+    ci = 1.96 * sqrt(var / values.size());
+}
+
+void Sampler::finish(){
+    long total = detailed_insts() + warmed;
+    sampled_instructions = total;
+    sample_count = ipcs.size();
+    if (ipcs.empty()) {
+        cout << "No sample taken: the trace ended within the first "
+             << period_insts << " instructions" << endl;
+        return;
+    }
+
+    double mean, ci;
+    mean_ci(ipcs, mean, ci);
+    sample_ipc_mean = mean;
+    sample_ipc_ci = ci;
+    printf("-> sampled ipc: %f +- %f\n", mean, ci);
+    mean_ci(read_latencies, mean, ci);
+    sample_read_latency_mean = mean;
+    sample_read_latency_ci = ci;
+    printf("-> sampled read latency: %f +- %f ns\n", mean, ci);
+    mean_ci(bandwidths, mean, ci);
+    sample_bandwidth_mean = mean;
+    sample_bandwidth_ci = ci;
+    printf("-> sampled bandwidth: %f +- %f GB/s\n", mean, ci);
+
+    // the samples all have about sample_insts instructions, so the mean cpi
+    // scales to the cycles of the trace
+    mean_ci(cpis, mean, ci);
+    double cycle_ns = proc.pim_mode_enabled ? memory.clk_ns() : proc.cycle_time;
+    estimated_cpu_cycles = long(total * mean);
+    estimated_total_time = total * mean * cycle_ns;
+    printf("-> estimated cycles: %ld (%f ns) for %ld instructions\n",
+        long(total * mean), total * mean * cycle_ns, total);
+}
@@ -0,0 +1,93 @@
+#ifndef __SAMPLER_H
+#define __SAMPLER_H
+
+#include "Config.h"
+#include "Memory.h"
+#include "Processor.h"
+#include "Statistics.h"
+#include <vector>
+
+namespace ramulator
+{
+
+// Systematic sampling of a cpu trace (--sample-insts). Every
+// sample_period_insts instructions of all cores, the run is simulated in
+// detail for sample_warmup_insts instructions, which are not measured, and
+// then for sample_insts measured instructions. The rest of the period is
+// only functionally warmed: the caches, the page table and the open rows see
+// every access, but no time passes. The requests in flight drain before
+// each warming phase.
+//
+// Each sample is printed with its IPC, DRAM read latency and bandwidth. The
+// means over the samples, their 95% confidence intervals and the cycles and
+// time of the whole trace extrapolated from them are reported as statistics.
+class Sampler {
+public:
+    // registers the statistics, so only created for a sampled run
+    Sampler(const Config& configs, Processor& proc, MemoryBase& memory);
+    // warms the first period up to its detailed part
+    void start();
+    // called after every processor tick
+    void tick();
+    // true while the requests in flight drain: the tick in which they are
+    // done starts the functional warming, so no tick may be skipped
+    bool is_draining() const {return phase == Phase::DRAIN;}
+    // computes the statistics from the samples taken
+    void finish();
+
+private:
+    enum class Phase {
+        WARMUP,   // detailed, not measured
+        MEASURE,  // detailed and measured
+        DRAIN     // waits for the requests in flight before warming
+    } phase = Phase::WARMUP;
+
+    // counters at the start of a measured interval
+    struct Snapshot {
+        long cycles;
+        long insts;
+        long reads;
+        long read_latency;
+        long memory_cycles;
+        double bytes;
+    };
+
+    Processor& proc;
+    MemoryBase& memory;
+    long sample_insts;
+    long warmup_insts;
+    long period_insts;
+
+    // detailed instructions at the start of the current phase and period
+    long phase_start = 0;
+    long period_start = 0;
+    // functionally warmed instructions so far
+    long warmed = 0;
+    Snapshot begin;
+
+    std::vector<double> ipcs;
+    std::vector<double> cpis;
+    std::vector<double> read_latencies;  // ns, of the samples with reads
+    std::vector<double> bandwidths;      // GB/s
+
+    ScalarStat sample_count;
+    ScalarStat sample_ipc_mean;
+    ScalarStat sample_ipc_ci;
+    ScalarStat sample_read_latency_mean;
+    ScalarStat sample_read_latency_ci;
+    ScalarStat sample_bandwidth_mean;
+    ScalarStat sample_bandwidth_ci;
+    ScalarStat sampled_instructions;
+    ScalarStat estimated_cpu_cycles;
+    ScalarStat estimated_total_time;
+
+    long detailed_insts();
+    Snapshot snapshot();
+    void warm();
+    // mean and half width of the 95% confidence interval of values
+    static void mean_ci(const std::vector<double>& values, double& mean, double& ci);
+};
+
+} /*namespace ramulator*/
+
+#endif /*__SAMPLER_H*/
@@ -4,11 +4,13 @@
 #include "DRAM.h"
 #include "Request.h"
 #include "Controller.h"
+#include "RequestQueue.h"
 #include <vector>
 #include <map>
 #include <list>
 #include <functional>
 #include <cassert>
+#include <climits>
 
 using namespace std;
 
@@ -32,22 +34,26 @@ public:
 
     Scheduler(Controller<T>* ctrl) : ctrl(ctrl) {}
 
-    list<Request>::iterator get_head(list<Request>& q)
+    list<Request>::iterator get_head(RequestQueue<T>& queue)
     {
+      // most ticks of a lightly loaded controller find its queues empty
+      if (!queue.q.size())
+        return queue.q.end();
+
+      // FRFCFS_Cap counts row hits while it compares requests, so it always
+      // looks at every request
+      if (queue.indexed() && (type == Type::FRFCFS || type == Type::FRFCFS_PriorHit))
+        return get_indexed_head(queue);
+
+      list<Request>& q = queue.q;
       // TODO make the decision at compile time
       if (type != Type::FRFCFS_PriorHit) {
-        if (!q.size())
-            return q.end();
-
         auto head = q.begin();
         for (auto itr = next(q.begin(), 1); itr != q.end(); itr++)
             head = compare[int(type)](head, itr);
 
         return head;
       } else {
-        if (!q.size())
-            return q.end();
-
         auto head = q.begin();
         for (auto itr = next(q.begin(), 1); itr != q.end(); itr++) {
             head = compare[int(Type::FRFCFS_PriorHit)](head, itr);
@@ -105,6 +111,54 @@ public:
 
 private:
     typedef list<Request>::iterator ReqIter;
+
+    vector<bool> hit_rowgroups;
+
+    // Same choice as the list scan, made per group of requests to the same
+    // bank, row and type. The list is in arrival order, so the scan picks the
+    // first request (the lowest sequence number) that qualifies, and returning
+    // q.end() instead of a request that is not ready schedules nothing either.
+    ReqIter get_indexed_head(RequestQueue<T>& queue)
+    {
+      ReqIter head = queue.q.end();
+      long head_seq = LONG_MAX;
+      auto consider = [this, &head, &head_seq] (typename RequestQueue<T>::Group& group) {
+        auto& first = group.reqs.front();
+        if (first.first < head_seq && this->ctrl->is_ready(group.cmd, first.second->addr_vec)) {
+          head = first.second;
+          head_seq = first.first;
+        }
+      };
+
+      typedef typename RequestQueue<T>::Bank Bank;
+      typedef typename RequestQueue<T>::Group Group;
+      queue.for_each_group([&queue] (Bank& bank, Group& group) {queue.refresh(bank, group);});
+
+      if (type == Type::FRFCFS) {
+        queue.for_each_group([&consider] (Bank& bank, Group& group) {consider(group);});
+        return head;
+      }
+
+      // the earliest ready row hit first
+      hit_rowgroups.assign(queue.rowgroups, false);
+      queue.for_each_group([this, &consider] (Bank& bank, Group& group) {
+        if (group.hit) {
+          hit_rowgroups[bank.rowgroup] = true;
+          consider(group);
+        }
+      });
+      if (head != queue.q.end())
+        return head;
+
+      // then the earliest ready request whose PRE would not close a row that
+      // another request hits
+      queue.for_each_group([this, &consider] (Bank& bank, Group& group) {
+        if (group.hit || !group.open || !hit_rowgroups[bank.rowgroup])
+          consider(group);
+      });
+      return head;
+    }
+
     function<ReqIter(ReqIter, ReqIter)> compare[int(Type::MAX)] = {
         // FCFS
         [this] (ReqIter req1, ReqIter req2) {
@@ -218,14 +272,15 @@ public:
     };
 
     map<vector<int>, Entry> table;
+    vector<int> rowgroup;  // lookup key, kept to reuse its storage
 
     RowTable(Controller<T>* ctrl) : ctrl(ctrl) {}
 
-    void update(typename T::Command cmd, const vector<int>& addr_vec, long clk)
+    void update(typename T::Command cmd, const AddrVec& addr_vec, long clk)
     {
         auto begin = addr_vec.begin();
         auto end = begin + int(T::Level::Row);
-        vector<int> rowgroup(begin, end); // bank or subarray
+        rowgroup.assign(begin, end); // bank or subarray
         int row = *end;
 
         T* spec = ctrl->channel->spec;
@@ -258,12 +313,12 @@ public:
         } /* closing */
     }
 
-    int get_hits(vector<int>& addr_vec)
+    int get_hits(const AddrVec& addr_vec)
     {
         auto begin = addr_vec.begin();
         auto end = begin + int(T::Level::Row);
 
-        vector<int> rowgroup(begin, end);
+        rowgroup.assign(begin, end);
         int row = *end;
 
         auto itr = table.find(rowgroup);
@@ -72,6 +72,11 @@ class StatBase {
 
   virtual bool is_display() const  = 0;
   virtual bool is_nozero() const = 0;
+
+  virtual const std::string& get_name() const = 0;
+  // The current value, or the value of each element of a vector. Left
+  // empty by the statistics that are not counters.
+  virtual void values(VCounter& vec) const { vec.clear(); }
 };
 
 class StatList {
@@ -88,6 +93,7 @@ class StatList {
       assert(false && "!stat_output.good()");
     }
   }
+  const std::vector<StatBase*>& get_list() const {return list;}
   void printall() {
     for(off_type i = 0 ; i < list.size() ; ++i) {
       if (!list[i]) {
@@ -153,6 +159,8 @@ class Stat : public StatBase {
   }
   const std::string& setSeparator() const {return separatorString;}
 
+  const std::string& get_name() const {return _name;}
+
   size_type size() const { return 0; }
 
   virtual void print(std::ofstream& file) {};
@@ -184,6 +192,7 @@ class ScalarBase: public Stat<ScalarType> {
 
   size_type size() const {return 1;}
   VResult vresult() const {return VResult(1, result());}
+  void values(VCounter& vec) const {vec.assign(1, value());}
 
   virtual void print(std::ofstream& file) {
     Stat<ScalarType>::printname(file);
@@ -323,7 +332,7 @@ class VectorBase: public Stat<Derived> {
     data.resize(size());
     for (off_type i = 0 ; i < size() ; ++i) {
       data[i].flags(0)
-             .name("[" + std::string(1, char(i + '0')) + "]");
+             .name("[" + std::to_string(i) + "]");
     }
   }
   size_type size() const {return _size;}
@@ -334,6 +343,7 @@ class VectorBase: public Stat<Derived> {
       vec[i] = data[i].value();
     }
   }
+  void values(VCounter& vec) const {value(vec);}
   // Copy the results to a local vector and return a reference to it.
   void result(VResult& vec) const {
     vec.resize(size());
@@ -42,6 +42,27 @@
 
 namespace ramulator {
 
+// Prepended to the names of the statistics registered while it is in scope,
+// to tell apart the statistics of two instances of a component (e.g., the
+// processors of the host and of the PIM cores in one run)
+class StatNamePrefix {
+  public:
+    StatNamePrefix(const std::string& _prefix) : saved(prefix()) {
+      prefix() = _prefix;
+    }
+    ~StatNamePrefix() {
+      prefix() = saved;
+    }
+
+    static std::string& prefix() {
+      static std::string current;
+      return current;
+    }
+
+  private:
+    std::string saved;
+};
+
 template<class StatType>
 class StatBase { // wrapper for Stats::DataWrap
   protected:
@@ -68,8 +89,8 @@ class StatBase { // wrapper for Stats::DataWrap
     }
 
     StatBase<StatType> & name(std::string _name) {
-      statName = _name;
-      stat.name("ramulator." + _name);
+      statName = StatNamePrefix::prefix() + _name;
+      stat.name("ramulator." + statName);
 
       return self();
     }
@@ -0,0 +1,57 @@
+#include "TickPool.h"
+
+using namespace std;
+using namespace ramulator;
+
+TickPool::TickPool(int shards, function<void(int)> work)
+    : shards(shards), work(work), generation(0), running(0), stopping(false){
+    // busy-wait first, the next run usually starts within a few microseconds,
+    // unless the shards have to share cores
+    if (int(thread::hardware_concurrency()) >= shards)
+        spins_before_sleep = 4096;
+    for (int shard = 1; shard < shards; shard++)
+        workers.emplace_back(&TickPool::worker, this, shard);
+}
+
+TickPool::~TickPool(){
+    stopping.store(true, memory_order_release);
+    generation.fetch_add(1, memory_order_release);
+    wake_all();
+    for (auto& thread : workers)
+        thread.join();
+}
+
+void TickPool::run(){
+    running.store(shards - 1, memory_order_relaxed);
+    // publishes everything the simulation thread wrote since the last run
+    generation.fetch_add(1, memory_order_release);
+    wake_all();
+    work(0);
+    wait_until([this]{ return running.load(memory_order_acquire) == 0; });
+}
+
+void TickPool::worker(int shard){
+    long seen = 0;
+    while (true) {
+        wait_until([this, seen]{ return generation.load(memory_order_acquire) != seen; });
+        seen++;
+        if (stopping.load(memory_order_acquire))
+            return;
+        work(shard);
+        if (running.fetch_sub(1, memory_order_acq_rel) == 1)
+            wake_all();
+    }
+}
+
+void TickPool::wait_until(function<bool()> ready){
+    for (int spins = 0; spins < spins_before_sleep; spins++)
+        if (ready()) return;
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, ready);
+}
+
+void TickPool::wake_all(){
+    // taking the lock orders the change before a sleeper's last check
+    { lock_guard<mutex> guard(lock); }
+    changed.notify_all();
+}
@@ -0,0 +1,48 @@
+#ifndef __TICK_POOL_H
+#define __TICK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ramulator
+{
+
+// Runs a fixed number of shards of work on worker threads in lock step with
+// the simulation loop. run() starts every shard once, runs shard 0 on the
+// calling thread and returns when all shards have finished, so the caller
+// sees the effects of every shard as if they had run one after another.
+// Waiting threads spin for a while before they sleep, since a run lasts about
+// one memory cycle, and sleep right away when there are fewer cores than
+// shards.
+class TickPool {
+public:
+    TickPool(int shards, std::function<void(int)> work);
+    TickPool(const TickPool&) = delete;
+    TickPool& operator=(const TickPool&) = delete;
+    ~TickPool();
+
+    void run();
+    int get_shards() const {return shards;}
+
+private:
+    void worker(int shard);
+    void wait_until(std::function<bool()> ready);
+    void wake_all();
+
+    int shards;
+    int spins_before_sleep = 0;
+    std::function<void(int)> work;
+    std::vector<std::thread> workers;
+    std::atomic<long> generation;  // incremented to start a run
+    std::atomic<int> running;      // shards of the current run still working
+    std::atomic<bool> stopping;
+    std::mutex lock;
+    std::condition_variable changed;
+};
+
+}
+#endif /* __TICK_POOL_H */
@@ -0,0 +1,142 @@
+#include "TimeSeries.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace ramulator;
+
+const char TimeSeries::magic[8] = {'R', 'A', 'M', 'S', 'E', 'R', 'I', 'E'};
+
+// per-vault or per-channel traffic, row buffer locality, queue occupancy and
+// the instructions of each core
+static const char* default_select =
+    "cpu_cycles,cpu_instructions_core_*,read_transaction_bytes,write_transaction_bytes,"
+    "incoming_requests_per_channel,incoming_read_reqs_per_channel,"
+    "row_hits,row_misses,row_conflicts,read_req_queue_length_sum,write_req_queue_length_sum";
+
+// rows are written in blocks of about this size
+static const size_t block_size = 1 << 20;
+
+TimeSeries::TimeSeries(const Config& configs)
+    : fname(configs["stats_series"]){
+    epoch = configs.contains("stats_epoch") ? configs.get_int_value("stats_epoch") : 100000;
+    if (epoch <= 0) {
+        cerr << "stats_epoch must be positive" << endl;
+        exit(1);
+    }
+
+    select_given = configs["stats_series_select"] != "";
+    stringstream names(select_given ? configs["stats_series_select"] : default_select);
+    string name;
+    while (getline(names, name, ',')) {
+        if (name != "")
+            select.push_back(name);
+    }
+
+    file.open(fname, ios::out | ios::trunc | ios::binary);
+    if (!file.good()) {
+        cerr << "Bad stats series file: " << fname << endl;
+        exit(1);
+    }
+}
+
+TimeSeries::~TimeSeries(){
+    flush();
+}
+
+void TimeSeries::open(){
+    opened = true;
+    auto& list = Stats::statlist.get_list();
+    for (auto& name : select) {
+        bool prefix = name.back() == '*';
+        string full = "ramulator." + (prefix ? name.substr(0, name.size() - 1) : name);
+        bool found = false;
+        for (auto stat : list) {
+            if (!stat)
+                continue;
+            const string& stat_name = stat->get_name();
+            if (prefix ? stat_name.compare(0, full.size(), full) != 0 : stat_name != full)
+                continue;
+            stat->values(values);
+            if (values.empty())
+                continue;
+            stats.push_back(stat);
+            found = true;
+        }
+        if (!found && select_given) {
+            cerr << "No statistic for stats_series_select: " << name << endl;
+            exit(1);
+        }
+    }
+
+    uint32_t columns = stats.size();
+    uint64_t epoch_cycles = epoch;
+    uint32_t file_version = version;
+    write(magic, sizeof(magic));
+    write(&file_version, sizeof(file_version));
+    write(&columns, sizeof(columns));
+    write(&epoch_cycles, sizeof(epoch_cycles));
+    last.resize(stats.size());
+    for (unsigned i = 0; i < stats.size(); i++) {
+        string name = stats[i]->get_name().substr(strlen("ramulator."));
+        stats[i]->values(last[i]);
+        uint32_t width = last[i].size();
+        uint32_t length = name.size();
+        write(&width, sizeof(width));
+        write(&length, sizeof(length));
+        write(name.data(), length);
+        // the first row holds the counts from the start of the run
+        fill(last[i].begin(), last[i].end(), 0);
+    }
+}
+
+void TimeSeries::dump(){
+    if (!opened)
+        open();
+    if (before_dump)
+        before_dump();
+
+    uint64_t cycle = clk;
+    write(&cycle, sizeof(cycle));
+    for (unsigned i = 0; i < stats.size(); i++) {
+        stats[i]->values(values);
+        assert(values.size() == last[i].size());
+        for (unsigned j = 0; j < values.size(); j++) {
+            double delta = values[j] - last[i][j];
+            write(&delta, sizeof(delta));
+        }
+        last[i].swap(values);
+    }
+    last_dump = clk;
+    if (buffer.size() >= block_size)
+        flush();
+}
+
+void TimeSeries::finish(){
+    if (clk != last_dump)
+        dump();
+    else if (!opened)
+        open();
+    flush();
+}
+
+void TimeSeries::write(const void* data, size_t size){
+    const char* bytes = (const char*) data;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void TimeSeries::flush(){
+    if (buffer.empty())
+        return;
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    if (!file.good()) {
+        cerr << "Could not write stats series file: " << fname << endl;
+        exit(1);
+    }
+    buffer.clear();
+}
@@ -0,0 +1,83 @@
+#ifndef __TIMESERIES_H
+#define __TIMESERIES_H
+
+#include "Config.h"
+#include "Statistics.h"
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ramulator
+{
+
+// Follows selected statistics during the run (--stats-series). Every
+// stats_epoch memory cycles, the change of each statistic since the previous
+// epoch is appended as one row of a binary table, the way zsim's HDF5 backend
+// writes one record per dump. Rows are buffered and written in large blocks.
+//
+// The file starts with a header:
+//   char magic[8] = "RAMSERIE", uint32 version, uint32 columns, uint64 epoch
+//   per column: uint32 width (elements of a vector, 1 for a scalar),
+//               uint32 length of the name, the name
+// followed by fixed-size rows: the uint64 memory cycle at the end of the
+// epoch, then one double per element of each column. The last row covers the
+// partial epoch at the end of the run.
+//
+// stats_series_select lists the statistics as a comma-separated list of
+// names; a name ending in '*' selects every statistic starting with it.
+class TimeSeries {
+public:
+    static const char magic[8];
+    static const uint32_t version = 1;
+
+    TimeSeries(const Config& configs);
+    ~TimeSeries();
+
+    // called before the statistics are read, to gather the counts of
+    // controllers ticked by worker threads
+    std::function<void()> before_dump;
+
+    void tick() {
+        if (++clk % epoch == 0) dump();
+    }
+    // ticks up to and including the next one that writes a row
+    long ticks_to_dump() const {return epoch - clk % epoch;}
+    void skip(long cycles) {
+        long until = clk + cycles;
+        for (long end = (clk / epoch + 1) * epoch; end <= until; end += epoch) {
+            clk = end;
+            dump();
+        }
+        clk = until;
+    }
+    // appends the partial last epoch and writes the file
+    void finish();
+
+private:
+    std::string fname;
+    std::ofstream file;
+    long epoch;
+    long clk = 0;
+    long last_dump = -1;
+    bool opened = false;
+    std::vector<std::string> select;
+    bool select_given;
+
+    std::vector<Stats::StatBase*> stats;
+    std::vector<Stats::VCounter> last;
+    Stats::VCounter values;
+    std::vector<char> buffer;
+
+    // resolves the selected statistics and writes the header; done at the
+    // first row, once the processor has registered its statistics
+    void open();
+    void dump();
+    void write(const void* data, size_t size);
+    void flush();
+};
+
+} /*namespace ramulator*/
+
+#endif /*__TIMESERIES_H*/
@@ -0,0 +1,99 @@
+#include "Processor.h"
+#include "Config.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+/*
+ * ramulator-trace-convert: converts a text trace (zsim, pisa, pin or DRAM
+ * trace) into the binary trace format read by Trace (see BinaryTraceHeader
+ * in Processor.h). The binary trace is used by passing --trace-format binary
+ * to ramulator.
+ */
+
+using namespace std;
+using namespace ramulator;
+namespace po = boost::program_options;
+
+int main(int argc, const char *argv[])
+{
+    po::options_description desc;
+    desc.add_options()
+      ("help", "print simple manual")
+      ("trace-format", po::value<string>(), "format of the input trace: zsim, pisa, pin or dram")
+      ("input", po::value<string>(), "text trace to convert")
+      ("output", po::value<string>(), "binary trace to write")
+       ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (argc < 2 || vm.count("help")) {
+      cout << desc << "\n";
+      return 1;
+    }
+    if (!vm.count("trace-format") || !vm.count("input") || !vm.count("output")) {
+      cout << "--trace-format, --input and --output are required." << endl;
+      return 1;
+    }
+
+    Config::Format format;
+    const string& format_str = vm["trace-format"].as<string>();
+    if (format_str == "zsim") {
+      format = Config::Format::ZSIM;
+    } else if (format_str == "pisa") {
+      format = Config::Format::PISA;
+    } else if (format_str == "pin") {
+      format = Config::Format::PIN;
+    } else if (format_str == "dram") {
+      format = Config::Format::DRAM;
+    } else {
+      cout << "invalid trace format: " << format_str << endl;
+      return 1;
+    }
+
+    Trace trace;
+    // read the whole trace once, do not start over at its end
+    trace.pim_mode_enabled = true;
+    if (!trace.init_trace(vm["input"].as<string>())) {
+      return 1;
+    }
+    if (trace.is_binary()) {
+      cout << "input trace is already binary" << endl;
+      return 1;
+    }
+
+    const string& output = vm["output"].as<string>();
+    ofstream out(output, ios::out | ios::binary);
+    if (!out.good()) {
+      cerr << "Bad output file: " << output << endl;
+      return 1;
+    }
+
+    BinaryTraceHeader header;
+    memcpy(header.magic, Trace::binary_magic, sizeof(header.magic));
+    header.version = Trace::binary_version;
+    header.format = uint32_t(format);
+    out.write((const char*) &header, sizeof(header));
+
+    // records are written in blocks
+    vector<char> block;
+    block.reserve(1 << 16);
+    long converted = 0;
+    BinaryTraceRecord record, previous = BinaryTraceRecord();
+    while (trace.get_record(format, record)) {
+      Trace::encode_record(record, previous, block);
+      if (block.size() >= (1 << 16) - 64) {
+        out.write(block.data(), block.size());
+        block.clear();
+      }
+      converted++;
+    }
+    out.write(block.data(), block.size());
+    out.close();
+
+    cout << "Converted " << converted << " records to " << output << endl;
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include "TraceStream.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <lzma.h>
+#include <zlib.h>
+#ifdef RAMULATOR_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+using namespace ramulator;
+
+namespace {
+
+// Fills out with up to size decompressed bytes. Returns the number of bytes
+// written, 0 at the end of the stream and -1 if the stream is corrupt or
+// truncated.
+struct Decoder {
+    virtual ~Decoder() {}
+    virtual long read(char* out, size_t size) = 0;
+};
+
+class GzipDecoder : public Decoder {
+public:
+    GzipDecoder(const char* input, size_t size) : next(input), remaining(size) {
+        memset(&zs, 0, sizeof(zs));
+        // 32: accept both gzip and zlib headers
+        ok = (inflateInit2(&zs, 15 + 32) == Z_OK);
+    }
+    ~GzipDecoder() { inflateEnd(&zs); }
+
+    long read(char* out, size_t size) {
+        if (!ok) return -1;
+        zs.next_out = (Bytef*) out;
+        zs.avail_out = size;
+        while (zs.avail_out > 0 && !finished) {
+            if (zs.avail_in == 0) {
+                if (remaining == 0) {
+                    // the input ended inside a gzip member
+                    if (zs.avail_out == size) return -1;
+                    break;
+                }
+                // avail_in is 32 bits wide, feed large files in pieces
+                size_t n = min(remaining, size_t(UINT_MAX));
+                zs.next_in = (Bytef*) next;
+                zs.avail_in = n;
+                next += n;
+                remaining -= n;
+            }
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // concatenated gzip members form one trace
+                if (zs.avail_in == 0 && remaining == 0) finished = true;
+                else inflateReset(&zs);
+            }
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                return -1;
+            }
+        }
+        return size - zs.avail_out;
+    }
+
+private:
+    z_stream zs;
+    const char* next;
+    size_t remaining;
+    bool ok;
+    bool finished = false;
+};
+
+class XzDecoder : public Decoder {
+public:
+    XzDecoder(const char* input, size_t size) {
+        ok = (lzma_stream_decoder(&xz, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK);
+        xz.next_in = (const uint8_t*) input;
+        xz.avail_in = size;
+    }
+    ~XzDecoder() { lzma_end(&xz); }
+
+    long read(char* out, size_t size) {
+        if (!ok) return -1;
+        xz.next_out = (uint8_t*) out;
+        xz.avail_out = size;
+        while (xz.avail_out > 0 && !finished) {
+            lzma_ret ret = lzma_code(&xz, LZMA_FINISH);
+            if (ret == LZMA_STREAM_END) finished = true;
+            else if (ret != LZMA_OK) return -1;
+        }
+        return size - xz.avail_out;
+    }
+
+private:
+    lzma_stream xz = LZMA_STREAM_INIT;
+    bool ok;
+    bool finished = false;
+};
+
+#ifdef RAMULATOR_ZSTD
+class ZstdDecoder : public Decoder {
+public:
+    ZstdDecoder(const char* input, size_t size) {
+        zstd = ZSTD_createDStream();
+        ZSTD_initDStream(zstd);
+        in.src = input;
+        in.size = size;
+        in.pos = 0;
+    }
+    ~ZstdDecoder() { ZSTD_freeDStream(zstd); }
+
+    long read(char* out, size_t size) {
+        ZSTD_outBuffer buffer = {out, size, 0};
+        while (buffer.pos < buffer.size) {
+            // every frame is decoded and flushed
+            if (in.pos == in.size && frame_end) break;
+            size_t before_in = in.pos, before_out = buffer.pos;
+            size_t ret = ZSTD_decompressStream(zstd, &buffer, &in);
+            if (ZSTD_isError(ret)) return -1;
+            frame_end = (ret == 0);
+            if (in.pos == before_in && buffer.pos == before_out) {
+                // the input ended inside a frame
+                if (buffer.pos == 0) return -1;
+                break;
+            }
+        }
+        return buffer.pos;
+    }
+
+private:
+    ZSTD_DStream* zstd;
+    ZSTD_inBuffer in;
+    bool frame_end = true;
+};
+#endif
+
+}
+
+TraceStream::Codec TraceStream::detect(const char* data, size_t size){
+    const unsigned char* magic = (const unsigned char*) data;
+    if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return Codec::GZIP;
+    if (size >= 6 && memcmp(magic, "\xfd" "7zXZ\0", 6) == 0)
+        return Codec::XZ;
+    if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return Codec::ZSTD;
+    return Codec::NONE;
+}
+
+const char* TraceStream::codec_name(Codec codec){
+    switch (int(codec)) {
+        case int(Codec::GZIP): return "gzip";
+        case int(Codec::XZ): return "xz";
+        case int(Codec::ZSTD): return "zstd";
+        default: return "none";
+    }
+}
+
+TraceStream::TraceStream(const char* input, size_t input_size, Codec codec,
+                         size_t block_size, int number_blocks)
+    : input(input), input_size(input_size), codec(codec),
+      blocks(number_blocks, vector<char>(block_size)), filled(number_blocks, 0){
+#ifndef RAMULATOR_ZSTD
+    if (codec == Codec::ZSTD) {
+        std::cerr << "zstd traces need ramulator built with ZSTD=1" << std::endl;
+        exit(1);
+    }
+#endif
+    start();
+}
+
+TraceStream::~TraceStream(){
+    stop();
+}
+
+void TraceStream::start(){
+    head = tail = load = 0;
+    holding = done = failed = stopping = false;
+    worker = std::thread(&TraceStream::decompress, this);
+}
+
+void TraceStream::stop(){
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stopping = true;
+    }
+    block_free.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void TraceStream::restart(){
+    stop();
+    start();
+}
+
+bool TraceStream::next_block(const char*& begin, const char*& end){
+    std::unique_lock<std::mutex> guard(lock);
+    if (holding) {
+        head = (head + 1) % blocks.size();
+        load--;
+        holding = false;
+        block_free.notify_one();
+    }
+    block_ready.wait(guard, [this]{ return load > 0 || done; });
+    if (load == 0) {
+        if (failed) {
+            std::cerr << "Corrupt or truncated " << codec_name(codec) << " trace" << std::endl;
+            exit(1);
+        }
+        return false;
+    }
+    holding = true;
+    begin = blocks[head].data();
+    end = begin + filled[head];
+    return true;
+}
+
+void TraceStream::decompress(){
+    std::unique_ptr<Decoder> decoder;
+    switch (int(codec)) {
+        case int(Codec::GZIP): decoder.reset(new GzipDecoder(input, input_size)); break;
+        case int(Codec::XZ): decoder.reset(new XzDecoder(input, input_size)); break;
+#ifdef RAMULATOR_ZSTD
+        case int(Codec::ZSTD): decoder.reset(new ZstdDecoder(input, input_size)); break;
+#endif
+        default: break;
+    }
+
+    bool end_of_stream = (decoder == nullptr);
+    bool error = false;
+    while (!end_of_stream && !error) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            block_free.wait(guard, [this]{ return load < int(blocks.size()) || stopping; });
+            if (stopping) return;
+        }
+        // blocks[tail] is not visible to the parser until it is published below
+        vector<char>& block = blocks[tail];
+        size_t size = 0;
+        while (size < block.size()) {
+            long n = decoder->read(block.data() + size, block.size() - size);
+            if (n < 0) {
+                error = true;
+                break;
+            }
+            if (n == 0) {
+                end_of_stream = true;
+                break;
+            }
+            size += n;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        if (size > 0) {
+            filled[tail] = size;
+            tail = (tail + 1) % blocks.size();
+            load++;
+        }
+        block_ready.notify_one();
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    done = true;
+    failed = error;
+    block_ready.notify_one();
+}
@@ -0,0 +1,62 @@
+#ifndef __TRACE_STREAM_H
+#define __TRACE_STREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ramulator
+{
+
+// Decompresses a compressed trace (gzip, xz or zstd) on a background thread
+// into a ring of fixed-size blocks. The trace parser reads the blocks in
+// place, so a compressed trace never has to be decompressed to disk first.
+class TraceStream {
+public:
+    enum class Codec {
+        NONE, GZIP, XZ, ZSTD
+    };
+
+    // detects the codec from the first bytes of a file
+    static Codec detect(const char* data, size_t size);
+    static const char* codec_name(Codec codec);
+
+    TraceStream(const char* input, size_t input_size, Codec codec,
+                size_t block_size = 1 << 22, int number_blocks = 4);
+    ~TraceStream();
+
+    // releases the block returned by the previous call and returns the next
+    // one, false at the end of the stream
+    bool next_block(const char*& begin, const char*& end);
+    // starts decompressing from the beginning of the input again
+    void restart();
+
+private:
+    void start();
+    void stop();
+    void decompress();
+
+    const char* input;
+    size_t input_size;
+    Codec codec;
+
+    std::vector<std::vector<char>> blocks;
+    std::vector<size_t> filled;
+    int head = 0;   // next block handed to the parser
+    int tail = 0;   // next block filled by the decompressor
+    int load = 0;
+    bool holding = false;   // the parser is reading blocks[head]
+    bool done = false;
+    bool failed = false;
+    bool stopping = false;
+
+    std::mutex lock;
+    std::condition_variable block_ready;
+    std::condition_variable block_free;
+    std::thread worker;
+};
+
+}
+#endif /* __TRACE_STREAM_H */
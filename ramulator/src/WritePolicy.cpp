@@ -0,0 +1,34 @@
+#include "WritePolicy.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+using namespace ramulator;
+
+string WritePolicy::drain_name[int(Drain::MAX)] = {
+    "watermark", "eager", "row_hit"
+};
+
+WritePolicy::WritePolicy(const Config& configs){
+    string name = configs["write_drain"];
+    if (name != "") {
+        int i = 0;
+        while (i < int(Drain::MAX) && name != drain_name[i])
+            i++;
+        if (i == int(Drain::MAX)) {
+            cerr << "Unknown write_drain: " << name << endl;
+            exit(1);
+        }
+        drain = Drain(i);
+    }
+    if (configs.contains("write_high_watermark"))
+        high_watermark = configs.get_int_value("write_high_watermark");
+    if (configs.contains("write_low_watermark"))
+        low_watermark = configs.get_int_value("write_low_watermark");
+    if (low_watermark < 0 || low_watermark > high_watermark || high_watermark > 100) {
+        cerr << "write_low_watermark and write_high_watermark must be percents, "
+             << "the low one no higher than the high one" << endl;
+        exit(1);
+    }
+    coalescing = configs["write_coalescing"] == "on";
+}
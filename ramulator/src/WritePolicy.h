@@ -0,0 +1,46 @@
+#ifndef __WRITE_POLICY_H
+#define __WRITE_POLICY_H
+
+#include "Config.h"
+#include <string>
+
+namespace ramulator
+{
+
+// How a memory controller buffers and drains its writes, set up in the
+// configuration file:
+//   write_drain = watermark|eager|row_hit
+//   write_high_watermark  percent of the write queue that starts a drain (80)
+//   write_low_watermark   percent of the write queue that ends it (20)
+//   write_coalescing = on|off  (off)
+//
+// The controller drains writes from when the write queue reaches the high
+// watermark (or the read queue is empty) until it is back to the low
+// watermark (and a read is queued). With write coalescing, a write to an
+// address that already has a write queued only updates the data of that
+// write, so it takes no entry and no DRAM command.
+class WritePolicy {
+public:
+    enum class Drain {
+        Watermark,  // only between the watermarks
+        Eager,      // also when no read can issue, a write that can
+        RowHit,     // at the low watermark, only once no queued write is a row hit
+        MAX
+    };
+    static std::string drain_name[int(Drain::MAX)];
+
+    Drain drain = Drain::Watermark;
+    int high_watermark = 80;
+    int low_watermark = 20;
+    bool coalescing = false;
+
+    WritePolicy(const Config& configs);
+
+    // the watermarks of a write queue of max entries
+    unsigned int high(unsigned int max) const {return max * high_watermark / 100;}
+    unsigned int low(unsigned int max) const {return max * low_watermark / 100;}
+};
+
+} /*namespace ramulator*/
+
+#endif /*__WRITE_POLICY_H*/
@@ -0,0 +1,88 @@
+#include <map>
+
+#include "ZsimWrapper.h"
+#include "Config.h"
+#include "Request.h"
+#include "MemoryFactory.h"
+#include "Memory.h"
+#include "HMC_Memory.h"
+#include "Statistics.h"
+#include "DDR3.h"
+#include "DDR4.h"
+#include "LPDDR3.h"
+#include "LPDDR4.h"
+#include "GDDR5.h"
+#include "WideIO.h"
+#include "WideIO2.h"
+#include "HBM.h"
+#include "HMC.h"
+#include "SALP.h"
+#include "ALDRAM.h"
+
+using namespace ramulator;
+
+static map<string, function<MemoryBase *(Config&, int)> > name_to_func = {
+    {"DDR3", &MemoryFactory<DDR3>::create}, {"DDR4", &MemoryFactory<DDR4>::create},
+    {"LPDDR3", &MemoryFactory<LPDDR3>::create}, {"LPDDR4", &MemoryFactory<LPDDR4>::create},
+    {"GDDR5", &MemoryFactory<GDDR5>::create},
+    {"WideIO", &MemoryFactory<WideIO>::create}, {"WideIO2", &MemoryFactory<WideIO2>::create},
+    {"HBM", &MemoryFactory<HBM>::create},
+    {"SALP-1", &MemoryFactory<SALP>::create}, {"SALP-2", &MemoryFactory<SALP>::create}, {"SALP-MASA", &MemoryFactory<SALP>::create},
+    {"ALDRAM", &MemoryFactory<ALDRAM>::create},
+    {"HMC", &MemoryFactory<HMC>::create},
+};
+
+
+ZsimWrapper::ZsimWrapper(const char* config_file, const char* stats_file, int cores, int cacheline,
+        ReadDone read_done, void* arg)
+    : read_done(read_done), arg(arg)
+{
+    Config configs(config_file);
+    const string& std_name = configs["standard"];
+    assert(name_to_func.find(std_name) != name_to_func.end() && "unrecognized standard name");
+    configs.set_core_num(cores);
+    if (configs["unlimit_bandwidth"] == "true") {
+      configs.set("speed", configs["speed"] + "_unlimit_bandwidth");
+    }
+    // zsim runs inside Pin, which does not allow threads of our own
+    configs.set("controller_threads", "1");
+
+    Stats::statlist.output(stats_file);
+    mem = name_to_func[std_name](configs, cacheline);
+    tCK = mem->clk_ns();
+}
+
+
+ZsimWrapper::~ZsimWrapper() {
+    delete mem;
+}
+
+void ZsimWrapper::tick()
+{
+    mem->tick();
+    Stats::curTick++; // memory clock, global, for Statistics
+}
+
+bool ZsimWrapper::send(long addr, bool write, int coreid)
+{
+    Request req(addr, write ? Request::Type::WRITE : Request::Type::READ,
+        Request::Callback::member<ZsimWrapper, &ZsimWrapper::read_complete>(this), coreid);
+    // the HMC clears the address bits above its capacity
+    req.initial_addr = addr;
+    return mem->send(req);
+}
+
+int ZsimWrapper::pending_requests()
+{
+    return mem->pending_requests();
+}
+
+void ZsimWrapper::read_complete(Request& req)
+{
+    read_done(arg, req.initial_addr);
+}
+
+void ZsimWrapper::finish(void) {
+    mem->finish();
+    Stats::statlist.printall();
+}
@@ -0,0 +1,41 @@
+#ifndef __ZSIM_WRAPPER_H
+#define __ZSIM_WRAPPER_H
+
+namespace ramulator
+{
+
+class Request;
+class MemoryBase;
+
+// Ramulator as the main memory of zsim (sys.mem.type = "Ramulator"), built
+// into libramulator.so. zsim is compiled with the old libstdc++ string ABI,
+// so nothing of the standard library crosses this interface: requests are
+// plain addresses and a completed read is reported to read_done with the
+// address it was sent with. Writes are posted and do not complete.
+class ZsimWrapper
+{
+public:
+    typedef void (*ReadDone)(void* arg, long addr);
+
+private:
+    MemoryBase *mem;
+    ReadDone read_done;
+    void* arg;
+
+    void read_complete(Request& req);
+
+public:
+    double tCK;
+    ZsimWrapper(const char* config_file, const char* stats_file, int cores, int cacheline,
+            ReadDone read_done, void* arg);
+    ~ZsimWrapper();
+    void tick();
+    bool send(long addr, bool write, int coreid);
+    int pending_requests();
+    // writes the statistics to stats_file
+    void finish(void);
+};
+
+} /*namespace ramulator*/
+
+#endif /*__ZSIM_WRAPPER_H*/
@@ -13,5 +13,7 @@ apt-get -y install byacc
 apt-get -y install libhdf5-dev
 apt-get -y install libelf-dev
 apt-get -y install libxerces-c-dev
+apt-get -y install zlib1g-dev
+apt-get -y install liblzma-dev
 
 ln -s /usr/include/asm-generic /usr/include/asm
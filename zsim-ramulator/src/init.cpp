@@ -60,6 +60,7 @@
 #include "process_stats.h"
 #include "process_tree.h"
 #include "profile_stats.h"
+#include "ramulator_mem_ctrl.h"
 #include "repl_policies.h"
 #include "scheduler.h"
 #include "simple_core.h"
@@ -373,6 +374,12 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         string outputDir = config.get<const char*>("sys.mem.outputDir");
         string traceName = config.get<const char*>("sys.mem.traceName");
         mem = new DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
+    } else if (type == "Ramulator") {
+        string configFile = config.get<const char*>("sys.mem.configFile");
+        string statsFile = config.get<const char*>("sys.mem.statsFile", "ramulator.stats");
+        // memory cycles per core cycle, 0 derives it from the DRAM standard
+        double clockRatio = config.get<double>("sys.mem.clockRatio", 0.0);
+        mem = new RamulatorMemory(configFile, statsFile, frequency, clockRatio, latency, domain, name);
     } else if (type == "Detailed") {
         // FIXME(dsm): Don't use a separate config file... see DDRMemory
         g_string mcfg = config.get<const char*>("sys.mem.paramFile", "");
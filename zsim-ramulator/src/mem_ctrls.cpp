@@ -70,7 +70,6 @@ uint64_t MemoryTraces::access(MemReq& req) {
             *req.state = req.is(MemReq::NOEXCL)? S : E;
             //LOIS
             if(print_trace){
-	        futex_lock(&traceLock);
 		if(!req.is(MemReq::IFETCH)){
 			if((!req.is(MemReq::PREFETCH_TRACE)) && (!req.is(MemReq::PREFETCH))) substract[req.coreId]++; 
 			int64_t pinstr = previous_instr[req.coreId];
@@ -81,18 +80,16 @@ uint64_t MemoryTraces::access(MemReq& req) {
 				pinstr = pinstr - substract[req.coreId];
 				substract[req.coreId] = 0;
 			}
-			if(req.is(MemReq::PREFETCH_TRACE) || req.is(MemReq::PREFETCH)) tracefile << threadIdx[req.coreId] << " " << req.coreId << " " << pinstr << " P " << req.lineAddr << std::endl;
-			else tracefile  << threadIdx[req.coreId] << " " << req.coreId  << " " << pinstr << " L " << req.lineAddr << std::endl;
+			char type = (req.is(MemReq::PREFETCH_TRACE) || req.is(MemReq::PREFETCH))? 'P' : 'L';
+			tracefile.write({threadIdx[req.coreId], pinstr, req.lineAddr, (uint32_t)req.coreId, -1, type});
 			previous_instr[req.coreId] = 0;
 		}
-		futex_unlock(&traceLock);        
             }
             break;
         case GETX:
             *req.state = M;
             //LOIS
 	    if(print_trace){
-		    futex_lock(&traceLock);        
 		    if(!req.is(MemReq::IFETCH)){
 			    int64_t pinstr = previous_instr[req.coreId];
 			    if((!req.is(MemReq::PREFETCH_TRACE)) && (!req.is(MemReq::PREFETCH))) substract[req.coreId]++;
@@ -103,11 +100,10 @@ uint64_t MemoryTraces::access(MemReq& req) {
 				    pinstr = pinstr - substract[req.coreId];
 				    substract[req.coreId] = 0;
 			    }
-			    if(req.is(MemReq::PREFETCH_TRACE) || req.is(MemReq::PREFETCH)) tracefile << threadIdx[req.coreId]<< " " << req.coreId << " " << pinstr << " P " << req.lineAddr << std::endl;
-			    else  tracefile << threadIdx[req.coreId]<< " " << req.coreId << " " << pinstr << " S " << req.lineAddr << std::endl;
+			    char type = (req.is(MemReq::PREFETCH_TRACE) || req.is(MemReq::PREFETCH))? 'P' : 'S';
+			    tracefile.write({threadIdx[req.coreId], pinstr, req.lineAddr, (uint32_t)req.coreId, -1, type});
 			    previous_instr[req.coreId] = 0;
 		    }
-		    futex_unlock(&traceLock);        
 	    }
             break;
         
@@ -138,12 +134,10 @@ uint64_t MemoryTraces::offload(offloadInfo offData){
 	//printf("offloading: %ld\n", offData.content);
   } else if(offData.msg == INSTR_COUNT){
 	//printf("core: %ld instrs: %ld\n", offData.coreIdx, offData.inter_instrs);
-	futex_lock(&traceLock);        
 	previous_instr[offData.coreIdx] += offData.inter_instrs;
-	total_instructions += offData.inter_instrs;
+	__sync_fetch_and_add(&total_instructions, offData.inter_instrs);
 	//printf("tota instructions: %lld\n",(long long int)total_instructions);
 	threadIdx[offData.coreIdx] = offData.threadIdx;
-	futex_unlock(&traceLock);        
 
   }
         
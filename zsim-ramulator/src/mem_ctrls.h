@@ -30,6 +30,7 @@
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "stats.h"
+#include "trace_file.h"
 
 //LOIS
 #include <iostream>
@@ -57,10 +58,11 @@ class MemoryTraces : public MemObject {
     private:
         g_string name;
         uint32_t latency;
-        std::ofstream tracefile;
+        TraceFile tracefile;
         bool only_offload;
         int print_trace;
-	lock_t traceLock;
+        // The per-core counters below are only touched by the thread that
+        // simulates the core, and tracefile takes records without a lock
         //Address previous_rdaddr[MAX_CORES];
         uint64_t previous_instr[MAX_CORES]; 
         int64_t substract[MAX_CORES]; 
@@ -86,7 +88,6 @@ class MemoryTraces : public MemObject {
 		substract[i] = 0;
                 //previous_count[i] = 0;
             }
-	    futex_init(&traceLock); 
        }
         
         MemoryTraces(uint32_t _latency, g_string& _name) : name(_name), latency(_latency) {
@@ -61,6 +61,7 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
     phaseEndCycle = zinfo->phaseLength;
 
     pim_trace = false; // LOIS we get the trace in the MC, not in the core
+    tracefile = nullptr;
     previous_instr = 0;
     ptrace = false;
     print_trace = false;
@@ -106,6 +107,7 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool _on
     phaseEndCycle = zinfo->phaseLength;
 
     pim_trace = false; // LOIS we get the trace in the MC, not in the core
+    tracefile = nullptr;
     previous_instr = 0;
     ptrace = false;
     print_trace = false;
@@ -150,7 +152,7 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool _on
 // Constructor for generating traces in the core, and not in the MC
 // ////////////////////////////////////////////////////////////////
 std::mutex OOOCore::mtx_traces;
-bool OOOCore::file_created = false;
+TraceFile* OOOCore::merged_tracefile = nullptr;
 
 OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool only_offload_, bool instr_trace_, g_string& _outFile, bool _merge_hostTraces) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name) {
     printf("--> Generating traces in the core\n");
@@ -190,13 +192,13 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool onl
     //LOIS
     merge_hostTraces = _merge_hostTraces;
     if(merge_hostTraces){
+      // a single stream, so that compressed traces stay one valid stream
       mtx_traces.lock();
-      if(!file_created) {
-        tracefile.open (_outFile.c_str());
-        file_created = true;
-      } else {
-        tracefile.open (_outFile.c_str(), ios::app);
+      if(!merged_tracefile) {
+        merged_tracefile = new TraceFile();
+        merged_tracefile->open(_outFile.c_str());
       }
+      tracefile = merged_tracefile;
       mtx_traces.unlock();
     } else {
       // GERALDO
@@ -204,7 +206,8 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool onl
       string tmp2(".");
       string to_open = tmp + tmp2 + std::to_string(coreIdx);
       printf("--> Conf File: %s\n", to_open.c_str());
-      tracefile.open(to_open.c_str());
+      tracefile = new TraceFile();
+      tracefile->open(to_open.c_str(), _outFile.c_str());
     }
         
     for (uint32_t i = 0; i < MAX_REGISTERS; i++) {
@@ -526,13 +529,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                         // LOIS
                         if( pim_trace && ptrace ){
                             //THREAD_ID PROCESSOR_ID  CYCLE_NUM TYPE  ADDRESS SIZE
-                            if(merge_hostTraces){
-                              mtx_traces.lock();
-                              tracefile << threadIdx << " "<< coreIdx << " " << previous_instr << " L " << addr << " " <<  size << std::endl;
-                              mtx_traces.unlock();
-                            } else {
-                              tracefile << threadIdx << " "<< coreIdx << " " << previous_instr << " L " << addr << " " <<  size << std::endl;
-                            }
+                            tracefile->write({threadIdx, (int64_t)previous_instr, addr, coreIdx, (int32_t)size, 'L'});
                         } else {
                             // NOtify the MC about the number of instructions 
                             if(!pim_trace && ptrace) {
@@ -589,13 +586,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     // LOIS
                     if( pim_trace &&  ptrace){
                         //THREAD_ID PROCESSOR_ID  CYCLE_NUM TYPE  ADDRESS SIZE
-                        if(merge_hostTraces){
-                          mtx_traces.lock();
-                          tracefile << threadIdx << " " << coreIdx << " " << previous_instr << " S " << addr << " "<< size << std::endl;
-                          mtx_traces.unlock();
-                        } else {
-                          tracefile << threadIdx << " " << coreIdx << " " << previous_instr << " S " << addr << " "<< size << std::endl;
-                        }   
+                        tracefile->write({threadIdx, (int64_t)previous_instr, addr, coreIdx, (int32_t)size, 'S'});
                     } else {
                         // NOtify the MC about the number of instructions 
                         if(!pim_trace && ptrace) {
@@ -720,13 +711,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 	    // LOIS
 	    if( pim_trace && instr_trace && ptrace){
 		//THREAD_ID PROCESSOR_ID  CYCLE_NUM TYPE  ADDRESS SIZE
-        if(merge_hostTraces){
-          mtx_traces.lock();
-		  tracefile << threadIdx << " " << coreIdx << " - "  << " I " << (wrongPathAddr + lineSize*i) << " 64" << std::endl;
-          mtx_traces.unlock();
-        } else {
-		  tracefile << threadIdx << " " << coreIdx << " - "  << " I " << (wrongPathAddr + lineSize*i) << " 64" << std::endl;
-        }
+		tracefile->write({threadIdx, -1, wrongPathAddr + lineSize*i, coreIdx, 64, 'I'});
         //previous_instr = 0;
 	    }
 	}
@@ -754,13 +739,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         // LOIS
         if( pim_trace && instr_trace && ptrace){
             //THREAD_ID PROCESSOR_ID  CYCLE_NUM TYPE  ADDRESS SIZE
-           if(merge_hostTraces){
-             mtx_traces.lock();
-             tracefile << threadIdx << " " << coreIdx << " - "  << " I " << fetchAddr << " 64" << std::endl;
-             mtx_traces.unlock();
-           } else {
-             tracefile << threadIdx << " " << coreIdx << " - "  << " I " << fetchAddr << " 64" << std::endl;
-           }
+            tracefile->write({threadIdx, -1, fetchAddr, coreIdx, 64, 'I'});
              //previous_instr = 0;
         }
     }
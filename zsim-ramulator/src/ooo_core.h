@@ -34,6 +34,7 @@
 #include "memory_hierarchy.h"
 #include "ooo_core_recorder.h"
 #include "pad.h"
+#include "trace_file.h"
 #include <fstream>
 #include <mutex>
 // Uncomment to enable stall stats
@@ -364,7 +365,7 @@ class OOOCore : public Core {
     private:
 	uint32_t coreIdx; // LOIS: for offloading
         uint32_t threadIdx; // LOIS: for offloading
-        std::ofstream tracefile; // for generating trace file
+        TraceFile* tracefile; // for generating trace file
         uint64_t offload_code;
         uint64_t function_offload_instructions;
         bool  only_offload, pim_trace, instr_trace; // generates the trace in the core or in the MC
@@ -373,7 +374,7 @@ class OOOCore : public Core {
     	uint64_t offload_instrs;
         bool merge_hostTraces;
         static std::mutex mtx_traces;
-        static bool file_created; 
+        static TraceFile* merged_tracefile; // shared by all cores when merge_hostTraces
         uint64_t total_missing_instructions; // for debugging
         FilterCache* l1i;
         FilterCache* l1d;
@@ -458,8 +459,8 @@ class OOOCore : public Core {
         OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool only_offload);
         OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, bool only_offload, bool instr_trace_, g_string& _outFile, bool merge_hostTraces);
         ~OOOCore(){
-            if(pim_trace) 
-              tracefile.close();
+            if(pim_trace && !merge_hostTraces)
+              tracefile->close();
         }
         // LOIS
         void offloadFunction_begin() { 
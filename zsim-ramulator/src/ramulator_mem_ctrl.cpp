@@ -0,0 +1,218 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ramulator_mem_ctrl.h"
+#include <map>
+#include <string>
+#include <vector>
+#include "event_recorder.h"
+#include "tick_event.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+#ifdef _WITH_RAMULATOR_ //was compiled with ramulator
+#include "ZsimWrapper.h"
+
+class RamulatorAccEvent : public TimingEvent {
+    private:
+        RamulatorMemory* dram;
+        bool write;
+        Address addr;
+        uint32_t coreId;
+
+    public:
+        uint64_t sCycle;
+
+        RamulatorAccEvent(RamulatorMemory* _dram, bool _write, Address _addr, uint32_t _coreId, int32_t domain) :
+            TimingEvent(0, 0, domain), dram(_dram), write(_write), addr(_addr), coreId(_coreId) {}
+
+        bool isWrite() const {
+            return write;
+        }
+
+        Address getAddr() const {
+            return addr;
+        }
+
+        uint32_t getCoreId() const {
+            return coreId;
+        }
+
+        void simulate(uint64_t startCycle) {
+            sCycle = startCycle;
+            dram->enqueue(this, startCycle);
+        }
+};
+
+// Ramulator keeps its statistics in process-global lists, written once at the end
+static std::vector<RamulatorMemory*> instances;
+
+RamulatorMemory::RamulatorMemory(std::string& configFile, std::string& statsFile, uint32_t cpuFreqMHz, double clockRatio,
+        uint32_t _minLatency, uint32_t _domain, const g_string& _name)
+{
+    if (instances.size()) panic("Ramulator models all channels of the memory, use a single memory controller");
+    instances.push_back(this);
+
+    curCycle = 0;
+    minLatency = _minLatency;
+    // NOTE: this will alloc DRAM on the heap and not the glob_heap, make sure only one process ever handles this
+    dramCore = new ramulator::ZsimWrapper(configFile.c_str(), statsFile.c_str(), zinfo->numCores, zinfo->lineSize,
+            &RamulatorMemory::readDone, this);
+
+    // memory cycles per cycle of the domain, e.g. 0.5 for DDR4-2400 (1200 MHz) at 2400 MHz
+    if (clockRatio <= 0) clockRatio = 1000.0 / (dramCore->tCK * cpuFreqMHz);
+    cpuTick = 1000000;
+    memTick = cpuTick / clockRatio;
+    cpuTime = 0;
+    nextMemTime = memTick;
+    info("[%s] Ramulator tCK %.3f ns, %.3f memory cycles per cycle", _name.c_str(), dramCore->tCK, clockRatio);
+
+    domain = _domain;
+    TickEvent<RamulatorMemory>* tickEv = new TickEvent<RamulatorMemory>(this, domain);
+    tickEv->queue(0);  // start the sim at time 0
+
+    name = _name;
+}
+
+void RamulatorMemory::initStats(AggregateStat* parentStat) {
+    AggregateStat* memStats = new AggregateStat();
+    memStats->init(name.c_str(), "Memory controller stats");
+    profReads.init("rd", "Read requests"); memStats->append(&profReads);
+    profWrites.init("wr", "Write requests"); memStats->append(&profWrites);
+    profTotalRdLat.init("rdlat", "Total latency experienced by read requests"); memStats->append(&profTotalRdLat);
+    profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
+    profStalls.init("stalls", "Requests Ramulator could not queue right away"); memStats->append(&profStalls);
+    parentStat->append(memStats);
+}
+
+uint64_t RamulatorMemory::access(MemReq& req) {
+    switch (req.type) {
+        case PUTS:
+        case PUTX:
+            *req.state = I;
+            break;
+        case GETS:
+            *req.state = req.is(MemReq::NOEXCL)? S : E;
+            break;
+        case GETX:
+            *req.state = M;
+            break;
+
+        default: panic("!?");
+    }
+
+    uint64_t respCycle = req.cycle + minLatency;
+    assert(respCycle > req.cycle);
+
+    if ((req.type != PUTS /*discard clean writebacks*/) && zinfo->eventRecorders[req.srcId]) {
+        Address addr = req.lineAddr << lineBits;
+        bool isWrite = (req.type == PUTX);
+        uint32_t coreId = (req.srcId < zinfo->numCores)? req.srcId : 0;
+        RamulatorAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) RamulatorAccEvent(this, isWrite, addr, coreId, domain);
+        memEv->setMinStartCycle(req.cycle);
+        TimingRecord tr = {addr, req.cycle, respCycle, req.type, memEv, memEv};
+        zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+    }
+
+    return respCycle;
+}
+
+uint32_t RamulatorMemory::tick(uint64_t cycle) {
+    cpuTime += cpuTick;
+    while (nextMemTime <= cpuTime) {
+        while (!overflowRequests.empty() && send(overflowRequests.front())) overflowRequests.pop_front();
+        dramCore->tick();
+        nextMemTime += memTick;
+    }
+    curCycle++;
+    return 1;
+}
+
+void RamulatorMemory::enqueue(RamulatorAccEvent* ev, uint64_t cycle) {
+    //info("[%s] %s access to %lx added at %ld, %ld inflight reqs", getName(), ev->isWrite()? "Write" : "Read", ev->getAddr(), cycle, inflightRequests.size());
+    ev->hold();
+    // keep the order of the requests Ramulator rejected
+    if (!overflowRequests.empty() || !send(ev)) {
+        profStalls.inc();
+        overflowRequests.push_back(ev);
+    }
+}
+
+bool RamulatorMemory::send(RamulatorAccEvent* ev) {
+    if (!dramCore->send(ev->getAddr(), ev->isWrite(), ev->getCoreId())) return false;
+    if (ev->isWrite()) {
+        // writes are posted, they are done once Ramulator queued them
+        profWrites.inc();
+        profTotalWrLat.inc(curCycle+1 - ev->sCycle);
+        ev->release();
+        ev->done(curCycle+1);
+    } else {
+        inflightRequests.insert(std::pair<Address, RamulatorAccEvent*>(ev->getAddr(), ev));
+    }
+    return true;
+}
+
+void RamulatorMemory::readDone(void* mem, long addr) {
+    static_cast<RamulatorMemory*>(mem)->DRAM_read_return_cb(addr);
+}
+
+void RamulatorMemory::DRAM_read_return_cb(uint64_t addr) {
+    std::multimap<uint64_t, RamulatorAccEvent*>::iterator it = inflightRequests.find(addr);
+    assert((it != inflightRequests.end()));
+    RamulatorAccEvent* ev = it->second;
+
+    uint32_t lat = curCycle+1 - ev->sCycle;
+    profReads.inc();
+    profTotalRdLat.inc(lat);
+
+    ev->release();
+    ev->done(curCycle+1);
+    inflightRequests.erase(it);
+    //info("[%s] Read access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), addr, curCycle, curCycle-ev->sCycle, inflightRequests.size());
+}
+
+void RamulatorMemory::finishAll() {
+    for (RamulatorMemory* mem : instances) mem->dramCore->finish();
+    instances.clear();
+}
+
+#else //no ramulator, have the class fail when constructed
+
+RamulatorMemory::RamulatorMemory(std::string& configFile, std::string& statsFile, uint32_t cpuFreqMHz, double clockRatio,
+        uint32_t _minLatency, uint32_t _domain, const g_string& _name)
+{
+    panic("Cannot use RamulatorMemory, zsim was not compiled with Ramulator");
+}
+
+void RamulatorMemory::initStats(AggregateStat* parentStat) { panic("???"); }
+uint64_t RamulatorMemory::access(MemReq& req) { panic("???"); return 0; }
+uint32_t RamulatorMemory::tick(uint64_t cycle) { panic("???"); return 0; }
+void RamulatorMemory::enqueue(RamulatorAccEvent* ev, uint64_t cycle) { panic("???"); }
+void RamulatorMemory::finishAll() {}
+bool RamulatorMemory::send(RamulatorAccEvent* ev) { panic("???"); return false; }
+void RamulatorMemory::DRAM_read_return_cb(uint64_t addr) { panic("???"); }
+void RamulatorMemory::readDone(void* mem, long addr) { panic("???"); }
+
+#endif
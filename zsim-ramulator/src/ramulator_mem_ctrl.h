@@ -0,0 +1,106 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RAMULATOR_MEM_CTRL_H_
+#define RAMULATOR_MEM_CTRL_H_
+
+#include <deque>
+#include <map>
+#include <string>
+#include "g_std/g_string.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+namespace ramulator {
+    class ZsimWrapper;
+};
+
+class RamulatorAccEvent;
+
+/* Ramulator in-process, as the main memory of the weave phase. Accesses are
+ * bound with minLatency and then simulated by Ramulator, whose completed reads
+ * finish the access events, so DRAM contention feeds back into the cores
+ * instead of going through a trace file. Ramulator models every channel (or
+ * HMC vault) of the memory, so there is one instance for all of them.
+ *
+ * Ramulator is ticked at its own clock: clockRatio memory cycles per cycle of
+ * the domain, by default the system frequency over the frequency of the DRAM
+ * standard. Requests Ramulator cannot queue yet are retried every memory
+ * cycle, in order.
+ */
+class RamulatorMemory : public MemObject {
+    private:
+        g_string name;
+        uint32_t minLatency;
+        uint32_t domain;
+
+        ramulator::ZsimWrapper* dramCore;
+
+        std::multimap<uint64_t, RamulatorAccEvent*> inflightRequests;
+        std::deque<RamulatorAccEvent*> overflowRequests;  // not accepted yet
+
+        uint64_t curCycle; //processor cycle, used in callbacks
+        // a cycle of the domain is cpuTick long, one of the memory memTick;
+        // the memory is ticked whenever cpuTime passes nextMemTime
+        uint64_t cpuTick, memTick;
+        uint64_t cpuTime, nextMemTime;
+
+        // R/W stats
+        PAD();
+        Counter profReads;
+        Counter profWrites;
+        Counter profTotalRdLat;
+        Counter profTotalWrLat;
+        Counter profStalls;
+        PAD();
+
+    public:
+        RamulatorMemory(std::string& configFile, std::string& statsFile, uint32_t cpuFreqMHz, double clockRatio,
+                uint32_t _minLatency, uint32_t _domain, const g_string& _name);
+
+        const char* getName() {return name.c_str();}
+
+        void initStats(AggregateStat* parentStat);
+
+        // Record accesses
+        uint64_t access(MemReq& req);
+
+        // Event-driven simulation (phase 2)
+        uint32_t tick(uint64_t cycle);
+        void enqueue(RamulatorAccEvent* ev, uint64_t cycle);
+
+        // writes the Ramulator statistics of every instance (end of simulation)
+        static void finishAll();
+
+        // LOIS: not supported
+        uint64_t offload(offloadInfo offData){assert(0);}
+    private:
+        bool send(RamulatorAccEvent* ev);
+        void DRAM_read_return_cb(uint64_t addr);
+        static void readDone(void* mem, long addr);
+};
+
+#endif  // RAMULATOR_MEM_CTRL_H_
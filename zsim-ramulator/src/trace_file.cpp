@@ -0,0 +1,270 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace_file.h"
+#include <sched.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "log.h"
+
+static bool endsWith(const char* str, const char* suffix) {
+    size_t len = strlen(str), suffixLen = strlen(suffix);
+    return len >= suffixLen && strcmp(str + len - suffixLen, suffix) == 0;
+}
+
+TraceFileBuf::TraceFileBuf() : file(nullptr), codec(PLAIN) {
+    memset(&zs, 0, sizeof(zs));
+    xz = LZMA_STREAM_INIT;
+#ifdef _WITH_ZSTD_
+    zstd = nullptr;
+#endif
+}
+
+TraceFileBuf::~TraceFileBuf() {
+    close();
+}
+
+bool TraceFileBuf::open(const char* filename, const char* baseName) {
+    close();
+    codec = PLAIN;
+    bool ok = true;
+    if (endsWith(baseName, ".gz")) {
+        codec = GZIP;
+        memset(&zs, 0, sizeof(zs));
+        // 16: gzip header and trailer
+        ok = deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    } else if (endsWith(baseName, ".xz")) {
+        codec = XZ;
+        xz = LZMA_STREAM_INIT;
+        ok = lzma_easy_encoder(&xz, 6, LZMA_CHECK_CRC64) == LZMA_OK;
+    } else if (endsWith(baseName, ".zst")) {
+#ifdef _WITH_ZSTD_
+        codec = ZSTD;
+        zstd = ZSTD_createCStream();
+        ok = zstd && !ZSTD_isError(ZSTD_initCStream(zstd, 3));
+#else
+        warn("zstd traces need zsim built with ZSTDPATH, writing %s uncompressed", filename);
+#endif
+    }
+    if (ok) file = fopen(filename, "w");
+    if (!file) {
+        warn("Could not open trace file %s", filename);
+        return false;
+    }
+    setp(buffer, buffer + BUF_SIZE);
+    return true;
+}
+
+void TraceFileBuf::close() {
+    if (!file) return;
+    if (!flushBuffer(true)) warn("Error writing trace file");
+    switch (codec) {
+        case GZIP: deflateEnd(&zs); break;
+        case XZ: lzma_end(&xz); break;
+#ifdef _WITH_ZSTD_
+        case ZSTD: ZSTD_freeCStream(zstd); zstd = nullptr; break;
+#endif
+        default: break;
+    }
+    fclose(file);
+    file = nullptr;
+}
+
+int TraceFileBuf::overflow(int c) {
+    if (!file || !flushBuffer(false)) return traits_type::eof();
+    if (c != traits_type::eof()) {
+        *pptr() = c;
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int TraceFileBuf::sync() {
+    // std::endl syncs after every line: plain text goes out to stdio, compressed
+    // text stays buffered so that the compressor sees large blocks
+    if (file && codec == PLAIN) return flushBuffer(false)? 0 : -1;
+    return 0;
+}
+
+bool TraceFileBuf::flushBuffer(bool finish) {
+    size_t size = pptr() - pbase();
+    setp(buffer, buffer + BUF_SIZE);
+    bool ok = true;
+    switch (codec) {
+        case PLAIN:
+            ok = fwrite(buffer, 1, size, file) == size;
+            break;
+        case GZIP:
+            zs.next_in = (Bytef*)buffer;
+            zs.avail_in = size;
+            while (true) {
+                zs.next_out = (Bytef*)out;
+                zs.avail_out = BUF_SIZE;
+                int ret = deflate(&zs, finish? Z_FINISH : Z_NO_FLUSH);
+                if (ret == Z_STREAM_ERROR) return false;
+                size_t bytes = BUF_SIZE - zs.avail_out;
+                ok = ok && fwrite(out, 1, bytes, file) == bytes;
+                if (finish? ret == Z_STREAM_END : (zs.avail_in == 0 && zs.avail_out != 0)) break;
+            }
+            break;
+        case XZ:
+            xz.next_in = (const uint8_t*)buffer;
+            xz.avail_in = size;
+            while (true) {
+                xz.next_out = (uint8_t*)out;
+                xz.avail_out = BUF_SIZE;
+                lzma_ret ret = lzma_code(&xz, finish? LZMA_FINISH : LZMA_RUN);
+                if (ret != LZMA_OK && ret != LZMA_STREAM_END) return false;
+                size_t bytes = BUF_SIZE - xz.avail_out;
+                ok = ok && fwrite(out, 1, bytes, file) == bytes;
+                if (finish? ret == LZMA_STREAM_END : (xz.avail_in == 0 && xz.avail_out != 0)) break;
+            }
+            break;
+#ifdef _WITH_ZSTD_
+        case ZSTD: {
+            ZSTD_inBuffer in = {buffer, size, 0};
+            size_t remaining = 1;
+            while (in.pos < in.size || (finish && remaining)) {
+                ZSTD_outBuffer o = {out, BUF_SIZE, 0};
+                remaining = (in.pos < in.size)? ZSTD_compressStream(zstd, &o, &in) : ZSTD_endStream(zstd, &o);
+                if (ZSTD_isError(remaining)) return false;
+                ok = ok && fwrite(out, 1, o.pos, file) == o.pos;
+            }
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+    return ok;
+}
+
+/* TraceFile */
+
+static std::mutex openFilesLock;
+static std::vector<TraceFile*> openFiles;
+
+TraceFile::TraceFile() : std::ostream(&buf) {
+    resetRing();
+}
+
+void TraceFile::resetRing() {
+    for (uint64_t i = 0; i < RING_SIZE; i++) ring[i].seq.store(i, std::memory_order_relaxed);
+    head = 0;
+    tail.store(0, std::memory_order_relaxed);
+    draining.store(false, std::memory_order_release);
+}
+
+void TraceFile::open(const char* filename, const char* baseName) {
+    resetRing();
+    if (buf.open(filename, baseName? baseName : filename)) {
+        clear();
+        std::lock_guard<std::mutex> guard(openFilesLock);
+        openFiles.push_back(this);
+    } else {
+        setstate(std::ios::failbit);
+    }
+}
+
+void TraceFile::close() {
+    if (!buf.isOpen()) return;
+    // wait for records that are still being queued
+    while (!drain() || head != tail.load(std::memory_order_acquire)) sched_yield();
+    buf.close();
+    std::lock_guard<std::mutex> guard(openFilesLock);
+    openFiles.erase(std::remove(openFiles.begin(), openFiles.end(), this), openFiles.end());
+}
+
+void TraceFile::closeAll() {
+    std::vector<TraceFile*> files;
+    {
+        std::lock_guard<std::mutex> guard(openFilesLock);
+        files.swap(openFiles);
+    }
+    for (TraceFile* f : files) f->close();
+}
+
+void TraceFile::write(const TraceRecord& rec) {
+    uint64_t seq = tail.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = ring[seq & (RING_SIZE - 1)];
+    // the ring is full until the record RING_SIZE places back is written out
+    while (slot.seq.load(std::memory_order_acquire) != seq) {
+        if (!drain()) sched_yield();
+    }
+    slot.rec = rec;
+    slot.seq.store(seq + 1, std::memory_order_release);
+    if ((seq & (DRAIN_BLOCK - 1)) == DRAIN_BLOCK - 1) drain();
+}
+
+bool TraceFile::drain() {
+    if (draining.exchange(true, std::memory_order_acquire)) return false;
+    while (true) {
+        Slot& slot = ring[head & (RING_SIZE - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != head + 1) break;  // not filled yet
+        format(slot.rec);
+        slot.seq.store(head + RING_SIZE, std::memory_order_release);
+        head++;
+    }
+    draining.store(false, std::memory_order_release);
+    return true;
+}
+
+static char* formatUint(char* p, uint64_t v) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+void TraceFile::format(const TraceRecord& rec) {
+    char line[128];
+    char* p = line;
+    p = formatUint(p, rec.thread);
+    *p++ = ' ';
+    p = formatUint(p, rec.core);
+    *p++ = ' ';
+    if (rec.instrs < 0) {
+        *p++ = '-';
+        *p++ = ' ';
+    } else {
+        p = formatUint(p, rec.instrs);
+    }
+    *p++ = ' ';
+    *p++ = rec.type;
+    *p++ = ' ';
+    p = formatUint(p, rec.addr);
+    if (rec.size >= 0) {
+        *p++ = ' ';
+        p = formatUint(p, rec.size);
+    }
+    *p++ = '\n';
+    buf.sputn(line, p - line);
+}
@@ -0,0 +1,134 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_FILE_H_
+#define TRACE_FILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+#include <lzma.h>
+#include <zlib.h>
+#ifdef _WITH_ZSTD_
+#include <zstd.h>
+#endif
+
+/* A record of a Ramulator trace, written as "thread core instrs type addr
+ * size". Instruction fetches have no instruction count (instrs < 0, written
+ * as "-"), and the host traces of MemoryTraces have no size (size < 0).
+ */
+struct TraceRecord {
+    uint64_t thread;
+    int64_t instrs;
+    uint64_t addr;
+    uint32_t core;
+    int32_t size;
+    char type;
+};
+
+/* Output stream for the Ramulator traces. The file is compressed when its
+ * name (or the base name of per-core traces, e.g. traces.gz for traces.gz.0)
+ * ends in .gz, .xz or .zst (zstd needs ZSTDPATH at build time), and written
+ * as plain text otherwise; Ramulator reads all of them directly.
+ *
+ * A compressed file is only complete after close(). Files that are still open
+ * at the end of the simulation are closed by TraceFile::closeAll().
+ *
+ * Cores queue records with write(), which takes no lock: a record reserves
+ * the next slot of a ring with one atomic increment, which is also its
+ * position in the file. Whichever thread completes a block of records formats
+ * and writes out the ring up to the first slot that is still being filled.
+ * (zsim runs inside Pin, so there is no writer thread of our own.)
+ */
+class TraceFileBuf : public std::streambuf {
+    public:
+        TraceFileBuf();
+        ~TraceFileBuf();
+
+        bool open(const char* filename, const char* baseName);
+        void close();
+        bool isOpen() const {return file != nullptr;}
+
+    protected:
+        int overflow(int c);
+        int sync();
+
+    private:
+        enum Codec {PLAIN, GZIP, XZ, ZSTD};
+
+        // compresses and writes the buffered text; finish ends the stream
+        bool flushBuffer(bool finish);
+
+        FILE* file;
+        Codec codec;
+        static const size_t BUF_SIZE = 1 << 16;
+        char buffer[BUF_SIZE];
+        char out[BUF_SIZE];
+        z_stream zs;
+        lzma_stream xz;
+#ifdef _WITH_ZSTD_
+        ZSTD_CStream* zstd;
+#endif
+};
+
+class TraceFile : public std::ostream {
+    public:
+        TraceFile();
+        ~TraceFile() {close();}
+
+        // baseName selects the compression, it defaults to filename
+        void open(const char* filename, const char* baseName = nullptr);
+        void close();
+        bool is_open() const {return buf.isOpen();}
+
+        // closes every open trace file of this process
+        static void closeAll();
+
+        // queues a record, safe to call from several threads at once
+        void write(const TraceRecord& rec);
+
+    private:
+        struct Slot {
+            std::atomic<uint64_t> seq;  // record number the slot holds (+1 once filled)
+            TraceRecord rec;
+        };
+        static const uint64_t RING_SIZE = 1 << 13;  // records
+        static const uint64_t DRAIN_BLOCK = 1 << 10;
+
+        // writes out the filled records in order; false if another thread is at it
+        bool drain();
+        void format(const TraceRecord& rec);
+        void resetRing();
+
+        TraceFileBuf buf;
+        Slot ring[RING_SIZE];
+        std::atomic<uint64_t> tail;  // next record number to reserve
+        uint64_t head;  // next record number to write out, owned by the draining thread
+        std::atomic<bool> draining;
+};
+
+#endif  // TRACE_FILE_H_
@@ -56,9 +56,11 @@
 #include "pin_cmd.h"
 #include "process_tree.h"
 #include "profile_stats.h"
+#include "ramulator_mem_ctrl.h"
 #include "scheduler.h"
 #include "stats.h"
 #include "trace_driver.h"
+#include "trace_file.h"
 #include "virt/virt.h"
 
 //#include <signal.h> //can't include this, conflicts with PIN's
@@ -1144,6 +1146,7 @@ VOID SimEnd() {
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        RamulatorMemory::finishAll();  // writes the Ramulator stats
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
     }
@@ -1151,6 +1154,7 @@ VOID SimEnd() {
     //Uncomment when debugging termination races, which can be rare because they are triggered by threads of a dying process
     //sleep(5);
 
+    TraceFile::closeAll();  // compressed Ramulator traces are only valid once closed
     exit(0);
 }
 